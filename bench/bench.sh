@@ -0,0 +1,68 @@
+#!/bin/sh
+# Runs the benchmark kernels headless, one line per kernel and core
+#	Usage: bench.sh riscvcpu results.tsv [baseline.tsv]
+#	Results are tab separated: kernel, core, stop, retired, seconds, MIPS,
+#	exit status (- if the kernel didn't exit).
+#	With a baseline (results of an earlier run), MIPS are compared.
+#	BENCH_CORES and BENCH_MEM override the cores and the guest memory size.
+#	Fails if a kernel doesn't halt or exits with another status than the
+#	one of its "bench-exit:" line (0 if none), they check their own result.
+#	A "bench-options:" line of the source adds options to its runs.
+
+CPU=$1
+OUT=$2
+BASELINE=$3
+CORES=${BENCH_CORES:-"call goto jit"}
+MEM=${BENCH_MEM:-0x400000}
+DIR=$(dirname "$0")
+
+if [ -z "$CPU" ] || [ -z "$OUT" ]; then
+	echo "Usage: $0 riscvcpu results.tsv [baseline.tsv]" >&2
+	exit 1
+fi
+
+printf "kernel\tcore\tstop\tretired\tseconds\tmips\texit\n" > "$OUT"
+EXPECTED=""
+for bin in "$DIR"/*.bin; do
+	kernel=$(basename "$bin" .bin)
+	options=$(sed -n 's/^#[[:space:]]*bench-options:[[:space:]]*//p' "${bin%.bin}.s" 2>/dev/null)
+	expected=$(sed -n 's/^#[[:space:]]*bench-exit:[[:space:]]*//p' "${bin%.bin}.s" 2>/dev/null)
+	EXPECTED="$EXPECTED $kernel=${expected:-0}"
+	for core in $CORES; do
+		# Its output, if any, isn't parsed: only the last lines are ours
+		"$CPU" -r -m "$MEM" -c "$core" $options "$bin" | awk -v kernel="$kernel" -v core="$core" '
+			BEGIN { code = "-" }
+			/^stop:/ { stop = $2; sub(",", "", stop) }
+			/^retired:/ { retired = $2; seconds = $4; mips = $7; sub(",", "", retired); sub(",", "", seconds) }
+			/^exit:/ { code = $2 }
+			END { printf "%s\t%s\t%s\t%s\t%s\t%s\t%s\n", kernel, core, stop, retired, seconds, mips, code }
+		' >> "$OUT"
+	done
+done
+
+# Report, against the baseline if any
+awk -F '\t' -v baseline="$BASELINE" -v expected="$EXPECTED" '
+	BEGIN {
+		n = split(expected, e, " ")
+		for(i=1 ; i<=n ; i++){
+			split(e[i], f, "=")
+			code[f[1]] = f[2]
+		}
+		if(baseline != ""){
+			while((getline line < baseline) > 0){
+				split(line, f, "\t")
+				base[f[1] "\t" f[2]] = f[6]
+			}
+		}
+	}
+	NR == 1 { next }
+	{
+		printf "%-8s %-5s %-10s %12s %10.6f s %10.2f MIPS exit %-3s", $1, $2, $3, $4, $5, $6, $7
+		if(($1 "\t" $2) in base && base[$1 "\t" $2] > 0)
+			printf " %+7.1f%%", ($6 / base[$1 "\t" $2] - 1) * 100
+		printf "\n"
+		if($3 != "halt" || $7 != code[$1])
+			failed = 1
+	}
+	END { exit failed }
+' "$OUT"
@@ -0,0 +1,58 @@
+# CRC-32 (reflected, polynomial 0xEDB88320), bit by bit
+#	Arithmetic and logic heavy: shifts, xors and a data dependent branch
+#	per bit. A 64 KiB buffer of xorshift32 bytes is hashed PASSES times.
+
+	.equ BUF, 0x10000
+	.equ SIZE, 0x10000
+	.equ PASSES, 8
+	.equ EXPECTED, 0xa81a8029
+
+	.text
+	.globl _start
+_start:
+	# Fill the buffer
+	li s0, BUF
+	li s1, BUF + SIZE
+	li t0, 0x2545F491	# xorshift32 state
+	mv t1, s0
+fill:
+	slli t2, t0, 13
+	xor t0, t0, t2
+	srli t2, t0, 17
+	xor t0, t0, t2
+	slli t2, t0, 5
+	xor t0, t0, t2
+	sb t0, 0(t1)
+	addi t1, t1, 1
+	bne t1, s1, fill
+
+	li a0, -1		# crc
+	li s2, 0xEDB88320
+	li s3, PASSES
+pass:
+	mv t1, s0
+byte:
+	lbu t2, 0(t1)
+	xor a0, a0, t2
+	li t3, 8
+bit:
+	andi t4, a0, 1
+	srli a0, a0, 1
+	beqz t4, 1f
+	xor a0, a0, s2
+1:
+	addi t3, t3, -1
+	bnez t3, bit
+	addi t1, t1, 1
+	bne t1, s1, byte
+	addi s3, s3, -1
+	bnez s3, pass
+	not a0, a0
+
+	li t0, EXPECTED
+	bne a0, t0, fail
+	li a0, 0
+	li a7, 93		# exit
+	ecall
+fail:
+	ebreak
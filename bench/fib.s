@@ -0,0 +1,42 @@
+# Recursive Fibonacci
+#	Call heavy: two calls per level, return address and argument saved on
+#	the stack, short bodies in between.
+
+	.equ N, 28
+	.equ EXPECTED, 317811
+
+	.text
+	.globl _start
+_start:
+	li a0, N
+	call fib
+
+	li t0, EXPECTED
+	bne a0, t0, fail
+	li a0, 0
+	li a7, 93		# exit
+	ecall
+fail:
+	ebreak
+
+# a0 = fib(a0)
+fib:
+	li t0, 2
+	bltu a0, t0, 1f
+	addi sp, sp, -12
+	sw ra, 8(sp)
+	sw s0, 4(sp)
+	sw s1, 0(sp)
+	mv s0, a0
+	addi a0, a0, -1
+	call fib
+	mv s1, a0
+	addi a0, s0, -2
+	call fib
+	add a0, a0, s1
+	lw s1, 0(sp)
+	lw s0, 4(sp)
+	lw ra, 8(sp)
+	addi sp, sp, 12
+1:
+	ret
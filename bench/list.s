@@ -0,0 +1,71 @@
+# Linked list walk
+#	Pointer chasing: each load address comes from the previous load. The
+#	NODES nodes of 8 bytes (next, value) are linked in the order of the
+#	LCG i -> 5 * i + 1 mod NODES, a single cycle scattered over 512 KiB.
+
+	.equ BUF, 0x10000
+	.equ NODES, 0x10000
+	.equ LOOPS, 64
+	.equ EXPECTED, 0x297a9db1
+
+	.text
+	.globl _start
+_start:
+	# node[i].next = &node[(5 * i + 1) % NODES], node[i].value = i ^ (i >> 3)
+	li s0, BUF
+	li s1, NODES - 1
+	li t0, 0
+link:
+	slli t1, t0, 2
+	add t1, t1, t0
+	addi t1, t1, 1
+	and t1, t1, s1
+	slli t1, t1, 3
+	add t1, t1, s0
+	slli t2, t0, 3
+	add t2, t2, s0
+	sw t1, 0(t2)
+	srli t3, t0, 3
+	xor t3, t3, t0
+	sw t3, 4(t2)
+	addi t0, t0, 1
+	bne t0, s1, link
+	# Last node, NODES - 1
+	slli t1, s1, 2
+	add t1, t1, s1
+	addi t1, t1, 1
+	and t1, t1, s1
+	slli t1, t1, 3
+	add t1, t1, s0
+	slli t2, s1, 3
+	add t2, t2, s0
+	sw t1, 0(t2)
+	srli t3, s1, 3
+	xor t3, t3, s1
+	sw t3, 4(t2)
+
+	# Walk the whole cycle LOOPS times
+	li a0, 0
+	mv t0, s0
+	li s2, LOOPS
+loop:
+	li t3, NODES
+walk:
+	lw t1, 4(t0)
+	lw t0, 0(t0)
+	add a0, a0, t1
+	slli t2, a0, 1
+	srli a0, a0, 31
+	or a0, a0, t2
+	addi t3, t3, -1
+	bnez t3, walk
+	addi s2, s2, -1
+	bnez s2, loop
+
+	li t0, EXPECTED
+	bne a0, t0, fail
+	li a0, 0
+	li a7, 93		# exit
+	ecall
+fail:
+	ebreak
@@ -0,0 +1,89 @@
+# Integer matrix multiply, C = A x B with N x N words
+#	RV32I has no multiply: every product calls a shift and add routine,
+#	which mixes calls, data dependent branches and arithmetic.
+#	Elements are below 256, the routine loops over the bits of one factor.
+
+	.equ A, 0x10000
+	.equ B, 0x11000
+	.equ C, 0x12000
+	.equ N, 24
+	.equ ROUNDS, 20
+	.equ EXPECTED, 0xf2d47e00
+
+	.text
+	.globl _start
+_start:
+	# a[i] = i & 0xFF, b[i] = (i * 7 + 3) & 0xFF
+	li s0, A
+	li s1, B
+	li t0, 0
+	li t1, N * N
+	li t3, 3
+init:
+	andi t2, t0, 0xFF
+	sw t2, 0(s0)
+	andi t2, t3, 0xFF
+	sw t2, 0(s1)
+	addi s0, s0, 4
+	addi s1, s1, 4
+	addi t3, t3, 7
+	addi t0, t0, 1
+	bne t0, t1, init
+
+	li s11, ROUNDS
+	li s10, 0		# checksum
+round:
+	li s0, A		# row of a
+	li s2, C		# c[i][j]
+	li s6, A + N * N * 4
+row:
+	li s1, B		# column of b
+	li s7, B + N * 4
+col:
+	li s3, 0		# sum
+	mv s4, s0
+	mv s5, s1
+	li s8, N
+dot:
+	lw a0, 0(s4)
+	lw a1, 0(s5)
+	call mulu
+	add s3, s3, a0
+	addi s4, s4, 4
+	addi s5, s5, N * 4
+	addi s8, s8, -1
+	bnez s8, dot
+	sw s3, 0(s2)
+	add s10, s10, s3
+	addi s2, s2, 4
+	addi s1, s1, 4
+	bne s1, s7, col
+	addi s0, s0, N * 4
+	bne s0, s6, row
+	addi s11, s11, -1
+	bnez s11, round
+
+	mv a0, s10
+	li t0, EXPECTED
+	bne a0, t0, fail
+	li a0, 0
+	li a7, 93		# exit
+	ecall
+fail:
+	ebreak
+
+# a0 = a0 * a1 (unsigned, low 32 bits)
+mulu:
+	li t0, 0
+1:
+	beqz a1, 3f
+	andi t1, a1, 1
+	beqz t1, 2f
+	add t0, t0, a0
+2:
+	slli a0, a0, 1
+	srli a1, a1, 1
+	j 1b
+3:
+	mv a0, t0
+	ret
@@ -0,0 +1,73 @@
+# Insertion sort of xorshift32 words
+#	Branch heavy: the inner loop compares and moves one word per iteration.
+#	ROUNDS arrays of COUNT words are filled, sorted (unsigned) then folded
+#	into a checksum.
+
+	.equ BUF, 0x10000
+	.equ COUNT, 2048
+	.equ ROUNDS, 4
+	.equ EXPECTED, 0x48c1dda7
+
+	.text
+	.globl _start
+_start:
+	li s0, BUF
+	li s1, BUF + COUNT * 4
+	li s2, ROUNDS
+	li t0, 0x9E3779B9	# xorshift32 state
+	li a0, 0		# checksum
+round:
+	# Fill
+	mv t1, s0
+fill:
+	slli t2, t0, 13
+	xor t0, t0, t2
+	srli t2, t0, 17
+	xor t0, t0, t2
+	slli t2, t0, 5
+	xor t0, t0, t2
+	sw t0, 0(t1)
+	addi t1, t1, 4
+	bne t1, s1, fill
+
+	# Sort: a[0..i) is sorted, insert a[i]
+	addi t1, s0, 4
+outer:
+	lw t2, 0(t1)		# key
+	mv t3, t1
+inner:
+	beq t3, s0, place
+	lw t4, -4(t3)
+	bgeu t2, t4, place
+	sw t4, 0(t3)
+	addi t3, t3, -4
+	j inner
+place:
+	sw t2, 0(t3)
+	addi t1, t1, 4
+	bne t1, s1, outer
+
+	# Check the order, fold into the checksum
+	mv t1, s0
+	li t4, 0
+check:
+	lw t2, 0(t1)
+	bltu t2, t4, fail
+	mv t4, t2
+	slli t3, a0, 1
+	srli a0, a0, 31
+	or a0, a0, t3
+	xor a0, a0, t2
+	addi t1, t1, 4
+	bne t1, s1, check
+
+	addi s2, s2, -1
+	bnez s2, round
+
+	li t0, EXPECTED
+	bne a0, t0, fail
+	li a0, 0
+	li a7, 93		# exit
+	ecall
+fail:
+	ebreak
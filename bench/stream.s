@@ -0,0 +1,108 @@
+# STREAM-like passes over 3 arrays of 1 MiB
+#	Memory bound: every instruction but the loop control is a load, a store
+#	or works on what was just loaded. Loops are unrolled by 4.
+#	a[i] = b[i] + (c[i] << 2), then b[i] = a[i] ^ c[i], PASSES times.
+
+	.equ A, 0x10000
+	.equ B, 0x110000
+	.equ C, 0x210000
+	.equ WORDS, 0x40000
+	.equ PASSES, 8
+	.equ EXPECTED, 0x46680000
+
+	.text
+	.globl _start
+_start:
+	# b[i] = i, c[i] = i ^ 0x5A5A5A5A
+	li s1, B
+	li s2, C
+	li s3, WORDS
+	li t1, 0x5A5A5A5A
+	li t0, 0
+init:
+	sw t0, 0(s1)
+	xor t2, t0, t1
+	sw t2, 0(s2)
+	addi s1, s1, 4
+	addi s2, s2, 4
+	addi t0, t0, 1
+	bne t0, s3, init
+
+	li s4, PASSES
+pass:
+	# a[i] = b[i] + (c[i] << 2)
+	li s0, A
+	li s1, B
+	li s2, C
+	li s5, A + WORDS * 4
+triad:
+	lw t0, 0(s1)
+	lw t1, 0(s2)
+	lw t2, 4(s1)
+	lw t3, 4(s2)
+	slli t1, t1, 2
+	slli t3, t3, 2
+	add t0, t0, t1
+	add t2, t2, t3
+	sw t0, 0(s0)
+	sw t2, 4(s0)
+	lw t0, 8(s1)
+	lw t1, 8(s2)
+	lw t2, 12(s1)
+	lw t3, 12(s2)
+	slli t1, t1, 2
+	slli t3, t3, 2
+	add t0, t0, t1
+	add t2, t2, t3
+	sw t0, 8(s0)
+	sw t2, 12(s0)
+	addi s0, s0, 16
+	addi s1, s1, 16
+	addi s2, s2, 16
+	bne s0, s5, triad
+
+	# b[i] = a[i] ^ c[i]
+	li s0, A
+	li s1, B
+	li s2, C
+mix:
+	lw t0, 0(s0)
+	lw t1, 0(s2)
+	lw t2, 4(s0)
+	lw t3, 4(s2)
+	xor t0, t0, t1
+	xor t2, t2, t3
+	sw t0, 0(s1)
+	sw t2, 4(s1)
+	lw t0, 8(s0)
+	lw t1, 8(s2)
+	lw t2, 12(s0)
+	lw t3, 12(s2)
+	xor t0, t0, t1
+	xor t2, t2, t3
+	sw t0, 8(s1)
+	sw t2, 12(s1)
+	addi s0, s0, 16
+	addi s1, s1, 16
+	addi s2, s2, 16
+	bne s0, s5, mix
+
+	addi s4, s4, -1
+	bnez s4, pass
+
+	# Sum of a
+	li s0, A
+	li a0, 0
+sum:
+	lw t0, 0(s0)
+	add a0, a0, t0
+	addi s0, s0, 4
+	bne s0, s5, sum
+
+	li t0, EXPECTED
+	bne a0, t0, fail
+	li a0, 0
+	li a7, 93		# exit
+	ecall
+fail:
+	ebreak
@@ -0,0 +1,83 @@
+# System calls through the proxy
+#	Opens /dev/null, writes BLOCK bytes to it LOOPS times, grows the heap
+#	with brk and uses it, then exits with EXIT_CODE without closing the file.
+#	It runs RUNS times with the written memory restored in between (-k),
+#	which has to close the file and reset the program break and the exit
+#	state: the file is fd 3 and the break the end of the program each time.
+#	bench-options: -k 64
+#	bench-exit: 42
+
+	.equ LOOPS, 2000
+	.equ BLOCK, 64
+	.equ HEAP, 0x10000
+	.equ EXIT_CODE, 42
+
+	.equ AT_FDCWD, -100
+	.equ O_WRONLY, 1
+	.equ SYS_OPENAT, 56
+	.equ SYS_WRITE, 64
+	.equ SYS_EXIT, 93
+	.equ SYS_BRK, 214
+
+	.text
+	.globl _start
+_start:
+	li a0, AT_FDCWD
+	la a1, path
+	li a2, O_WRONLY
+	li a3, 0
+	li a7, SYS_OPENAT
+	ecall
+	li t0, 3
+	bne a0, t0, fail
+	mv s0, a0
+
+	# Writes
+	li s1, LOOPS
+1:	mv a0, s0
+	la a1, path
+	li a2, BLOCK
+	li a7, SYS_WRITE
+	ecall
+	li t0, BLOCK
+	bne a0, t0, fail
+	addi s1, s1, -1
+	bnez s1, 1b
+
+	# Heap, from the end of the program
+	li a0, 0
+	li a7, SYS_BRK
+	ecall
+	la t0, end
+	bne a0, t0, fail
+	li t1, HEAP
+	add s1, a0, t1
+	mv a0, s1
+	li a7, SYS_BRK
+	ecall
+	bne a0, s1, fail
+	# Sum of the words stored over it
+	la t0, end
+	li t1, 0
+	li t2, 0
+2:	sw t1, 0(t0)
+	lw t3, 0(t0)
+	add t2, t2, t3
+	addi t1, t1, 1
+	addi t0, t0, 4
+	bltu t0, s1, 2b
+	# HEAP / 4 words: n * (n - 1) / 2
+	li t0, (HEAP / 4) * (HEAP / 4 - 1) / 2
+	bne t2, t0, fail
+
+	li a0, EXIT_CODE
+	li a7, SYS_EXIT
+	ecall
+
+fail:
+	ebreak
+
+path:
+	.asciz "/dev/null"
+	.balign 4
+end:
@@ -0,0 +1,166 @@
+# Demand paging under Sv32
+#	Traps and translation heavy. M delegates the page faults and the user
+#	ecalls to S and drops to it with a two-level table: a 4 MiB superpage
+#	maps the kernel (and the tables) in place, the second level maps the
+#	user code at UCODE. U touches PAGES unmapped pages of its data window,
+#	each store takes a page fault, S maps the page and returns through sret
+#	to the store, which runs again. U hands S the sum it read back with an
+#	ecall, S checks it, unmaps the window and starts U over, LOOPS times.
+#	M checks the faults S counted.
+
+	.equ ROOT, 0x100000			# first level table
+	.equ L2, 0x101000			# second level table of 0x400000-0x7fffff
+	.equ COUNT, 0x102000		# page faults taken by S
+	.equ UCODE, 0x400000		# user code, maps u_start
+	.equ UDATA, 0x401000		# user data window
+	.equ BACKING, 0x200000		# physical pages of the window
+	.equ PAGES, 64
+	.equ LOOPS, 2000
+
+	.equ PTE_SUPER, 0xcf		# V R W X A D
+	.equ PTE_UCODE, 0x5b		# V R X U A
+	.equ PTE_UDATA, 0xd7		# V R W U A D
+	.equ MEDELEG, (1 << 8) | (1 << 12) | (1 << 13) | (1 << 15)
+	.equ MPP_S, 0x800
+	.equ SPP, 0x100
+	.equ SATP, 0x80000000 | (ROOT >> 12)
+
+	.text
+	.globl _start
+_start:
+	la t0, m_trap
+	csrw mtvec, t0
+	# Tables, the second level zeroed: nothing of the window is mapped
+	li t0, ROOT
+	li t1, PTE_SUPER
+	sw t1, 0(t0)
+	li t1, (L2 >> 12) << 10 | 1
+	sw t1, 4(t0)
+	li t0, L2
+	li t2, L2 + 0x1000
+1:	sw zero, 0(t0)
+	addi t0, t0, 4
+	bltu t0, t2, 1b
+	la t0, u_start
+	srli t0, t0, 12
+	slli t0, t0, 10
+	ori t0, t0, PTE_UCODE
+	li t1, L2
+	sw t0, ((UCODE >> 12) & 0x3ff) * 4(t1)
+	li t0, COUNT
+	sw zero, 0(t0)
+
+	# To S, with translation on
+	li t0, MEDELEG
+	csrw medeleg, t0
+	la t0, s_trap
+	csrw stvec, t0
+	li t0, MPP_S
+	csrw mstatus, t0
+	la t0, s_start
+	csrw mepc, t0
+	li t0, SATP
+	csrw satp, t0
+	sfence.vma
+	mret
+
+s_start:
+	li s10, LOOPS
+	# To U, SPP = U
+	li t0, SPP
+	csrc sstatus, t0
+	li t0, UCODE
+	csrw sepc, t0
+	sret
+
+# S trap handler, U only uses s0-s3 and a0
+	.balign 4
+s_trap:
+	csrr t0, scause
+	li t1, 8
+	beq t0, t1, s_ecall
+	li t1, 15
+	bne t0, t1, s_fail
+	# Store page fault in the window: maps its page
+	csrr t0, stval
+	li t1, UDATA
+	sub t2, t0, t1
+	srli t2, t2, 12
+	li t1, PAGES
+	bgeu t2, t1, s_fail
+	li t1, BACKING >> 12
+	add t2, t2, t1
+	slli t2, t2, 10
+	ori t2, t2, PTE_UDATA
+	srli t0, t0, 12
+	andi t0, t0, 0x3ff
+	slli t0, t0, 2
+	li t1, L2
+	add t0, t0, t1
+	sw t2, 0(t0)
+	li t0, COUNT
+	lw t1, 0(t0)
+	addi t1, t1, 1
+	sw t1, 0(t0)
+	sfence.vma
+	sret
+
+s_ecall:
+	# Sum of 0..PAGES-1
+	li t0, PAGES * (PAGES - 1) / 2
+	bne a0, t0, s_fail
+	# Unmaps the window
+	li t0, L2 + ((UDATA >> 12) & 0x3ff) * 4
+	li t1, PAGES
+2:	sw zero, 0(t0)
+	addi t0, t0, 4
+	addi t1, t1, -1
+	bnez t1, 2b
+	sfence.vma
+	addi s10, s10, -1
+	beqz s10, s_done
+	li t0, UCODE
+	csrw sepc, t0
+	sret
+s_done:
+	li a0, 0
+	ecall
+s_fail:
+	li a0, 1
+	ecall
+
+	.balign 4
+m_trap:
+	csrr t0, mcause
+	li t1, 9
+	bne t0, t1, fail
+	bnez a0, fail
+	li t0, COUNT
+	lw t1, 0(t0)
+	li t2, LOOPS * PAGES
+	bne t1, t2, fail
+	csrw mtvec, zero
+	li a0, 0
+	li a7, 93
+	ecall
+
+fail:
+	csrw mtvec, zero
+	ebreak
+
+	# User code, the first store to each page faults
+	.balign 0x1000
+u_start:
+	li s0, UDATA
+	li s1, 0
+	li s2, PAGES
+	li a0, 0
+3:	sw s1, 0(s0)
+	lw s3, 0(s0)
+	add a0, a0, s3
+	addi s1, s1, 1
+	li s3, 0x1000
+	add s0, s0, s3
+	bne s1, s2, 3b
+	ecall
+4:	j 4b
@@ -10,9 +10,58 @@
 #include <math.h>
 
 
-#define DEBUG 1
+// Build with DEBUG=1 to print every executed instruction
+#ifndef DEBUG
+	#define DEBUG 0
+#endif
 #define DEBUG_PRINT(fmt, ...) do{if(DEBUG) printf(fmt, __VA_ARGS__);}while(0)
 
+// Core used when none is asked for, CORE=CALL, CORE=GOTO or CORE=JIT
+#ifndef RISCV_DEFAULT_CORE
+	#define RISCV_DEFAULT_CORE RISCV_CORE_GOTO
+#endif
+// Computed goto is a gcc extension (clang has it too)
+#if defined(__GNUC__)
+	#define RISCV_HAS_GOTO 1
+#else
+	#define RISCV_HAS_GOTO 0
+#endif
+// The JIT emits x86-64 code into mmap()ed memory
+#if defined(__x86_64__) && defined(__linux__)
+	#define RISCV_HAS_JIT 1
+#else
+	#define RISCV_HAS_JIT 0
+#endif
+
+// Guest memory can be a 4 GiB reservation, out of range accesses fault
+#if UINTPTR_MAX > 0xFFFFFFFF && defined(__linux__)
+	#define RISCV_HAS_GUARD 1
+#else
+	#define RISCV_HAS_GUARD 0
+#endif
+
+// Snapshots share guest memory through a memfd
+#if defined(__linux__)
+	#define RISCV_HAS_SNAP 1
+#else
+	#define RISCV_HAS_SNAP 0
+#endif
+
+// Build with TRACE=1 to be able to record binary execution traces
+#ifndef RISCV_TRACE
+	#define RISCV_TRACE 0
+#endif
+
+// Build with STATS=1 to be able to count executed instructions
+#ifndef RISCV_STATS
+	#define RISCV_STATS 0
+#endif
+
+// Build with PROF=1 to be able to sample guest call stacks
+#ifndef RISCV_PROF
+	#define RISCV_PROF 0
+#endif
+
 // RV32I
 #define BITS 32
 //#define MEM_SIZE 0xFFFF // no need for more
@@ -58,6 +107,9 @@ typedef uint32_t pc_kt;
 
 // Opcodes
 #define OP_BASECODE		0x3
+// Bytes of the instruction starting with these bits, others than OP_BASECODE
+// are compressed ones (C extension, see PolyRISC-V_rvc.h)
+#define RISCV_INSTR_LEN(instr) (((instr) & OP_BASECODE) == OP_BASECODE? 4 : 2)
 #define OP_LOAD			((0x00 << 2) | OP_BASECODE) 
 	#define F3_LOAD_LB			0x0
 	#define F3_LOAD_LH			0x1
@@ -68,6 +120,7 @@ typedef uint32_t pc_kt;
 #define OP_CUSTOM_0		((0x02 << 2) | OP_BASECODE) 
 #define OP_MISC_MEM		((0x03 << 2) | OP_BASECODE) 
 	#define F3_MISC_MEM_FENCE	0x0
+	#define F3_MISC_MEM_FENCE_I	0x1
 #define OP_OP_IMM		((0x04 << 2) | OP_BASECODE) 
 	#define F3_OP_IMM_ADDI		0x0
 	#define F3_OP_IMM_SLTI		0x2
@@ -102,6 +155,16 @@ typedef uint32_t pc_kt;
 		#define	F7_OP_SRLA_SRA			0x20
 	#define	F3_OP_OR			0x6
 	#define	F3_OP_AND			0x7
+	// M extension, funct7 is checked first
+	#define	F7_OP_MULDIV		0x01
+		#define	F3_OP_MULDIV_MUL		0x0
+		#define	F3_OP_MULDIV_MULH		0x1
+		#define	F3_OP_MULDIV_MULHSU		0x2
+		#define	F3_OP_MULDIV_MULHU		0x3
+		#define	F3_OP_MULDIV_DIV		0x4
+		#define	F3_OP_MULDIV_DIVU		0x5
+		#define	F3_OP_MULDIV_REM		0x6
+		#define	F3_OP_MULDIV_REMU		0x7
 #define OP_LUI			((0x0D << 2) | OP_BASECODE) 
 #define OP_OP_32		((0x0E << 2) | OP_BASECODE) 
 
@@ -127,22 +190,209 @@ typedef uint32_t pc_kt;
 	#define F3_SYSTEM_PRIV		0x0
 			#define F12_SYSTEM_PRIV_ECALL	0x000
 			#define F12_SYSTEM_PRIV_EBREAK	0x001
+			#define F12_SYSTEM_PRIV_SRET	0x102
+			#define F12_SYSTEM_PRIV_WFI		0x105
+			#define F12_SYSTEM_PRIV_MRET	0x302
+		#define F7_SYSTEM_PRIV_SFENCE_VMA	0x09 // rs2 and rs1 are operands
+	#define F3_SYSTEM_CSRRW		0x1
+	#define F3_SYSTEM_CSRRS		0x2
+	#define F3_SYSTEM_CSRRC		0x3
+	#define F3_SYSTEM_CSRRWI	0x5
+	#define F3_SYSTEM_CSRRSI	0x6
+	#define F3_SYSTEM_CSRRCI	0x7
 #define OP_RESERVED_2	((0x1D << 2) | OP_BASECODE) 
 #define OP_CUSTOM_3		((0x1E << 2) | OP_BASECODE) 
 
+// Every instruction handler: X(NAME, name) for RISCV_OP_NAME and RISCV_instr_name()
+#define RISCV_INSTR_LIST(X) \
+	X(LUI, lui) X(AUIPC, auipc) X(JAL, jal) X(JALR, jalr) \
+	X(BEQ, beq) X(BNE, bne) X(BLT, blt) X(BGE, bge) X(BLTU, bltu) X(BGEU, bgeu) \
+	X(LB, lb) X(LH, lh) X(LW, lw) X(LBU, lbu) X(LHU, lhu) \
+	X(SB, sb) X(SH, sh) X(SW, sw) \
+	X(ADDI, addi) X(SLTI, slti) X(SLTIU, sltiu) X(XORI, xori) X(ORI, ori) X(ANDI, andi) \
+	X(SLLI, slli) X(SRLI, srli) X(SRAI, srai) \
+	X(ADD, add) X(SUB, sub) X(SLL, sll) X(SLT, slt) X(SLTU, sltu) \
+	X(XOR, xor) X(SRL, srl) X(SRA, sra) X(OR, or) X(AND, and) \
+	X(MUL, mul) X(MULH, mulh) X(MULHSU, mulhsu) X(MULHU, mulhu) \
+	X(DIV, div) X(DIVU, divu) X(REM, rem) X(REMU, remu) \
+	X(FENCE, fence) X(FENCE_I, fence_i) X(ECALL, ecall) X(EBREAK, ebreak) \
+	X(MRET, mret) X(SRET, sret) X(WFI, wfi) X(SFENCE_VMA, sfence_vma) \
+	X(DEBUG_BREAK, debug_break) X(JAL_HALT, jal_halt) X(ILLEGAL, illegal)
+
+// CSR instructions (Zicsr): X(NAME, name) as well
+//	Counters read the instructions retired so far, which only the core knows:
+//	it sets cpu->csr.retired before running one of them.
+#define RISCV_CSR_LIST(X) \
+	X(CSRRW, csrrw) X(CSRRS, csrrs) X(CSRRC, csrrc) \
+	X(CSRRWI, csrrwi) X(CSRRSI, csrrsi) X(CSRRCI, csrrci)
+
+// Fused pairs, common idioms run by one handler: X(NAME, name, FIRST, first, second)
+//	for RISCV_OP_NAME and RISCV_instr_name(), which runs RISCV_instr_first()
+//	then RISCV_instr_second() on the next decoded instruction (di + 1).
+//	The first one never traps.
+#define RISCV_FUSED_LIST(X) \
+	X(LUI_ADDI, lui_addi, LUI, lui, addi) \
+	X(AUIPC_JALR, auipc_jalr, AUIPC, auipc, jalr) \
+	X(ADDI_BNE, addi_bne, ADDI, addi, bne) \
+	X(ADDI_SW, addi_sw, ADDI, addi, sw)
+
+#define RISCV_OP_ENUM(NAME, name) RISCV_OP_##NAME,
+#define RISCV_FUSED_ENUM(NAME, name, FIRST, first, second) RISCV_OP_##NAME,
+typedef enum{
+	RISCV_INSTR_LIST(RISCV_OP_ENUM)
+	RISCV_OP_CSR, // CSR instructions from here on
+	RISCV_OP_CSR_BASE = RISCV_OP_CSR - 1,
+	RISCV_CSR_LIST(RISCV_OP_ENUM)
+	RISCV_OP_FUSED, // fused pairs from here on
+	RISCV_OP_FUSED_BASE = RISCV_OP_FUSED - 1,
+	RISCV_FUSED_LIST(RISCV_FUSED_ENUM)
+	RISCV_OP_COUNT
+}RISCV_op_et;
+
+// Execution cores, same results, different dispatch
+typedef enum{
+	RISCV_CORE_DEFAULT = 0,	// RISCV_DEFAULT_CORE
+	RISCV_CORE_CALL,		// call the cached handler pointer from one loop
+	RISCV_CORE_GOTO,		// threaded code, each handler jumps to the next one
+	RISCV_CORE_JIT			// basic blocks translated to native code
+}RISCV_core_et;
+
+typedef struct RISCV_st RISCV_st;
+typedef struct RISCV_dinstr_st RISCV_dinstr_st;
+typedef struct RISCV_trace_st RISCV_trace_st;
+typedef struct RISCV_stats_st RISCV_stats_st;
+typedef struct RISCV_prof_st RISCV_prof_st;
+typedef struct RISCV_jit_st RISCV_jit_st;
+typedef struct RISCV_symtab_st RISCV_symtab_st;
+typedef struct RISCV_fault_st RISCV_fault_st;
+typedef struct RISCV_dirty_st RISCV_dirty_st;
+typedef struct RISCV_sys_st RISCV_sys_st;
+typedef struct RISCV_mmio_st RISCV_mmio_st;
+typedef struct RISCV_mmu_st RISCV_mmu_st;
+typedef struct RISCV_debug_st RISCV_debug_st;
+
+extern const char REG_NAMES[32][6];
+
+// Instruction handler, executes a decoded instruction
+typedef void (*RISCV_exec_ft)(RISCV_st *cpu, const RISCV_dinstr_st *di);
+
+// Decoded instruction
+//	Filled once by RISCV_decode_instr(), then executed as many times as needed
+struct RISCV_dinstr_st{
+	RISCV_exec_ft exec; // NULL if not decoded yet
+	uint32_t instr;		// raw instruction, the low 16 bits only when compressed
+	int32_t imm;		// sign-extended immediate (shamt for shifts)
+	uint8_t rd;
+	uint8_t rs1;
+	uint8_t rs2;
+	uint8_t op;			// RISCV_op_et, same handler as exec, may be a fused pair
+	uint8_t len;		// bytes, 2 when compressed (of the first one of a pair)
+};
+
+// Cache entry of the instruction following di
+//	The cache has one entry per 16 bits, the second one of a fused pair is
+//	run from there
+static inline const RISCV_dinstr_st* RISCV_dinstr_next(const RISCV_dinstr_st *di)
+{
+	return di + (di->len >> 1);
+}
+
+// Why RISCV_run() returned
+typedef enum{
+	RISCV_STOP_NONE = 0,	// still running
+	RISCV_STOP_BUDGET,		// max instructions retired
+	RISCV_STOP_HALT,		// program ended (exit syscall, jump to itself)
+	RISCV_STOP_TRAP,		// illegal instruction, bad pc or access fault (see cpu->fault), pc points to it
+	RISCV_STOP_BREAKPOINT,	// ebreak, pc points after it
+	RISCV_STOP_DEBUG_BREAK,	// debugger breakpoint (see PolyRISC-V_debug.h), pc points to it, not run yet
+	RISCV_STOP_DEBUG_WATCH,	// store to a watched range, pc points after it
+	RISCV_STOP_SWITCH		// privilege mode or translation changed, internal: RISCV_run() goes on
+}RISCV_stop_et;
+
+// Unprivileged counters (Zicntr), read-only
+//	No timing model: one cycle per instruction, cycle is instret.
+#define CSR_CYCLE		0xC00
+#define CSR_TIME		0xC01
+#define CSR_INSTRET		0xC02
+#define CSR_CYCLEH		0xC80
+#define CSR_TIMEH		0xC81
+#define CSR_INSTRETH	0xC82
+#define CSR_TIME_FREQ	1000000 // Hz, time counts microseconds since RISCV_init()
+
+// CSR file
+//	instret is kept up to date by the cores when they return (the JIT also
+//	before interpreting an instruction), never per instruction.
+typedef struct{
+	uint64_t instret;	// retired before the running core was entered
+	uint64_t retired;	// retired by it since, set when a CSR instruction runs
+	uint64_t time_base;	// host CLOCK_MONOTONIC ns at time 0
+}RISCV_csr_st;
+
+// Privileged state, machine and supervisor CSRs (see PolyRISC-V_priv.h)
+typedef struct{
+	uint8_t mode;		// PRIV_M, PRIV_S or PRIV_U
+	uint32_t mstatus;	// sstatus is a view of it
+	uint32_t medeleg;
+	uint32_t mideleg;
+	uint32_t mie;		// sie is a view of it
+	uint32_t mip;		// MTIP isn't kept, it comes from mtimecmp
+	uint32_t mtvec;
+	uint32_t mcounteren;
+	uint32_t mscratch;
+	uint32_t mepc;
+	uint32_t mcause;
+	uint32_t mtval;
+	uint32_t stvec;
+	uint32_t scounteren;
+	uint32_t sscratch;
+	uint32_t sepc;
+	uint32_t scause;
+	uint32_t stval;
+	uint32_t satp;
+	uint64_t mtimecmp;	// CLINT register, time CSR ticks
+}RISCV_priv_st;
+
 typedef struct{
+	RISCV_stop_et reason;
+	uint64_t retired;	// number of instructions executed
+}RISCV_run_st;
+
+struct RISCV_st{
 	reg_kt reg[32];
 	pc_kt pc;
-	uint8_t *mem;
+	uint8_t *mem; // mmap()ed, pages are zeroed when first touched
 	size_t mem_size;
+	size_t mem_reserved; // bytes of address space at mem
 	size_t stack_top;
 	size_t stack_bot;
-}RISCV_st;
+	RISCV_dinstr_st *icache; // one entry per 16 bits of mem, where an instruction may start
+	size_t icache_size;
+	RISCV_stop_et stop; // set by instructions to end RISCV_run()
+	RISCV_core_et core;
+	RISCV_trace_st *trace; // NULL when not tracing
+	uint32_t trace_addr; // address of the traced load/store
+	RISCV_stats_st *stats; // NULL when not counting
+	RISCV_prof_st *prof; // NULL when not profiling
+	RISCV_jit_st *jit; // NULL unless running with RISCV_CORE_JIT
+	pc_kt entry; // pc after a reset
+	RISCV_symtab_st *symtab; // NULL unless loaded from an ELF
+	RISCV_fault_st *fault; // NULL unless guest memory is guarded
+	uint8_t *pages; // PAGE_ flags per guest page, covers any 32 bits address
+	RISCV_dirty_st *dirty; // NULL unless written pages are tracked
+	RISCV_sys_st *sys; // syscalls of ecall
+	RISCV_mmio_st *mmio; // NULL unless devices are mapped
+	RISCV_mmu_st *mmu; // TLBs of Sv32 translation
+	RISCV_debug_st *debug; // NULL unless breakpoints or watchpoints were set
+	RISCV_csr_st csr;
+	RISCV_priv_st priv;
+};
 
 typedef struct{
 	size_t mem_size;
 	size_t stack_size;
-	bool set_to_0;
+	bool set_to_0; // memory always starts zeroed now, kept for compatibility
+	RISCV_core_et core;
+	bool guard; // out of range accesses trap, mem_size is rounded up to whole pages
 }RISCV_init_op_st;
 
 RISCV_st* RISCV_init(RISCV_init_op_st *options);
@@ -150,20 +400,79 @@ void RISCV_deinit(RISCV_st *cpu);
 void RISCV_load_raw_program(RISCV_st *cpu, const uint8_t *elf, size_t elf_size);
 void RISCV_reset(RISCV_st *cpu);
 void RISCV_step(RISCV_st *cpu);
+RISCV_run_st RISCV_run(RISCV_st *cpu, uint64_t max_instructions);
+void RISCV_icache_flush(RISCV_st *cpu);
+// time CSR, CSR_TIME_FREQ ticks since RISCV_init()
+uint64_t RISCV_time(const RISCV_st *cpu);
+// Decoded pairs fused across addr, from before it, get decoded again
+void RISCV_icache_drop_fused(RISCV_st *cpu, uint32_t addr);
+
+// Large zeroed tables (per guest halfword or page), mmap()ed: clearing one only
+// costs the pages which were used
+#define TABLE_MADVISE_MIN 0x10000 // bytes, memset() below
+void* RISCV_table_alloc(size_t size);
+void RISCV_table_clear(void *table, size_t size);
+void RISCV_table_free(void *table, size_t size);
+
+// Guest pages, cpu->pages
+//	A store checks the flags of the page of its first byte, any of them sends
+//	it to RISCV_page_write(). A store may spill over the next page, so the
+//	page before a flagged one gets flagged too (PAGE_CODE, PAGE_CLEAN_NEXT,
+//	PAGE_WATCH).
+#define RISCV_PAGE_SHIFT	12
+#define RISCV_PAGE_SIZE		(1UL << RISCV_PAGE_SHIFT)
+#define RISCV_PAGES			(1UL << (BITS - RISCV_PAGE_SHIFT))
+#define PAGE_CODE			0x01 // instructions were decoded from it or the next one
+#define PAGE_CLEAN			0x02 // not written since the dirty tracking baseline
+#define PAGE_CLEAN_NEXT		0x04 // the next one is clean
+#define PAGE_BREAK			0x08 // has breakpoints, see PolyRISC-V_debug.h
+#define PAGE_WATCH			0x10 // has watched bytes, or the next one
+
+// Breakpoint patched over the instruction decoded at pc, if it has one
+void RISCV_debug_patch(RISCV_st *cpu, pc_kt pc);
+
+// Decoded instructions come from the page of pc
+//	and the next one when a 32 bits instruction starts 2 bytes before it.
+//	Called once the instruction at pc is decoded, its breakpoint goes over
+//	it from here.
+static inline void RISCV_page_code(RISCV_st *cpu, pc_kt pc)
+{
+	uint32_t page = pc >> RISCV_PAGE_SHIFT;
+
+	if(__builtin_expect(cpu->pages[page] & PAGE_BREAK, 0))
+		RISCV_debug_patch(cpu, pc);
+	cpu->pages[page] |= PAGE_CODE;
+	if(page)
+		cpu->pages[page - 1] |= PAGE_CODE;
+	if(((pc + 2) >> RISCV_PAGE_SHIFT) != page)
+		cpu->pages[(pc + 2) >> RISCV_PAGE_SHIFT] |= PAGE_CODE;
+}
+
+// Slow path of stores of size bytes at addr to flagged pages
+//	Drops the decoded instructions and translated blocks it overwrites,
+//	marks pages dirty, checks watchpoints. Called by translated stores too,
+//	true when the run has to stop after the store (RISCV_STOP_DEBUG_WATCH).
+bool RISCV_page_write(RISCV_st *cpu, uint32_t addr, uint32_t size);
 
 void RISCV_print_reg(RISCV_st *cpu);
 void RISCV_print_pc(RISCV_st *cpu);
 void RISCV_print_mem(RISCV_st *cpu, uint32_t start, uint32_t size);
 
 uint32_t RISCV_fetch_instr(RISCV_st *cpu);
+// Raw instruction at pc, see RISCV_dinstr_st.instr (pc + 2 must be in mem)
+uint32_t RISCV_read_instr(const RISCV_st *cpu, pc_kt pc);
+int RISCV_disasm(const uint32_t instr, const pc_kt pc, char *buf, size_t size);
 
 // Decoding instructions
+void RISCV_decode_instr(const uint32_t instr, RISCV_dinstr_st *di);
+void RISCV_fuse_instr(RISCV_st *cpu, pc_kt pc);
+uint8_t RISCV_op_first(uint8_t op);
 // TODO: use const pointer to const instr instead ? to let compiler optimize things ? (to minimize cache miss ?)
 //	Opcodes
 uint8_t instr_decode_opcode(const uint32_t instr);
 uint8_t instr_decode_funct3(const uint32_t instr);
 uint8_t instr_decode_funct7(const uint32_t instr);
-uint8_t instr_decode_funct12(const uint32_t instr);
+uint16_t instr_decode_funct12(const uint32_t instr);
 //	Arguments fields
 uint8_t instr_decode_rd(const uint32_t instr);
 uint8_t instr_decode_rs1(const uint32_t instr);
@@ -177,45 +486,73 @@ int16_t instr_decode_imm_store(const uint32_t instr);
 uint8_t instr_decode_imm_shamt(const uint32_t instr);
 
 // Instructions implementation
-void RISCV_instr_lui(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_auipc(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_jal(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_jalr(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_beq(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_bne(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_blt(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_bge(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_bltu(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_bgeu(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_lb(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_lh(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_lw(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_lbu(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_lhu(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_sb(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_sh(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_sw(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_addi(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_slti(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_sltiu(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_xori(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_ori(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_andi(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_slli(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_srli(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_srai(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_add(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_sub(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_sll(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_slt(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_sltu(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_xor(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_srl(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_sra(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_or(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_and(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_fence(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_ecall(RISCV_st *cpu, uint32_t instr);
-void RISCV_instr_ebreak(RISCV_st *cpu, uint32_t instr);
+void RISCV_instr_lui(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_auipc(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_jal(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_jalr(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_beq(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_bne(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_blt(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_bge(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_bltu(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_bgeu(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_lb(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_lh(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_lw(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_lbu(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_lhu(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_sb(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_sh(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_sw(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_addi(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_slti(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_sltiu(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_xori(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_ori(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_andi(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_slli(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_srli(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_srai(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_add(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_sub(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_sll(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_slt(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_sltu(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_xor(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_srl(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_sra(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_or(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_and(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_mul(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_mulh(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_mulhsu(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_mulhu(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_div(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_divu(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_rem(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_remu(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_fence(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_fence_i(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_ecall(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_ebreak(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_mret(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_sret(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_wfi(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_sfence_vma(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_debug_break(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_jal_halt(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_illegal(RISCV_st *cpu, const RISCV_dinstr_st *di);
+//	CSR instructions
+void RISCV_instr_csrrw(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_csrrs(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_csrrc(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_csrrwi(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_csrrsi(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_csrrci(RISCV_st *cpu, const RISCV_dinstr_st *di);
+//	Fused pairs
+void RISCV_instr_lui_addi(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_auipc_jalr(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_addi_bne(RISCV_st *cpu, const RISCV_dinstr_st *di);
+void RISCV_instr_addi_sw(RISCV_st *cpu, const RISCV_dinstr_st *di);
 
 #endif // POLYRISC_V_H
@@ -0,0 +1,55 @@
+#ifndef POLYRISC_V_DEBUG_H
+#define POLYRISC_V_DEBUG_H
+
+#include "PolyRISC-V.h"
+
+// Debugger breakpoints and watchpoints
+//	Nothing is checked per instruction. A breakpoint goes over the decoded
+//	instruction at its address: RISCV_OP_DEBUG_BREAK stops RISCV_run() before
+//	it runs (RISCV_STOP_DEBUG_BREAK). Its page is flagged PAGE_BREAK, so the
+//	instruction gets it again whenever it is decoded again (see
+//	RISCV_page_code()). Pairs aren't fused over it and the JIT leaves it to
+//	the interpreter, the blocks over it are dropped when it is set.
+//	A watchpoint flags the pages of its bytes PAGE_WATCH: stores to them take
+//	the slow path of flagged pages, RISCV_page_write(), which stops the run
+//	after the ones writing to the watched bytes (RISCV_STOP_DEBUG_WATCH).
+//	Stores to other pages run at full speed. Loads have no slow path, they
+//	aren't watched.
+//	Addresses are the ones of guest memory, physical ones in the translated
+//	modes (see PolyRISC-V_mmu.h).
+
+#define DEBUG_BREAK_MAX		64
+#define DEBUG_WATCH_MAX		16
+
+typedef struct{
+	uint32_t addr;
+	uint32_t size;
+}RISCV_watch_st;
+
+struct RISCV_debug_st{
+	pc_kt breaks[DEBUG_BREAK_MAX];
+	size_t break_count;
+	RISCV_watch_st watches[DEBUG_WATCH_MAX];
+	size_t watch_count;
+	uint32_t hit;		// breakpoint or store address of the last stop
+	pc_kt hit_pc;		// pc of the last breakpoint stop
+	bool at_break;		// stopped at hit_pc, RISCV_debug_run() runs it first
+	bool stepping;		// over the breakpoint at hit, it isn't patched
+};
+
+// false on error: bad address, too many of them
+bool RISCV_debug_break(RISCV_st *cpu, pc_kt pc);
+bool RISCV_debug_watch(RISCV_st *cpu, uint32_t addr, uint32_t size);
+// Removes the breakpoint at addr, or the watchpoint starting there, false if none
+bool RISCV_debug_delete(RISCV_st *cpu, uint32_t addr);
+// Removes all of them
+void RISCV_debug_stop(RISCV_st *cpu);
+
+// RISCV_run() from a breakpoint stop: the instruction stopped at runs first
+RISCV_run_st RISCV_debug_run(RISCV_st *cpu, uint64_t max_instructions);
+
+// Store of size bytes at addr to a PAGE_WATCH page, true if watched (the
+// run stops), see RISCV_page_write()
+bool RISCV_debug_store(RISCV_st *cpu, uint32_t addr, uint32_t size);
+
+#endif // POLYRISC_V_DEBUG_H
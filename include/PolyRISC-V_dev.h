@@ -0,0 +1,47 @@
+#ifndef POLYRISC_V_DEV_H
+#define POLYRISC_V_DEV_H
+
+#include "PolyRISC-V_mmio.h"
+
+// Devices
+//	Addresses are the ones of the QEMU virt machine, the guest finds them
+//	where its drivers expect them.
+
+// 16550 UART, registers of 1 byte
+//	Transmitted bytes go to the host stdout through the syscall output
+//	buffer (one host write() for many of them, in order with write()), it
+//	is flushed before stdin is polled: a prompt shows before the guest
+//	waits. Received ones come from the host stdin, when it has some ready. No
+//	interrupts, no baud rate: the divisor latch is stored and ignored.
+#define UART_BASE		0x10000000
+#define UART_SIZE		0x100
+#define UART_RBR		0x0 // read: received byte
+#define UART_THR		0x0 // write: byte to transmit
+#define UART_IER		0x1
+#define UART_IIR		0x2 // read: no interrupt pending
+#define UART_FCR		0x2 // write: ignored
+#define UART_LCR		0x3
+#define UART_MCR		0x4
+#define UART_LSR		0x5
+#define UART_MSR		0x6
+#define UART_SCR		0x7
+#define UART_LSR_DR		0x01 // a received byte is ready
+#define UART_LSR_THRE	0x20 // can transmit
+#define UART_LSR_TEMT	0x40 // done transmitting
+#define UART_IN_SIZE	64 // bytes read from stdin at once
+
+// CLINT timer (SiFive layout)
+//	mtime is the time CSR (CSR_TIME_FREQ), read-only here. msip and
+//	mtimecmp raise the machine software and timer interrupts of the hart
+//	(see PolyRISC-V_priv.h), checked in between slices of instructions.
+#define CLINT_BASE		0x02000000
+#define CLINT_SIZE		0x10000
+#define CLINT_MSIP		0x0000
+#define CLINT_MTIMECMP	0x4000
+#define CLINT_MTIME		0xBFF8
+
+// false on error, see RISCV_mmio_map()
+bool RISCV_uart_map(RISCV_st *cpu, uint32_t base);
+bool RISCV_clint_map(RISCV_st *cpu, uint32_t base);
+
+#endif // POLYRISC_V_DEV_H
@@ -0,0 +1,51 @@
+#ifndef POLYRISC_V_DIRTY_H
+#define POLYRISC_V_DIRTY_H
+
+#include "PolyRISC-V.h"
+
+// Written pages tracking
+//	RISCV_dirty_start() copies guest memory and registers as the baseline and
+//	flags every page PAGE_CLEAN: the first store to a page takes the slow path
+//	once, which appends it to the dirty list, later ones run at full speed.
+//	RISCV_restore_dirty() copies back the listed pages only, for a reset
+//	between test cases costing what the last one wrote.
+
+struct RISCV_dirty_st{
+	uint8_t *base;		// baseline image, mem_size bytes
+	uint32_t *list;		// dirty pages, in the order they were first written
+	size_t count;
+	size_t pages;		// guest pages, list size
+	reg_kt reg[32];		// baseline registers
+	pc_kt pc;
+	uint32_t brk;		// program break, memory above it is heap
+	RISCV_priv_st priv;
+};
+
+// Baseline is the current state, tracking starts over
+bool RISCV_dirty_start(RISCV_st *cpu);
+void RISCV_dirty_stop(RISCV_st *cpu);
+// Pages written since the baseline (addr >> RISCV_PAGE_SHIFT), 0 if not tracking
+size_t RISCV_dirty_list(const RISCV_st *cpu, const uint32_t **pages);
+// Back to the baseline, memory and registers
+void RISCV_restore_dirty(RISCV_st *cpu);
+
+// Clean pages of size bytes at addr get dirty, see RISCV_page_write()
+static inline void RISCV_dirty_mark(RISCV_st *cpu, uint32_t addr, uint32_t size)
+{
+	uint32_t first = addr >> RISCV_PAGE_SHIFT;
+	uint32_t last = (addr + size - 1) >> RISCV_PAGE_SHIFT;
+
+	for(uint32_t page=first ; ; page++){
+		if(cpu->pages[page] & PAGE_CLEAN){
+			cpu->pages[page] &= ~PAGE_CLEAN;
+			if(page)
+				cpu->pages[page - 1] &= ~PAGE_CLEAN_NEXT;
+			cpu->dirty->list[cpu->dirty->count++] = page;
+		}
+		// Wraps around at the end of the address space
+		if(page == last || page == RISCV_PAGES - 1)
+			break;
+	}
+}
+
+#endif // POLYRISC_V_DIRTY_H
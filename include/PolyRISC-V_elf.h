@@ -0,0 +1,36 @@
+#ifndef POLYRISC_V_ELF_H
+#define POLYRISC_V_ELF_H
+
+#include "PolyRISC-V.h"
+
+// ELF32 loader
+//	PT_LOAD segments go to their virtual address in guest memory. Whole
+//	pages of file data are mmap()ed private (copy on write) straight from
+//	the file, only the partial pages at the edges of a segment are copied.
+//	.bss pages are anonymous, the kernel zeroes them when first touched.
+//	The entry point becomes the reset pc, the symbol table is kept.
+
+// Function or object of the symbol table
+typedef struct{
+	uint32_t addr;
+	uint32_t size;	// 0 for plain assembly labels
+	const char *name;
+}RISCV_sym_st;
+
+// Sorted by address
+struct RISCV_symtab_st{
+	RISCV_sym_st *syms;
+	size_t count;
+	char *names;	// string table, syms[].name point into it
+};
+
+bool RISCV_load_elf(RISCV_st *cpu, const char *path);
+bool RISCV_is_elf(const char *path);
+
+// Symbol table alone, for tools working from the ELF only (NULL on error)
+RISCV_symtab_st* RISCV_symtab_load(const char *path);
+void RISCV_symtab_free(RISCV_symtab_st *symtab);
+// Symbol addr belongs to, NULL if none
+const RISCV_sym_st* RISCV_symtab_lookup(const RISCV_symtab_st *symtab, uint32_t addr);
+
+#endif // POLYRISC_V_ELF_H
@@ -0,0 +1,49 @@
+#ifndef POLYRISC_V_GUARD_H
+#define POLYRISC_V_GUARD_H
+
+#include <signal.h>
+#include "PolyRISC-V.h"
+
+// Guarded guest memory
+//	Guest memory is a 4 GiB (+ one page, for accesses at 0xFFFFFFFF) PROT_NONE
+//	reservation, only the first mem_size bytes are accessible. Loads and
+//	stores stay unchecked: one out of range raises SIGSEGV, which becomes a
+//	precise guest trap (RISCV_STOP_TRAP, pc points to the faulting
+//	instruction, registers are left as before it).
+//	- Interpreters: the access goes on against a scratch page, the run loop
+//	  stops after the instruction as for any trap, then RISCV_guard_end()
+//	  puts the registers back and drops the scratch pages.
+//	- JIT: the native pc tells the guest one (RISCV_jit_fault()), the block
+//	  returns to the dispatch loop from there.
+//	Only on 64 bits Linux hosts, see RISCV_HAS_GUARD.
+
+#define GUARD_RESERVE ((size_t)1 << BITS)
+
+// After a guest access: the SIGSEGV handler may have set cpu->stop during it
+//	Costs nothing but a reload of cpu->stop, where inlined handlers would
+//	otherwise reuse the value of before.
+#if RISCV_HAS_GUARD
+	#define GUARD_ACCESS_DONE(cpu) __asm__ volatile("" : "+m"((cpu)->stop))
+#else
+	#define GUARD_ACCESS_DONE(cpu) do{}while(0)
+#endif
+
+// Registers and scratch pages of an access fault
+struct RISCV_fault_st{
+	bool pending;		// set by the SIGSEGV handler, until RISCV_guard_end()
+	bool access;		// the last trap was an access fault at addr
+	uint32_t addr;		// guest address that faulted, any byte of a multi-byte access
+	pc_kt pc;			// faulting instruction
+	reg_kt reg[32];		// registers before it
+	uint8_t *pages[2];	// made accessible for the interpreters, an access spans 2 pages at most
+	size_t npages;
+};
+
+// Reserves guest memory, NULL on error
+uint8_t* RISCV_guard_alloc(size_t mem_size, size_t *reserved);
+// Handles the faults of cpu on this thread
+void RISCV_guard_begin(RISCV_st *cpu);
+// Trap state once back from the core
+void RISCV_guard_end(RISCV_st *cpu);
+
+#endif // POLYRISC_V_GUARD_H
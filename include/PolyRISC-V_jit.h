@@ -0,0 +1,142 @@
+#ifndef POLYRISC_V_JIT_H
+#define POLYRISC_V_JIT_H
+
+#include "PolyRISC-V.h"
+
+// x86-64 basic block translator
+//	Guest basic blocks (ending at a branch, jal or jalr) are translated into
+//	native code working on cpu->reg and cpu->mem directly. Whatever can't be
+//	translated (system instructions, illegal ones) is left to the interpreter.
+//	Blocks jump straight to each other when the target is static, returns
+//	are predicted with a return address stack. The budget goes along, so
+//	execution comes back to the dispatch loop before it runs out.
+//	Blocks are optimized first: writes to x0, moves of a register to itself
+//	and writes overwritten before being read are dropped, constants are
+//	propagated (see RISCV_jit_translate()).
+//	Stores over translated code drop the blocks they overlap, see
+//	RISCV_jit_invalidate(), the rest of the translations stay.
+//	Only built in on x86-64 Linux, see RISCV_HAS_JIT.
+
+#define JIT_CODE_SIZE		0x1000000	// bytes of native code, flushed when full
+#define JIT_BLOCK_MAX		64			// guest instructions per block
+#define JIT_BLOCK_SPAN		(JIT_BLOCK_MAX * 4) // bytes of guest code per block, at most
+#define JIT_BLOCK_ROOM		0x2000		// bytes, more than the biggest block
+#define JIT_NO_BLOCK		UINT32_MAX	// blocks[] value, interpret this pc
+#define JIT_RAS_SIZE		16			// return addresses, must be a power of 2
+#define JIT_FAULT_EXIT		8			// offset of the ret guest access faults resume at
+
+// What translated code returns to the dispatch loop with
+typedef struct{
+	uint64_t exit;	// guest pc to continue at in the low 32 bits, offset of
+					// the exit to link to the next block in the high ones
+	uint64_t left;	// budget left
+}RISCV_jit_ret_st;
+
+// Runs from the native code of a block, as long as the budget allows
+typedef RISCV_jit_ret_st (*RISCV_jit_enter_fn)(RISCV_st *cpu, uint8_t *mem,
+		uint8_t *pages, uint64_t left, const void *native);
+
+// Block header, the native code follows it
+typedef struct{
+	uint32_t len;	// guest instructions, all retired when the block returns
+	pc_kt pc;		// guest pc of the first instruction
+	pc_kt end;		// guest pc after the last one
+}RISCV_jit_block_st;
+
+// Return address stack, pushed by calls, popped by returns
+//	Native code is the exit of the calling block to the return address
+typedef struct{
+	pc_kt pc;
+	const uint8_t *native;
+}RISCV_jit_ras_entry_st;
+
+typedef struct{
+	uint64_t top; // byte offset of the top entry
+	RISCV_jit_ras_entry_st entry[JIT_RAS_SIZE];
+}RISCV_jit_ras_st;
+
+// Guest registers known while translating a block
+//	Values of constant results, used as immediates. cpu->reg gets them
+//	before the block may stop (pending ones), see RISCV_jit_translate().
+typedef struct{
+	uint32_t known;		// a bit per register, x0 always
+	uint32_t pending;	// known, not stored yet
+	uint32_t value[32];
+}RISCV_jit_consts_st;
+
+// Guest memory access of translated code, see RISCV_jit_fault()
+typedef struct{
+	uint32_t native;	// offset in code of the load/store instruction
+	uint32_t block;		// offset in code of its block
+	pc_kt pc;
+	uint32_t index;		// of its instruction in the block
+}RISCV_jit_site_st;
+
+struct RISCV_jit_st{
+	uint8_t *code;		// executable buffer, entry trampoline then blocks
+	size_t code_used;
+	uint64_t flushes;	// links to blocks of before a flush are stale
+	uint32_t *blocks;	// per guest halfword, offset in code of the block starting there
+	size_t halfwords;
+	RISCV_jit_ras_st ras;
+	RISCV_jit_site_st *sites; // in code order
+	size_t sites_count;
+	size_t sites_size;
+	uint32_t block_ofs;	// block being translated
+	uint32_t block_count; // its guest instructions
+	RISCV_jit_consts_st consts; // of the block being translated
+};
+
+RISCV_jit_st* RISCV_jit_init(RISCV_st *cpu);
+void RISCV_jit_deinit(RISCV_jit_st *jit);
+void RISCV_jit_flush(RISCV_jit_st *jit);
+uint32_t RISCV_jit_translate(RISCV_st *cpu, pc_kt pc);
+void RISCV_jit_link(RISCV_jit_st *jit, uint32_t exit, const RISCV_jit_block_st *block);
+// Drops the blocks with guest code in the size bytes at addr
+//	Their native code stays until the next flush: the running block goes
+//	on with the old instructions, as allowed until a fence.i, and links to
+//	them exit to the dispatch loop, which translates the new ones.
+void RISCV_jit_invalidate(RISCV_jit_st *jit, uint32_t addr, uint32_t size);
+
+// Guest pc of the access at native address rip, and the number of
+// instructions of its block it didn't retire (itself included)
+//	False if rip isn't a guest access of translated code. Called from the
+//	SIGSEGV handler, see PolyRISC-V_guard.h.
+bool RISCV_jit_fault(const RISCV_jit_st *jit, uintptr_t rip, pc_kt *pc, uint64_t *unretired);
+
+// Block starting at pc, translated on the first call
+//	NULL if the instruction at pc must be interpreted
+static inline const RISCV_jit_block_st* RISCV_jit_lookup(RISCV_st *cpu, pc_kt pc)
+{
+	uint32_t ofs = cpu->jit->blocks[pc >> 1];
+
+	if(!ofs)
+		ofs = RISCV_jit_translate(cpu, pc);
+	if(ofs == JIT_NO_BLOCK)
+		return NULL;
+
+	return (const RISCV_jit_block_st*)(cpu->jit->code + ofs);
+}
+
+static inline const void* RISCV_jit_native(const RISCV_jit_block_st *block)
+{
+	return block + 1;
+}
+
+static inline RISCV_jit_enter_fn RISCV_jit_enter(const RISCV_jit_st *jit)
+{
+	RISCV_jit_enter_fn fn = NULL;
+
+	// Object to function pointer, not ISO C but what POSIX dlsym() relies on
+	memcpy(&fn, &jit->code, sizeof(fn));
+
+	return fn;
+}
+
+// ret of the entry trampoline, the budget left in rdx and the pc in rax
+static inline const void* RISCV_jit_fault_exit(const RISCV_jit_st *jit)
+{
+	return jit->code + JIT_FAULT_EXIT;
+}
+
+#endif // POLYRISC_V_JIT_H
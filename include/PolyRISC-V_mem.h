@@ -0,0 +1,92 @@
+#ifndef POLYRISC_V_MEM_H
+#define POLYRISC_V_MEM_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Guest memory accesses
+//	RISC-V is little endian. On a little endian host an access is one native
+//	load or store (memcpy() of a constant size compiles down to it), when the
+//	address is aligned or the host doesn't mind. Otherwise bytes are put
+//	together one at a time, which is right whatever the host.
+//	No bounds checks, see PolyRISC-V_guard.h.
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	#define RISCV_HOST_LE 1
+#else
+	#define RISCV_HOST_LE 0
+#endif
+// Misaligned native accesses are as fast as aligned ones (most of the time)
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+	#define RISCV_HOST_UNALIGNED 1
+#else
+	#define RISCV_HOST_UNALIGNED 0
+#endif
+
+// Fast path usable for an access of size bytes at addr
+#define RISCV_MEM_NATIVE(addr, size) \
+	(RISCV_HOST_LE && (RISCV_HOST_UNALIGNED || ((addr) & ((size) - 1)) == 0))
+
+static inline uint8_t RISCV_mem_read8(const uint8_t *mem, uint32_t addr)
+{
+	return mem[addr];
+}
+
+static inline uint16_t RISCV_mem_read16(const uint8_t *mem, uint32_t addr)
+{
+	uint16_t value = 0;
+
+	if(RISCV_MEM_NATIVE(addr, 2)){
+		memcpy(&value, &mem[addr], sizeof(value));
+		return value;
+	}
+
+	return (uint16_t)mem[addr] | ((uint16_t)mem[addr + 1] << 8);
+}
+
+static inline uint32_t RISCV_mem_read32(const uint8_t *mem, uint32_t addr)
+{
+	uint32_t value = 0;
+
+	if(RISCV_MEM_NATIVE(addr, 4)){
+		memcpy(&value, &mem[addr], sizeof(value));
+		return value;
+	}
+
+	return
+		(uint32_t)mem[addr] |
+		((uint32_t)mem[addr + 1] << 8) |
+		((uint32_t)mem[addr + 2] << 16) |
+		((uint32_t)mem[addr + 3] << 24);
+}
+
+static inline void RISCV_mem_write8(uint8_t *mem, uint32_t addr, uint8_t value)
+{
+	mem[addr] = value;
+}
+
+static inline void RISCV_mem_write16(uint8_t *mem, uint32_t addr, uint16_t value)
+{
+	if(RISCV_MEM_NATIVE(addr, 2)){
+		memcpy(&mem[addr], &value, sizeof(value));
+		return;
+	}
+
+	mem[addr] = value & 0xFF;
+	mem[addr + 1] = (value >> 8) & 0xFF;
+}
+
+static inline void RISCV_mem_write32(uint8_t *mem, uint32_t addr, uint32_t value)
+{
+	if(RISCV_MEM_NATIVE(addr, 4)){
+		memcpy(&mem[addr], &value, sizeof(value));
+		return;
+	}
+
+	mem[addr] = value & 0xFF;
+	mem[addr + 1] = (value >> 8) & 0xFF;
+	mem[addr + 2] = (value >> 16) & 0xFF;
+	mem[addr + 3] = (value >> 24) & 0xFF;
+}
+
+#endif // POLYRISC_V_MEM_H
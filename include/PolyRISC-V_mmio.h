@@ -0,0 +1,52 @@
+#ifndef POLYRISC_V_MMIO_H
+#define POLYRISC_V_MMIO_H
+
+#include "PolyRISC-V.h"
+
+// Memory mapped devices
+//	Guest RAM keeps its unchecked native accesses, devices cost it nothing:
+//	they live in guest pages past mem_size, which are not accessible in the
+//	guarded reservation. An access to one faults like any out of range one
+//	(see PolyRISC-V_guard.h), then RISCV_run() looks the page up in the
+//	device table and, if a device is there, runs the load or store against
+//	its callbacks instead of trapping, and goes on.
+//	Each access costs a fault, devices are meant for registers (console,
+//	timer), not for bulk data. Guarded memory only (RISCV_HAS_GUARD).
+
+#define MMIO_PAGES_SIZE (RISCV_PAGES * sizeof(RISCV_device_st*))
+
+typedef struct RISCV_device_st RISCV_device_st;
+
+// Access of size (1, 2 or 4) bytes at offset from the device base
+typedef uint32_t (*RISCV_device_read_fn)(RISCV_st *cpu, RISCV_device_st *dev, uint32_t offset, uint8_t size);
+typedef void (*RISCV_device_write_fn)(RISCV_st *cpu, RISCV_device_st *dev, uint32_t offset, uint8_t size, uint32_t value);
+
+struct RISCV_device_st{
+	const char *name;
+	uint32_t base;		// page aligned
+	uint32_t size;		// bytes, the device takes whole pages
+	RISCV_device_read_fn read;
+	RISCV_device_write_fn write;
+	void (*free)(RISCV_device_st *dev); // NULL: nothing to free
+	void *data;			// device state
+	RISCV_device_st *next;
+};
+
+struct RISCV_mmio_st{
+	RISCV_device_st **pages; // device of each guest page, NULL for RAM
+	RISCV_device_st *devices; // mapped ones, freed with the cpu
+};
+
+// cpu owns dev from now on, false on error (dev is freed)
+bool RISCV_mmio_map(RISCV_st *cpu, RISCV_device_st *dev);
+void RISCV_mmio_free(RISCV_st *cpu);
+// Device at addr, NULL for RAM
+static inline RISCV_device_st* RISCV_mmio_device(const RISCV_st *cpu, uint32_t addr)
+{
+	return cpu->mmio? cpu->mmio->pages[addr >> RISCV_PAGE_SHIFT] : NULL;
+}
+// Runs the instruction of the access fault of cpu if it was to a device,
+//	then pc is past it. False if it wasn't, the trap stays.
+bool RISCV_mmio_fault(RISCV_st *cpu);
+
+#endif // POLYRISC_V_MMIO_H
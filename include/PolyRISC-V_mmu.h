@@ -0,0 +1,134 @@
+#ifndef POLYRISC_V_MMU_H
+#define POLYRISC_V_MMU_H
+
+#include "PolyRISC-V.h"
+#include "PolyRISC-V_mem.h"
+#include "PolyRISC-V_priv.h"
+
+// Sv32 virtual memory
+//	S and U modes translate addresses once satp.MODE is set. Those run on
+//	their own interpreter (RISCV_run() picks it), the flat cores and the
+//	JIT keep their untranslated accesses.
+//	Translations go through direct mapped software TLBs, one per kind of
+//	access, indexed by the low bits of the virtual page: a hit is a compare
+//	and an add to the host address of the physical page, a miss walks the
+//	page table and fills the entry. The TLBs depend on satp, the mode and
+//	mstatus.SUM/MXR, they are flushed when one of them changes and on
+//	sfence.vma.
+//	Physical addresses past guest memory go to devices (no TLB entry, they
+//	are called on every access), or raise access faults. Accessed and dirty
+//	PTE bits are set by the walk. Accesses across pages take the slow path,
+//	one byte at a time.
+
+#define MMU_TLB_SIZE	256
+#define MMU_TLB_INVALID	1 // never the address of a page
+
+// Page table entries
+#define PTE_V			0x01
+#define PTE_R			0x02
+#define PTE_W			0x04
+#define PTE_X			0x08
+#define PTE_U			0x10
+#define PTE_G			0x20
+#define PTE_A			0x40
+#define PTE_D			0x80
+#define PTE_PPN_SHIFT	10
+#define PTE_VPN_BITS	10 // per level, 2 levels
+
+typedef enum{
+	MMU_FETCH,
+	MMU_LOAD,
+	MMU_STORE
+}RISCV_access_et;
+
+typedef struct{
+	uint32_t tag;		// virtual address of the page, MMU_TLB_INVALID when empty
+	uint32_t page;		// physical page number
+	uint8_t *host;		// physical page in guest memory
+}RISCV_tlb_st;
+
+struct RISCV_mmu_st{
+	RISCV_tlb_st tlb[3][MMU_TLB_SIZE]; // per RISCV_access_et
+	bool fault;			// the last access faulted, with cause and tval
+	uint32_t cause;
+	uint32_t tval;
+};
+
+RISCV_mmu_st* RISCV_mmu_init(void);
+void RISCV_mmu_deinit(RISCV_mmu_st *mmu);
+// Drops every translation
+void RISCV_mmu_flush(RISCV_st *cpu);
+
+// Translating accesses now
+static inline bool RISCV_mmu_on(const RISCV_st *cpu)
+{
+	return (cpu->priv.satp & SATP_MODE) && cpu->priv.mode != PRIV_M;
+}
+
+// Page table walk for an access at va, false on a fault (see mmu->fault)
+bool RISCV_mmu_translate(RISCV_st *cpu, uint32_t va, RISCV_access_et access, uint64_t *pa);
+// Slow paths of the ones below
+bool RISCV_mmu_fetch_slow(RISCV_st *cpu, uint32_t va, uint32_t *pa);
+bool RISCV_mmu_load_slow(RISCV_st *cpu, uint32_t va, uint32_t size, uint32_t *value);
+bool RISCV_mmu_store_slow(RISCV_st *cpu, uint32_t va, uint32_t size, uint32_t value);
+
+// Entry of the TLB for an access of size bytes at va, NULL on a miss
+static inline const RISCV_tlb_st* RISCV_tlb_hit(const RISCV_st *cpu, RISCV_access_et access, uint32_t va, uint32_t size)
+{
+	const RISCV_tlb_st *e = &cpu->mmu->tlb[access][(va >> RISCV_PAGE_SHIFT) % MMU_TLB_SIZE];
+	uint32_t offset = va & (RISCV_PAGE_SIZE - 1);
+
+	if(__builtin_expect(e->tag == va - offset && offset <= RISCV_PAGE_SIZE - size, 1))
+		return e;
+	return NULL;
+}
+
+// Physical address of the instruction at va, in guest memory
+static inline bool RISCV_mmu_fetch(RISCV_st *cpu, uint32_t va, uint32_t *pa)
+{
+	const RISCV_tlb_st *e = RISCV_tlb_hit(cpu, MMU_FETCH, va, 2);
+
+	if(e){
+		*pa = (e->page << RISCV_PAGE_SHIFT) | (va & (RISCV_PAGE_SIZE - 1));
+		return true;
+	}
+	return RISCV_mmu_fetch_slow(cpu, va, pa);
+}
+
+// Loads size (1, 2 or 4) bytes at va, zero-extended
+static inline bool RISCV_mmu_load(RISCV_st *cpu, uint32_t va, uint32_t size, uint32_t *value)
+{
+	const RISCV_tlb_st *e = RISCV_tlb_hit(cpu, MMU_LOAD, va, size);
+	uint32_t offset = va & (RISCV_PAGE_SIZE - 1);
+
+	if(!e)
+		return RISCV_mmu_load_slow(cpu, va, size, value);
+
+	switch(size){
+		case 1:		*value = RISCV_mem_read8(e->host, offset); break;
+		case 2:		*value = RISCV_mem_read16(e->host, offset); break;
+		default:	*value = RISCV_mem_read32(e->host, offset); break;
+	}
+	return true;
+}
+
+// Stores the low size bytes of value at va, flagged pages as in the flat cores
+static inline bool RISCV_mmu_store(RISCV_st *cpu, uint32_t va, uint32_t size, uint32_t value)
+{
+	const RISCV_tlb_st *e = RISCV_tlb_hit(cpu, MMU_STORE, va, size);
+	uint32_t offset = va & (RISCV_PAGE_SIZE - 1);
+
+	if(!e)
+		return RISCV_mmu_store_slow(cpu, va, size, value);
+
+	switch(size){
+		case 1:		RISCV_mem_write8(e->host, offset, value); break;
+		case 2:		RISCV_mem_write16(e->host, offset, value); break;
+		default:	RISCV_mem_write32(e->host, offset, value); break;
+	}
+	if(cpu->pages[e->page])
+		RISCV_page_write(cpu, (e->page << RISCV_PAGE_SHIFT) | offset, size);
+	return true;
+}
+
+#endif // POLYRISC_V_MMU_H
@@ -0,0 +1,149 @@
+#ifndef POLYRISC_V_PRIV_H
+#define POLYRISC_V_PRIV_H
+
+#include "PolyRISC-V.h"
+
+// Privileged architecture, machine and supervisor modes of a single hart
+//	What a small kernel needs: the M and S trap CSRs with delegation, timer
+//	and software interrupts (CLINT, see PolyRISC-V_dev.h) and Sv32 virtual
+//	memory (see PolyRISC-V_mmu.h). No PMP (its CSRs read 0, writes are
+//	ignored), mstatus.MPRV is kept but doesn't change translation, counters
+//	are always readable whatever mcounteren and scounteren.
+//	A program is bare metal until it sets mtvec: ecall goes to the syscall
+//	proxy and any trap stops RISCV_run(), as without privileged modes. Once
+//	mtvec is set, the guest takes its own exceptions and interrupts.
+
+// Privilege modes
+#define PRIV_U		0
+#define PRIV_S		1
+#define PRIV_M		3
+
+// Supervisor CSRs
+#define CSR_SSTATUS		0x100
+#define CSR_SIE			0x104
+#define CSR_STVEC		0x105
+#define CSR_SCOUNTEREN	0x106
+#define CSR_SSCRATCH	0x140
+#define CSR_SEPC		0x141
+#define CSR_SCAUSE		0x142
+#define CSR_STVAL		0x143
+#define CSR_SIP			0x144
+#define CSR_SATP		0x180
+// Machine CSRs
+#define CSR_MSTATUS		0x300
+#define CSR_MISA		0x301
+#define CSR_MEDELEG		0x302
+#define CSR_MIDELEG		0x303
+#define CSR_MIE			0x304
+#define CSR_MTVEC		0x305
+#define CSR_MCOUNTEREN	0x306
+#define CSR_MSTATUSH	0x310
+#define CSR_MSCRATCH	0x340
+#define CSR_MEPC		0x341
+#define CSR_MCAUSE		0x342
+#define CSR_MTVAL		0x343
+#define CSR_MIP			0x344
+#define CSR_PMPCFG0		0x3A0 // to pmpcfg3
+#define CSR_PMPADDR0	0x3B0 // to pmpaddr15
+#define CSR_MCYCLE		0xB00
+#define CSR_MINSTRET	0xB02
+#define CSR_MCYCLEH		0xB80
+#define CSR_MINSTRETH	0xB82
+#define CSR_MVENDORID	0xF11
+#define CSR_MARCHID		0xF12
+#define CSR_MIMPID		0xF13
+#define CSR_MHARTID		0xF14
+#define CSR_MCONFIGPTR	0xF15
+// Lowest mode allowed and read-only ones, from the number
+#define CSR_MODE(csr)		(((csr) >> 8) & 0x3)
+#define CSR_READ_ONLY(csr)	(((csr) >> 10) == 0x3)
+
+// RV32 IMCSU
+#define MISA_VALUE		((1u << 30) | (1u << ('I' - 'A')) | (1u << ('M' - 'A')) | \
+		(1u << ('C' - 'A')) | (1u << ('S' - 'A')) | (1u << ('U' - 'A')))
+
+// mstatus fields
+#define MSTATUS_SIE		0x00000002
+#define MSTATUS_MIE		0x00000008
+#define MSTATUS_SPIE	0x00000020
+#define MSTATUS_MPIE	0x00000080
+#define MSTATUS_SPP		0x00000100
+#define MSTATUS_MPP		0x00001800
+#define MSTATUS_MPP_SHIFT	11
+#define MSTATUS_MPRV	0x00020000
+#define MSTATUS_SUM		0x00040000 // S mode may access U pages
+#define MSTATUS_MXR		0x00080000 // executable pages are readable
+#define MSTATUS_TVM		0x00100000 // satp and sfence.vma are M mode only
+#define MSTATUS_TW		0x00200000 // wfi is M mode only
+#define MSTATUS_TSR		0x00400000 // sret is M mode only
+#define SSTATUS_MASK	(MSTATUS_SIE | MSTATUS_SPIE | MSTATUS_SPP | MSTATUS_SUM | MSTATUS_MXR)
+#define MSTATUS_MASK	(SSTATUS_MASK | MSTATUS_MIE | MSTATUS_MPIE | MSTATUS_MPP | MSTATUS_MPRV | \
+		MSTATUS_TVM | MSTATUS_TW | MSTATUS_TSR)
+
+// Interrupts, bits of mip and mie
+#define IRQ_SSI			1
+#define IRQ_MSI			3
+#define IRQ_STI			5
+#define IRQ_MTI			7
+#define IRQ_SEI			9
+#define IRQ_MEI			11
+#define MIP_SSIP		(1u << IRQ_SSI)
+#define MIP_MSIP		(1u << IRQ_MSI)
+#define MIP_STIP		(1u << IRQ_STI)
+#define MIP_MTIP		(1u << IRQ_MTI)
+#define MIP_SEIP		(1u << IRQ_SEI)
+#define MIP_MEIP		(1u << IRQ_MEI)
+#define MIP_S_MASK		(MIP_SSIP | MIP_STIP | MIP_SEIP) // the ones S mode can get delegated
+#define MIE_MASK		(MIP_S_MASK | MIP_MSIP | MIP_MTIP | MIP_MEIP)
+
+// Exception causes, interrupts have CAUSE_INTERRUPT and their IRQ_ number
+#define CAUSE_MISALIGNED_FETCH	0
+#define CAUSE_FETCH_ACCESS		1
+#define CAUSE_ILLEGAL			2
+#define CAUSE_BREAKPOINT		3
+#define CAUSE_LOAD_ACCESS		5
+#define CAUSE_STORE_ACCESS		7
+#define CAUSE_ECALL_U			8 // + the mode it came from
+#define CAUSE_FETCH_PAGE		12
+#define CAUSE_LOAD_PAGE			13
+#define CAUSE_STORE_PAGE		15
+#define CAUSE_INTERRUPT			0x80000000
+#define MEDELEG_MASK			0xB3FF // not ecall from M mode, nor reserved causes
+
+// satp fields, no ASID (it reads 0)
+#define SATP_MODE		0x80000000 // Sv32
+#define SATP_PPN		0x003FFFFF
+
+// Instructions between interrupt checks, while some are enabled
+#define PRIV_SLICE		0x4000
+
+// Machine mode, nothing delegated nor enabled, mtimecmp never reached
+void RISCV_priv_reset(RISCV_st *cpu);
+// The guest takes its own traps
+static inline bool RISCV_priv_guest_traps(const RISCV_st *cpu)
+{
+	return cpu->priv.mtvec != 0;
+}
+
+// CSR accesses of the current mode, false if illegal
+//	A write may change translation or enable interrupts, it stops the core
+//	(RISCV_STOP_SWITCH) for RISCV_run() to check them.
+bool RISCV_csr_read(const RISCV_st *cpu, uint16_t csr, uint32_t *value);
+bool RISCV_csr_write(RISCV_st *cpu, uint16_t csr, uint32_t value);
+
+// Takes a trap to M mode, or S mode when delegated, cpu->pc is the epc
+void RISCV_trap(RISCV_st *cpu, uint32_t cause, uint32_t tval);
+// The guest takes the exception of the RISCV_STOP_TRAP stop of di at pc
+//	(NULL when pc can't be fetched), which is then cleared. False if it
+//	can't: bare metal, or the trap handler itself doesn't run.
+bool RISCV_priv_exception(RISCV_st *cpu, const RISCV_dinstr_st *di);
+// Takes the pending interrupt of highest priority, if it is enabled
+bool RISCV_priv_interrupt(RISCV_st *cpu);
+
+// Trap returns and the others, false if illegal in the current mode
+bool RISCV_priv_mret(RISCV_st *cpu);
+bool RISCV_priv_sret(RISCV_st *cpu);
+bool RISCV_priv_wfi(RISCV_st *cpu);
+bool RISCV_priv_sfence_vma(RISCV_st *cpu);
+
+#endif // POLYRISC_V_PRIV_H
@@ -0,0 +1,85 @@
+#ifndef POLYRISC_V_PROF_H
+#define POLYRISC_V_PROF_H
+
+#include <stdio.h>
+#include "PolyRISC-V.h"
+
+// Sampling profiler
+//	RISCV_run() stops every period retired instructions to record the pc
+//	and a shadow call stack, kept up to date by jal/jalr: linking ra calls,
+//	jalr zero, ra returns (same conventions as the JIT return address
+//	stack). Identical stacks are counted once, they are written out in the
+//	folded format flamegraph tools read ("main;f;g 42"), with function
+//	names from the ELF symbol table when there is one.
+//	Only built in with PROF=1 (-DRISCV_PROF=1), otherwise hooks are empty.
+//	The JIT keeps running, calls and returns go through the interpreter.
+
+#define PROF_PERIOD 9973 // default, prime so that it doesn't beat with loops
+#define PROF_DEPTH 128 // calls recorded, deeper ones are only counted
+
+// Distinct stack, frames in pool
+typedef struct{
+	uint32_t hash;
+	uint32_t depth;		// 0: empty slot
+	size_t frames;		// offset in pool
+	uint64_t count;
+}RISCV_prof_stack_st;
+
+struct RISCV_prof_st{
+	uint64_t period;
+	uint64_t left;		// until the next sample
+	pc_kt root;			// function running when profiling started
+	pc_kt stack[PROF_DEPTH]; // callees, outermost first
+	uint32_t depth;		// may be more than PROF_DEPTH
+	RISCV_prof_stack_st *stacks; // open addressing, stacks_size is a power of 2
+	size_t stacks_size;
+	size_t stacks_used;
+	pc_kt *pool;
+	size_t pool_used;
+	size_t pool_size;
+	uint64_t samples;
+};
+
+// One sample every period instructions (0: PROF_PERIOD)
+bool RISCV_prof_start(RISCV_st *cpu, uint64_t period);
+void RISCV_prof_stop(RISCV_st *cpu);
+// Records where cpu is, called by RISCV_run()
+void RISCV_prof_sample(RISCV_st *cpu);
+// Folded stacks of the samples so far, false on error
+bool RISCV_prof_write(const RISCV_st *cpu, FILE *f);
+
+// What jal/jalr di (op, without fusion) does: 1 call, -1 return, 0 jump
+static inline int RISCV_prof_kind(const RISCV_dinstr_st *di, uint8_t op)
+{
+	if(di->rd == RA)
+		return 1;
+	if(op == RISCV_OP_JALR && di->rd == ZERO && di->rs1 == RA)
+		return -1;
+	return 0;
+}
+
+// jal/jalr to target
+static inline void RISCV_prof_jump(RISCV_prof_st *prof, int kind, pc_kt target)
+{
+	if(kind > 0){
+		if(prof->depth < PROF_DEPTH)
+			prof->stack[prof->depth] = target;
+		prof->depth++;
+	}
+	else if(kind < 0 && prof->depth){
+		// Returning past the root is ignored
+		prof->depth--;
+	}
+}
+
+#if RISCV_PROF
+	// jal/jalr just executed, pc is the target
+	#define PROF_JUMP(cpu, di, op) do{ \
+		if((cpu)->prof) \
+			RISCV_prof_jump((cpu)->prof, RISCV_prof_kind((di), (op)), (cpu)->pc); \
+	}while(0)
+#else
+	#define PROF_JUMP(cpu, di, op) do{}while(0)
+#endif
+
+#endif // POLYRISC_V_PROF_H
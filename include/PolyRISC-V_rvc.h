@@ -0,0 +1,23 @@
+#ifndef POLYRISC_V_RVC_H
+#define POLYRISC_V_RVC_H
+
+#include "PolyRISC-V.h"
+
+// Compressed instructions (C extension)
+//	Every RV32C instruction is a shorter encoding of an RV32I one. They are
+//	expanded when decoded, then run by the RV32I handlers from the icache
+//	like any other instruction: nothing is left to do at execution time but
+//	step pc by 2 instead of 4 (RISCV_dinstr_st.len).
+//	Floating point loads and stores (no F or D here) and the reserved
+//	encodings are illegal, 0x0000 included.
+
+// RV32I instruction instr expands to, 0 if illegal
+uint32_t RISCV_rvc_expand(uint16_t instr);
+
+// RV32I form of any instruction, compressed or not (0 if illegal)
+static inline uint32_t RISCV_instr_expand(uint32_t instr)
+{
+	return RISCV_INSTR_LEN(instr) == 2? RISCV_rvc_expand(instr & 0xFFFF) : instr;
+}
+
+#endif // POLYRISC_V_RVC_H
@@ -0,0 +1,63 @@
+#ifndef POLYRISC_V_SCHED_H
+#define POLYRISC_V_SCHED_H
+
+#include <stdatomic.h>
+#include <pthread.h>
+#include "PolyRISC-V.h"
+
+// Many harts, few host threads
+//	The scheduler owns a pool of independent RISCV_st and runs them on N host
+//	threads, one quantum (RISCV_run() budget) at a time. Each thread has its
+//	own run queue of job indices: the owner pushes preempted jobs at the
+//	bottom, the owner and thieves take from the top (round robin, one CAS per
+//	quantum). A thread with an empty queue steals from the others.
+//	Queues hold every job at most once, so they never grow while running.
+
+#define SCHED_QUANTUM 0x40000 // instructions per time slice by default
+
+typedef struct{
+	RISCV_st *cpu;
+	uint64_t max_instructions;	// over the whole run
+	RISCV_run_st run;			// how it ended, retired over all quanta
+	uint32_t slices;			// quanta it took
+	bool done;
+}RISCV_job_st;
+
+typedef struct{
+	size_t threads;		// 0: one per online host cpu
+	uint64_t quantum;	// 0: SCHED_QUANTUM
+}RISCV_sched_op_st;
+
+typedef struct RISCV_sched_st RISCV_sched_st;
+
+typedef struct{
+	// Written by the owner, read by thieves, apart from top
+	_Alignas(64) _Atomic int64_t bottom;
+	_Alignas(64) _Atomic int64_t top;
+	_Alignas(64) _Atomic uint32_t *queue;
+	int64_t mask;
+	RISCV_sched_st *sched;
+	size_t id;
+	pthread_t thread;
+	uint64_t retired;	// instructions this thread ran
+	uint64_t steals;
+}RISCV_sched_worker_st;
+
+struct RISCV_sched_st{
+	RISCV_sched_op_st op;
+	RISCV_job_st *jobs;
+	size_t jobs_count;
+	size_t jobs_size;
+	RISCV_sched_worker_st *workers;
+	_Atomic size_t remaining; // jobs not done yet
+};
+
+RISCV_sched_st* RISCV_sched_init(const RISCV_sched_op_st *options);
+// Also deinits every cpu added
+void RISCV_sched_deinit(RISCV_sched_st *sched);
+// The scheduler owns cpu from now on, even on error
+bool RISCV_sched_add(RISCV_sched_st *sched, RISCV_st *cpu, uint64_t max_instructions);
+// Runs every job not done yet until it stops, see sched->jobs
+bool RISCV_sched_run(RISCV_sched_st *sched);
+
+#endif // POLYRISC_V_SCHED_H
@@ -0,0 +1,39 @@
+#ifndef POLYRISC_V_SNAP_H
+#define POLYRISC_V_SNAP_H
+
+#include "PolyRISC-V.h"
+
+// Copy-on-write snapshots
+//	Guest memory is saved once into a memfd, then mapped MAP_PRIVATE by the
+//	cpu it was taken from and by every fork or restore: pages are shared
+//	until written, only written ones get copied. Restoring maps the
+//	snapshot again, which drops the copies, the cost follows the pages a run
+//	touched instead of mem_size. Decoded instructions are dropped too.
+//	Linux only, see RISCV_HAS_SNAP.
+
+typedef struct{
+	int fd;				// memfd holding guest memory
+	size_t size;		// bytes mapped, mem_size rounded up to whole pages
+	size_t mem_size;
+	reg_kt reg[32];
+	pc_kt pc;
+	pc_kt entry;
+	size_t stack_top;
+	size_t stack_bot;
+	uint32_t brk;
+	RISCV_priv_st priv;
+	RISCV_core_et core;
+	bool guard;
+}RISCV_snap_st;
+
+// Saves memory and registers of cpu, which shares its pages with the
+// snapshot from now on. NULL on error.
+RISCV_snap_st* RISCV_snap_take(RISCV_st *cpu);
+// Instances made from the snapshot keep their memory
+void RISCV_snap_free(RISCV_snap_st *snap);
+// Back to the snapshot state, cpu has to be as big
+bool RISCV_snap_restore(RISCV_st *cpu, const RISCV_snap_st *snap);
+// New cpu in the snapshot state, NULL on error
+RISCV_st* RISCV_snap_fork(const RISCV_snap_st *snap);
+
+#endif // POLYRISC_V_SNAP_H
@@ -0,0 +1,35 @@
+#ifndef POLYRISC_V_STATS_H
+#define POLYRISC_V_STATS_H
+
+#include <stdio.h>
+#include "PolyRISC-V.h"
+
+// Execution statistics
+//	One counter per halfword of guest memory, bumped for every retired
+//	instruction, plus the time spent in RISCV_run(). The instruction mix is
+//	worked out when reporting, from the counters and the instruction at
+//	each pc. Counting runs on the interpreters without fusion, like traces.
+//	Only built in with STATS=1 (-DRISCV_STATS=1), otherwise hooks are empty.
+
+struct RISCV_stats_st{
+	uint64_t *hits;		// retired per pc >> 1, icache_size entries
+	uint64_t retired;	// while counting
+	double seconds;		// spent in RISCV_run() while counting
+};
+
+bool RISCV_stats_start(RISCV_st *cpu);
+void RISCV_stats_stop(RISCV_st *cpu);
+// Totals, instruction mix and the top hottest pcs, with symbols if any
+void RISCV_stats_report(const RISCV_st *cpu, FILE *f, size_t top);
+
+#if RISCV_STATS
+	// Retired instruction at pc
+	#define STATS_INSTR(cpu, pc) do{ \
+		if((cpu)->stats) \
+			(cpu)->stats->hits[(pc) >> 1]++; \
+	}while(0)
+#else
+	#define STATS_INSTR(cpu, pc) do{}while(0)
+#endif
+
+#endif // POLYRISC_V_STATS_H
@@ -0,0 +1,70 @@
+#ifndef POLYRISC_V_SYS_H
+#define POLYRISC_V_SYS_H
+
+#include "PolyRISC-V.h"
+
+// Syscall proxy
+//	ecall runs the system call numbered a7 with arguments a0 to a5 on the
+//	host, result in a0 (-errno on error), with the numbers and structures of
+//	newlib (libgloss) for RV32. Guest buffers are passed to the host as they
+//	are in guest memory, read() fills them in place.
+//	Writes are coalesced in an output buffer, one host write() for many
+//	small guest ones. It is written out when full, before any other call
+//	(a read from stdin shows the prompt first), when another fd is written
+//	and when RISCV_run() returns.
+//	Guest fds 0 to 2 are the host ones, closing them only drops them from
+//	the guest table.
+
+// Syscall numbers, a7
+#define SYS_OPENAT			56
+#define SYS_CLOSE			57
+#define SYS_LSEEK			62
+#define SYS_READ			63
+#define SYS_WRITE			64
+#define SYS_FSTAT			80
+#define SYS_EXIT			93
+#define SYS_EXIT_GROUP		94
+#define SYS_GETTIMEOFDAY	169
+#define SYS_BRK				214
+#define SYS_CLOCK_GETTIME64	403 // gettimeofday() of newlib on RV32
+
+// open() flags of newlib
+#define SYS_O_ACCMODE		0x0003
+#define SYS_O_APPEND		0x0008
+#define SYS_O_CREAT			0x0200
+#define SYS_O_TRUNC			0x0400
+#define SYS_O_EXCL			0x0800
+#define SYS_AT_FDCWD		-100
+
+#define SYS_FDS				64 // guest fds
+#define SYS_OUT_SIZE		0x10000 // output buffer, bytes
+#define SYS_OUT_DIRECT		(SYS_OUT_SIZE / 4) // writes this big skip the buffer
+
+struct RISCV_sys_st{
+	int fds[SYS_FDS];	// host fd of each guest one, -1 when closed
+	uint8_t *out;		// output buffer, allocated by the first write
+	size_t out_used;
+	int out_fd;			// host fd out is written to
+	uint32_t brk;		// program break, 0: end of the program (cpu->stack_bot)
+	bool exited;		// exit() was called
+	int32_t exit_code;
+};
+
+// NULL on error
+RISCV_sys_st* RISCV_sys_init(void);
+// Flushes the output, closes the files the guest left open
+void RISCV_sys_deinit(RISCV_sys_st *sys);
+// Back to a baseline with program break brk, for snapshot and dirty pages
+// restores: not exited, output flushed, the files of the guest closed
+//	Guest fds are the host stdin, stdout and stderr again, files open when
+//	the baseline was taken don't stay open.
+void RISCV_sys_restore(RISCV_sys_st *sys, uint32_t brk);
+// Runs the call of ecall, stops cpu on exit
+void RISCV_sys_call(RISCV_st *cpu);
+// Output to host fd, buffered if small. False if it has to be written
+// directly, after RISCV_sys_flush().
+bool RISCV_sys_buffer(RISCV_sys_st *sys, int host, const uint8_t *data, size_t size);
+// Writes the buffered output out, false on error
+bool RISCV_sys_flush(RISCV_sys_st *sys);
+
+#endif // POLYRISC_V_SYS_H
@@ -0,0 +1,69 @@
+#ifndef POLYRISC_V_TRACE_H
+#define POLYRISC_V_TRACE_H
+
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include "PolyRISC-V.h"
+
+// Binary execution trace
+//	The cpu pushes one fixed size record per executed instruction into a
+//	lock-free single producer / single consumer ring, a writer thread drains
+//	it to a file. Turn it back to text with the riscvtrace tool.
+//	Only built in with TRACE=1 (-DRISCV_TRACE=1), otherwise hooks are empty.
+
+#define TRACE_MAGIC "RVTRACE1"
+#define TRACE_RING_SIZE 0x10000 // records, must be a power of 2
+
+typedef struct{
+	pc_kt pc;
+	uint32_t instr;
+	reg_kt rd_value;	// rd after execution
+	uint32_t mem_addr;	// load/store address, 0 otherwise
+}RISCV_trace_rec_st;
+
+struct RISCV_trace_st{
+	RISCV_trace_rec_st *ring;
+	_Atomic uint64_t head;	// next record to write, moved by the cpu
+	_Atomic uint64_t tail;	// next record to read, moved by the writer
+	uint64_t tail_cache;	// cpu side copy of tail, avoids sharing the line
+	atomic_bool stop;
+	FILE *f;
+	pthread_t writer;
+};
+
+bool RISCV_trace_start(RISCV_st *cpu, const char *path);
+void RISCV_trace_stop(RISCV_st *cpu);
+
+static inline void RISCV_trace_push(RISCV_trace_st *trace, const RISCV_trace_rec_st *rec)
+{
+	uint64_t head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+
+	// Full, wait for the writer (never drop records)
+	while(head - trace->tail_cache >= TRACE_RING_SIZE){
+		trace->tail_cache = atomic_load_explicit(&trace->tail, memory_order_acquire);
+		if(head - trace->tail_cache >= TRACE_RING_SIZE)
+			sched_yield();
+	}
+
+	trace->ring[head & (TRACE_RING_SIZE - 1)] = *rec;
+	atomic_store_explicit(&trace->head, head + 1, memory_order_release);
+}
+
+#if RISCV_TRACE
+	// Address of the current load/store
+	#define TRACE_MEM(cpu, addr) do{(cpu)->trace_addr = (addr);}while(0)
+	// Record the instruction just executed
+	#define TRACE_INSTR(cpu, pc, di) do{ \
+		if((cpu)->trace){ \
+			RISCV_trace_rec_st rec = {(pc), (di)->instr, (cpu)->reg[(di)->rd], (cpu)->trace_addr}; \
+			RISCV_trace_push((cpu)->trace, &rec); \
+			(cpu)->trace_addr = 0; \
+		} \
+	}while(0)
+#else
+	#define TRACE_MEM(cpu, addr) do{}while(0)
+	#define TRACE_INSTR(cpu, pc, di) do{}while(0)
+#endif
+
+#endif // POLYRISC_V_TRACE_H
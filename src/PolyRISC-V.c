@@ -1,4 +1,21 @@
 #include "PolyRISC-V.h"
+#include "PolyRISC-V_trace.h"
+#include "PolyRISC-V_stats.h"
+#include "PolyRISC-V_prof.h"
+#include "PolyRISC-V_jit.h"
+#include "PolyRISC-V_elf.h"
+#include "PolyRISC-V_guard.h"
+#include "PolyRISC-V_mem.h"
+#include "PolyRISC-V_dirty.h"
+#include "PolyRISC-V_rvc.h"
+#include "PolyRISC-V_sys.h"
+#include "PolyRISC-V_mmio.h"
+#include "PolyRISC-V_priv.h"
+#include "PolyRISC-V_mmu.h"
+#include "PolyRISC-V_debug.h"
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
 
 const char REG_NAMES[32][6] = {
 	"zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
@@ -7,6 +24,20 @@ const char REG_NAMES[32][6] = {
 	"s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"
 };
 
+#define RISCV_OP_HANDLER(NAME, name) RISCV_instr_##name,
+#define RISCV_FUSED_HANDLER(NAME, name, FIRST, first, second) RISCV_instr_##name,
+static const RISCV_exec_ft RISCV_EXEC[RISCV_OP_COUNT] = {
+	RISCV_INSTR_LIST(RISCV_OP_HANDLER)
+	[RISCV_OP_CSR] = RISCV_CSR_LIST(RISCV_OP_HANDLER)
+	[RISCV_OP_FUSED] = RISCV_FUSED_LIST(RISCV_FUSED_HANDLER)
+};
+
+// Op of the first instruction of a fused pair
+#define RISCV_FUSED_FIRST(NAME, name, FIRST, first, second) [RISCV_OP_##NAME] = RISCV_OP_##FIRST,
+static const uint8_t RISCV_FIRST[RISCV_OP_COUNT] = {
+	RISCV_FUSED_LIST(RISCV_FUSED_FIRST)
+};
+
 const char REG_NAMES_TAB[32][6] = {
 	"zero", "ra\t", "sp\t", "gp\t", "tp\t", "t0\t", "t1\t", "t2\t",
 	"s0/fp", "s1\t","a0\t", "a1\t", "a2\t", "a3\t", "a4\t", "a5\t",
@@ -14,6 +45,20 @@ const char REG_NAMES_TAB[32][6] = {
 	"s8\t", "s9\t", "s10", "s11", "t3\t", "t4\t", "t5\t", "t6\t"
 };
 
+// Monotonic host clock, time CSR source
+static uint64_t RISCV_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+uint64_t RISCV_time(const RISCV_st *cpu)
+{
+	return (RISCV_time_ns() - cpu->csr.time_base) / (1000000000u / CSR_TIME_FREQ);
+}
+
 RISCV_st* RISCV_init(RISCV_init_op_st *options)
 {
 	RISCV_st *cpu = NULL;
@@ -30,17 +75,65 @@ RISCV_st* RISCV_init(RISCV_init_op_st *options)
 		return NULL;
 	memset(cpu, 0, sizeof(RISCV_st)); // init all struct to 0
 	cpu->mem_size = options->mem_size;
+	cpu->core = options->core? options->core : RISCV_DEFAULT_CORE;
+	if(cpu->core == RISCV_CORE_JIT && !RISCV_HAS_JIT)
+		cpu->core = RISCV_CORE_GOTO;
+	if(cpu->core == RISCV_CORE_GOTO && !RISCV_HAS_GOTO)
+		cpu->core = RISCV_CORE_CALL;
 
 	// Allocate cpu memory
-	cpu->mem = malloc(sizeof(uint8_t) * options->mem_size);
+	//	Anonymous pages are zeroed lazily by the kernel, and ELF segments can
+	//	be mapped over them
+#if RISCV_HAS_GUARD
+	if(options->guard){
+		size_t page = sysconf(_SC_PAGESIZE);
+
+		// Faults are only raised past the last page
+		cpu->mem_size = (cpu->mem_size + page - 1) & ~(page - 1);
+		cpu->fault = calloc(1, sizeof(RISCV_fault_st));
+		if(cpu->fault)
+			cpu->mem = RISCV_guard_alloc(cpu->mem_size, &cpu->mem_reserved);
+		if(!cpu->mem){
+			RISCV_deinit(cpu);
+			return NULL;
+		}
+	}
+#endif
 	if(!cpu->mem){
+		cpu->mem_reserved = cpu->mem_size;
+		cpu->mem = mmap(NULL, cpu->mem_reserved, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if(cpu->mem == MAP_FAILED){
+			cpu->mem = NULL;
+			RISCV_deinit(cpu);
+			return NULL;
+		}
+	}
+	cpu->stack_top = cpu->mem_size - 1;
+	cpu->csr.time_base = RISCV_time_ns();
+
+	// Allocate decoded instructions cache, one entry per 16 bits (compressed
+	// instructions only need to be 2 bytes aligned)
+	cpu->icache_size = (cpu->mem_size + 1) / 2;
+	cpu->icache = RISCV_table_alloc(cpu->icache_size * sizeof(RISCV_dinstr_st));
+	cpu->pages = RISCV_table_alloc(RISCV_PAGES * sizeof(uint8_t));
+	cpu->sys = RISCV_sys_init();
+	cpu->mmu = RISCV_mmu_init();
+	if(!cpu->icache || !cpu->pages || !cpu->sys || !cpu->mmu){
 		RISCV_deinit(cpu);
 		return NULL;
 	}
-	if(options->set_to_0){
-		memset(cpu->mem, 0, cpu->mem_size);
+	RISCV_priv_reset(cpu);
+
+#if RISCV_HAS_JIT
+	if(cpu->core == RISCV_CORE_JIT){
+		cpu->jit = RISCV_jit_init(cpu);
+		if(!cpu->jit){
+			fprintf(stderr, "Error, cannot allocate the JIT, interpreting instead.\n");
+			cpu->core = RISCV_CORE_GOTO;
+		}
 	}
-	cpu->stack_top = cpu->mem_size - 1;
+#endif
 
 	return cpu;
 }
@@ -49,8 +142,23 @@ void RISCV_deinit(RISCV_st *cpu)
 {
 	if(!cpu)
 		return;
-	if(!cpu->mem)
-		free(cpu->mem);
+	RISCV_debug_stop(cpu);
+	RISCV_trace_stop(cpu);
+	RISCV_stats_stop(cpu);
+	RISCV_prof_stop(cpu);
+	RISCV_sys_deinit(cpu->sys);
+	RISCV_mmio_free(cpu);
+	RISCV_mmu_deinit(cpu->mmu);
+#if RISCV_HAS_JIT
+	RISCV_jit_deinit(cpu->jit);
+#endif
+	RISCV_symtab_free(cpu->symtab);
+	if(cpu->mem)
+		munmap(cpu->mem, cpu->mem_reserved);
+	free(cpu->fault);
+	RISCV_table_free(cpu->icache, cpu->icache_size * sizeof(RISCV_dinstr_st));
+	RISCV_dirty_stop(cpu);
+	RISCV_table_free(cpu->pages, RISCV_PAGES * sizeof(uint8_t));
 	free(cpu);
 }
 
@@ -66,6 +174,93 @@ void RISCV_load_raw_program(RISCV_st *cpu, const uint8_t *elf, size_t elf_size)
 
 	// Copy program to memory
 	memcpy(cpu->mem, elf, elf_size);
+	cpu->entry = 0;
+	RISCV_symtab_free(cpu->symtab);
+	cpu->symtab = NULL;
+
+	// Previously decoded instructions are stale now
+	RISCV_icache_flush(cpu);
+}
+
+void* RISCV_table_alloc(size_t size)
+{
+	void *table = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+	return table == MAP_FAILED? NULL : table;
+}
+
+void RISCV_table_clear(void *table, size_t size)
+{
+	assert(table);
+
+	// Pages never touched cost nothing, the others are zeroed on next use
+	if(size < TABLE_MADVISE_MIN || madvise(table, size, MADV_DONTNEED))
+		memset(table, 0, size);
+}
+
+void RISCV_table_free(void *table, size_t size)
+{
+	if(table)
+		munmap(table, size);
+}
+
+bool RISCV_page_write(RISCV_st *cpu, uint32_t addr, uint32_t size)
+{
+	uint8_t flags = cpu->pages[addr >> RISCV_PAGE_SHIFT];
+	uint32_t last = addr + size - 1;
+
+	if(flags & (PAGE_CLEAN | PAGE_CLEAN_NEXT))
+		RISCV_dirty_mark(cpu, addr, size);
+
+	// Drop overwritten instructions so they get decoded again, starting with
+	// the 32 bits one which may begin 2 bytes before
+	if(flags & PAGE_CODE){
+		for(uint32_t i=addr >> 1 ? (addr >> 1) - 1 : 0 ; i<=(last >> 1) ; i++){
+			if(i < cpu->icache_size)
+				cpu->icache[i].exec = NULL;
+		}
+		RISCV_icache_drop_fused(cpu, addr);
+#if RISCV_HAS_JIT
+		// Translated blocks too, only the ones over the written bytes
+		if(cpu->jit)
+			RISCV_jit_invalidate(cpu->jit, addr, size);
+#endif
+	}
+
+	// Watched bytes are written now, the run stops after the store
+	if(flags & PAGE_WATCH)
+		return RISCV_debug_store(cpu, addr, size);
+	return false;
+}
+
+void RISCV_icache_drop_fused(RISCV_st *cpu, uint32_t addr)
+{
+	// Pairs are at most 8 bytes long
+	for(uint32_t i=addr >> 1 > 3 ? (addr >> 1) - 3 : 0 ; i<(addr >> 1) && i<cpu->icache_size ; i++){
+		if(cpu->icache[i].op >= RISCV_OP_FUSED)
+			cpu->icache[i].exec = NULL;
+	}
+}
+
+void RISCV_icache_flush(RISCV_st *cpu)
+{
+	assert(cpu);
+
+	RISCV_table_clear(cpu->icache, cpu->icache_size * sizeof(RISCV_dinstr_st));
+	// Forget where instructions were decoded from, clean pages stay so, and
+	// so do breakpoints and watchpoints
+	if(cpu->dirty || cpu->debug){
+		for(size_t i=0 ; i<=(cpu->mem_size >> RISCV_PAGE_SHIFT) ; i++)
+			cpu->pages[i] &= ~PAGE_CODE;
+	}
+	else{
+		RISCV_table_clear(cpu->pages, RISCV_PAGES * sizeof(uint8_t));
+	}
+#if RISCV_HAS_JIT
+	if(cpu->jit)
+		RISCV_jit_flush(cpu->jit);
+#endif
 }
 
 void RISCV_reset(RISCV_st *cpu)
@@ -81,78 +276,651 @@ void RISCV_reset(RISCV_st *cpu)
 	cpu->reg[SP] = cpu->stack_top;
 	
 	// Set program counter
-	cpu->pc = 0;
+	cpu->pc = cpu->entry;
+
+	// Heap starts over at the end of the program
+	cpu->sys->brk = 0;
+	cpu->sys->exited = false;
+	cpu->sys->exit_code = 0;
+
+	// Machine mode, no translation
+	RISCV_priv_reset(cpu);
 }
 
 void RISCV_step(RISCV_st *cpu)
 {
-	uint32_t instr = 0;
+	RISCV_run(cpu, 1);
+}
+
+// pc of the instruction following di at pc
+//	A predicted branch rather than pc + di->len: the next pc is on the
+//	critical path from one instruction to the next, it shouldn't wait for
+//	di to load.
+static inline pc_kt RISCV_next_pc(pc_kt pc, const RISCV_dinstr_st *di)
+{
+	if(__builtin_expect(di->len == 2, 0))
+		return pc + 2;
+	return pc + 4;
+}
+
+// Not executed, pc points to it, for RISCV_run() or the guest to take the
+// exception
+static inline void RISCV_instr_exception(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	cpu->pc -= di->len;
+	cpu->stop = RISCV_STOP_TRAP;
+}
+
+// Fused pair, or only its first instruction if the budget ends in between
+//	Returns the number of instructions executed
+static inline uint64_t RISCV_exec_fused(RISCV_st *cpu, const RISCV_dinstr_st *di, uint64_t left)
+{
+	if(left < 2){
+		RISCV_EXEC[RISCV_FIRST[di->op]](cpu, di);
+		return 1;
+	}
+
+	di->exec(cpu, di);
+	return 2;
+}
+
+static uint64_t RISCV_run_call(RISCV_st *cpu, uint64_t max_instructions)
+{
+	// Hot state is kept local, the compiler can keep it in registers
+	RISCV_dinstr_st * const icache = cpu->icache;
+	const pc_kt halfwords = cpu->mem_size >> 1;
+	RISCV_dinstr_st *di = NULL;
+	pc_kt pc = 0;
+	uint64_t n = 0;
+
+	while(n < max_instructions){
+		pc = cpu->pc;
+		if((pc >> 1) >= halfwords || (pc & 0x1)){
+			// Fetching outside of mem
+			cpu->stop = RISCV_STOP_TRAP;
+			break;
+		}
+
+		// Instructions are decoded once, then executed straight from the cache
+		di = &icache[pc >> 1];
+		if(!di->exec){
+			RISCV_decode_instr(RISCV_fetch_instr(cpu), di);
+			RISCV_page_code(cpu, pc);
+			RISCV_fuse_instr(cpu, pc);
+		}
+
+		DEBUG_PRINT("Executing instruction Ox%08x at pc: 0x%08x.\n", di->instr, pc);
+
+		// pc points to the next instr while executing, as if fetched. Branching
+		//	on len keeps the next pc from waiting for di to load.
+		cpu->pc = RISCV_next_pc(pc, di);
+		if(di->op < RISCV_OP_FUSED){
+			// Counters read the instructions retired so far
+			if(di->op >= RISCV_OP_CSR)
+				cpu->csr.retired = n;
+			di->exec(cpu, di);
+			n++;
+		}
+		else{
+			n += RISCV_exec_fused(cpu, di, max_instructions - n);
+		}
+
+		// ZERO is always 0
+		cpu->reg[ZERO] = 0;
+
+		TRACE_INSTR(cpu, pc, di);
+
+		if(cpu->stop){
+			// A trapping instr isn't retired, pc still points to it (the second
+			// one of a fused pair, the first one never traps), nor is one
+			// stopped at by a breakpoint
+			if(cpu->stop == RISCV_STOP_TRAP || cpu->stop == RISCV_STOP_DEBUG_BREAK)
+				n--;
+			else
+				STATS_INSTR(cpu, pc);
+			break;
+		}
+		STATS_INSTR(cpu, pc);
+	}
+
+	cpu->csr.instret += n;
+	return n;
+}
+
+#if RISCV_HAS_GOTO
+// Labels as values aren't ISO C
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#if !defined(__clang__)
+// Otherwise gcc merges the dispatch copies back into a single one
+__attribute__((optimize("no-crossjumping", "no-gcse")))
+#endif
+static uint64_t RISCV_run_goto(RISCV_st *cpu, uint64_t max_instructions)
+{
+	#define RISCV_OP_LABEL(NAME, name) &&do_##name,
+	#define RISCV_FUSED_LABEL(NAME, name, FIRST, first, second) &&do_##name,
+	static const void * const labels[RISCV_OP_COUNT] = {
+		RISCV_INSTR_LIST(RISCV_OP_LABEL)
+		[RISCV_OP_CSR] = RISCV_CSR_LIST(RISCV_OP_LABEL)
+		[RISCV_OP_FUSED] = RISCV_FUSED_LIST(RISCV_FUSED_LABEL)
+	};
+	RISCV_dinstr_st * const icache = cpu->icache;
+	const pc_kt halfwords = cpu->mem_size >> 1;
+	RISCV_dinstr_st *di = NULL;
+	pc_kt pc = 0;
+	uint64_t n = 0;
+
+	// Same steps as RISCV_run_call(), but every handler ends with its own
+	// copy of the dispatch: one indirect jump per handler predicts better
+	// than the single shared call site of the loop.
+	#define DISPATCH() do{ \
+		if(n >= max_instructions) \
+			goto end; \
+		pc = cpu->pc; \
+		if((pc >> 1) >= halfwords || (pc & 0x1)){ \
+			cpu->stop = RISCV_STOP_TRAP; \
+			goto end; \
+		} \
+		di = &icache[pc >> 1]; \
+		if(!di->exec){ \
+			RISCV_decode_instr(RISCV_fetch_instr(cpu), di); \
+			RISCV_page_code(cpu, pc); \
+			RISCV_fuse_instr(cpu, pc); \
+		} \
+		DEBUG_PRINT("Executing instruction Ox%08x at pc: 0x%08x.\n", di->instr, pc); \
+		cpu->pc = RISCV_next_pc(pc, di); \
+		goto *labels[di->op]; \
+	}while(0)
+
+	// Handlers are in this file, the compiler inlines them in place
+	#define RISCV_OP_CASE(NAME, name) \
+	do_##name: \
+		RISCV_instr_##name(cpu, di); \
+		n++; \
+		cpu->reg[ZERO] = 0; \
+		TRACE_INSTR(cpu, pc, di); \
+		if(cpu->stop) \
+			goto stopped; \
+		STATS_INSTR(cpu, pc); \
+		DISPATCH();
+
+	// Same, cpu->csr.retired is set first for the counters
+	#define RISCV_CSR_CASE(NAME, name) \
+	do_##name: \
+		cpu->csr.retired = n; \
+		RISCV_instr_##name(cpu, di); \
+		n++; \
+		cpu->reg[ZERO] = 0; \
+		TRACE_INSTR(cpu, pc, di); \
+		if(cpu->stop) \
+			goto stopped; \
+		STATS_INSTR(cpu, pc); \
+		DISPATCH();
+
+	// Fused pairs retire 2 instructions, the first one runs alone when the
+	// budget ends in between. No fusion while tracing or counting, no
+	// TRACE_INSTR() or STATS_INSTR().
+	// Both handlers are spelled out, they get inlined like the single ones.
+	#define RISCV_FUSED_CASE(NAME, name, FIRST, first, second) \
+	do_##name: \
+		if(max_instructions - n < 2) \
+			goto *labels[RISCV_OP_##FIRST]; \
+		RISCV_instr_##first(cpu, di); \
+		cpu->pc += RISCV_dinstr_next(di)->len; \
+		RISCV_instr_##second(cpu, RISCV_dinstr_next(di)); \
+		n += 2; \
+		cpu->reg[ZERO] = 0; \
+		if(cpu->stop) \
+			goto stopped; \
+		DISPATCH();
+
+	DISPATCH();
+	RISCV_INSTR_LIST(RISCV_OP_CASE)
+	RISCV_CSR_LIST(RISCV_CSR_CASE)
+	RISCV_FUSED_LIST(RISCV_FUSED_CASE)
+
+stopped:
+	// A trapping instr isn't retired, pc still points to it (the second one
+	// of a fused pair, the first one never traps), nor is one stopped at by
+	// a breakpoint
+	if(cpu->stop == RISCV_STOP_TRAP || cpu->stop == RISCV_STOP_DEBUG_BREAK)
+		n--;
+	else
+		STATS_INSTR(cpu, pc);
+end:
+	cpu->csr.instret += n;
+	return n;
+
+	#undef RISCV_FUSED_CASE
+	#undef RISCV_CSR_CASE
+	#undef RISCV_OP_CASE
+	#undef DISPATCH
+	#undef RISCV_FUSED_LABEL
+	#undef RISCV_OP_LABEL
+}
+#pragma GCC diagnostic pop
+#endif
+
+#if RISCV_HAS_JIT
+static uint64_t RISCV_run_jit(RISCV_st *cpu, uint64_t max_instructions)
+{
+	RISCV_jit_st * const jit = cpu->jit;
+	const RISCV_jit_enter_fn enter = RISCV_jit_enter(jit);
+	const pc_kt halfwords = cpu->mem_size >> 1;
+	const RISCV_jit_block_st *block = NULL;
+	RISCV_jit_ret_st ret = {0};
+	uint64_t left = max_instructions;
+	uint64_t synced = max_instructions; // left when csr.instret was last updated
+	uint64_t link_flushes = 0;
+	uint32_t link = 0;
+	pc_kt pc = 0;
+
+	while(left){
+		pc = cpu->pc;
+		if((pc >> 1) >= halfwords || (pc & 0x1)){
+			// Fetching outside of mem
+			cpu->stop = RISCV_STOP_TRAP;
+			break;
+		}
+
+		block = RISCV_jit_lookup(cpu, pc);
+		// The exit that got here jumps to the block directly from now on
+		if(link && block && link_flushes == jit->flushes)
+			RISCV_jit_link(jit, link, block);
+		link = 0;
+
+		if(block && block->len <= left){
+			// Whole blocks only, chained ones as well
+			ret = enter(cpu, cpu->mem, cpu->pages, left, RISCV_jit_native(block));
+			cpu->pc = (pc_kt)ret.exit;
+			left = ret.left;
+			link = ret.exit >> 32;
+			link_flushes = jit->flushes;
+		}
+		else{
+			// Not translatable, or the budget ends inside the block
+			//	The interpreter counts from instret, which includes blocks
+			cpu->csr.instret += synced - left;
+			left -= RISCV_run_call(cpu, 1);
+			synced = left;
+		}
+
+		if(cpu->stop)
+			break;
+	}
+
+	cpu->csr.instret += synced - left;
+	return max_instructions - left;
+}
+#endif
+
+// Loads and stores of the VM core, translated
+static inline void RISCV_vm_access(RISCV_st *cpu, const RISCV_dinstr_st *di, uint8_t op)
+{
+	uint32_t addr = cpu->reg[di->rs1] + di->imm;
+	uint32_t value = 0;
+	bool done = false;
+
+	TRACE_MEM(cpu, addr);
+	switch(op){
+		case RISCV_OP_LB:	done = RISCV_mmu_load(cpu, addr, 1, &value); value = (int8_t)value; break;
+		case RISCV_OP_LH:	done = RISCV_mmu_load(cpu, addr, 2, &value); value = (int16_t)value; break;
+		case RISCV_OP_LW:	done = RISCV_mmu_load(cpu, addr, 4, &value); break;
+		case RISCV_OP_LBU:	done = RISCV_mmu_load(cpu, addr, 1, &value); break;
+		case RISCV_OP_LHU:	done = RISCV_mmu_load(cpu, addr, 2, &value); break;
+		case RISCV_OP_SB:	done = RISCV_mmu_store(cpu, addr, 1, cpu->reg[di->rs2]); break;
+		case RISCV_OP_SH:	done = RISCV_mmu_store(cpu, addr, 2, cpu->reg[di->rs2]); break;
+		default:			done = RISCV_mmu_store(cpu, addr, 4, cpu->reg[di->rs2]); break;
+	}
+
+	if(!done)
+		RISCV_instr_exception(cpu, di);
+	else if(op <= RISCV_OP_LHU)
+		cpu->reg[di->rd] = value;
+}
+
+// Interpreter of the translated modes (see PolyRISC-V_mmu.h)
+//	Instructions are decoded once per physical address, into the cache of
+//	the flat cores, pc is virtual. Fused pairs run one instruction at a
+//	time, the second one may be on another page. Exceptions are taken by
+//	the guest from here, as long as it stays in a translated mode.
+static uint64_t RISCV_run_vm(RISCV_st *cpu, uint64_t max_instructions)
+{
+	RISCV_dinstr_st * const icache = cpu->icache;
+	RISCV_dinstr_st split = {0};
+	RISCV_dinstr_st *di = NULL;
+	uint32_t pa = 0, high = 0, raw = 0;
+	pc_kt pc = 0;
+	uint64_t n = 0;
+	uint8_t op = 0;
+
+	while(n < max_instructions){
+		pc = cpu->pc;
+		di = NULL;
+		if(!RISCV_mmu_fetch(cpu, pc, &pa))
+			goto exception;
+
+		raw = RISCV_mem_read16(cpu->mem, pa);
+		if((pa & (RISCV_PAGE_SIZE - 1)) == RISCV_PAGE_SIZE - 2 && RISCV_INSTR_LEN(raw) == 4){
+			// 32 bits across pages, the halves may be anywhere: not cached
+			if(!RISCV_mmu_fetch(cpu, pc + 2, &high))
+				goto exception;
+			di = &split;
+			RISCV_decode_instr(raw | (uint32_t)RISCV_mem_read16(cpu->mem, high) << 16, di);
+		}
+		else{
+			di = &icache[pa >> 1];
+			if(!di->exec){
+				RISCV_decode_instr(RISCV_read_instr(cpu, pa), di);
+				RISCV_page_code(cpu, pa);
+			}
+		}
+
+		DEBUG_PRINT("Executing instruction Ox%08x at pc: 0x%08x.\n", di->instr, pc);
+
+		cpu->pc = RISCV_next_pc(pc, di);
+		op = RISCV_op_first(di->op);
+		if(op >= RISCV_OP_LB && op <= RISCV_OP_SW){
+			RISCV_vm_access(cpu, di, op);
+		}
+		else{
+			if(op >= RISCV_OP_CSR)
+				cpu->csr.retired = n;
+			RISCV_EXEC[op](cpu, di);
+		}
+
+		cpu->reg[ZERO] = 0;
+
+		TRACE_INSTR(cpu, pc, di);
+
+		if(!cpu->stop){
+			STATS_INSTR(cpu, pa);
+			n++;
+			continue;
+		}
+		if(cpu->stop == RISCV_STOP_DEBUG_BREAK)
+			break;
+		if(cpu->stop != RISCV_STOP_TRAP){
+			STATS_INSTR(cpu, pa);
+			n++;
+			break;
+		}
+
+	exception:
+		// Not retired, the guest may leave the translated modes for its handler
+		if(!RISCV_priv_exception(cpu, di)){
+			cpu->stop = RISCV_STOP_TRAP;
+			break;
+		}
+		if(!RISCV_mmu_on(cpu)){
+			cpu->stop = RISCV_STOP_SWITCH;
+			break;
+		}
+	}
+
+	cpu->csr.instret += n;
+	return n;
+}
+
+static uint64_t RISCV_run_core(RISCV_st *cpu, RISCV_core_et core, uint64_t max_instructions)
+{
+	// Translated modes have their own interpreter
+	if(RISCV_mmu_on(cpu))
+		return RISCV_run_vm(cpu, max_instructions);
+
+	switch(core){
+#if RISCV_HAS_JIT
+		case RISCV_CORE_JIT:
+			return RISCV_run_jit(cpu, max_instructions);
+#endif
+#if RISCV_HAS_GOTO
+		case RISCV_CORE_GOTO:
+			return RISCV_run_goto(cpu, max_instructions);
+#endif
+		default:
+			return RISCV_run_call(cpu, max_instructions);
+	}
+}
+
+// Same, stopping every prof->period instructions for a sample
+static uint64_t RISCV_run_sampled(RISCV_st *cpu, RISCV_core_et core, uint64_t max_instructions)
+{
+#if RISCV_PROF
+	uint64_t retired = 0;
+
+	if(cpu->prof){
+		// Slices end at sample points
+		while(retired < max_instructions && !cpu->stop){
+			RISCV_prof_st *prof = cpu->prof;
+			uint64_t slice = max_instructions - retired;
+			uint64_t n = 0;
+
+			if(slice > prof->left)
+				slice = prof->left;
+			n = RISCV_run_core(cpu, core, slice);
+			retired += n;
+			prof->left -= n;
+			if(!prof->left){
+				RISCV_prof_sample(cpu);
+				prof->left = prof->period;
+			}
+		}
+		return retired;
+	}
+#endif
+	return RISCV_run_core(cpu, core, max_instructions);
+}
+
+// Stops the run goes on from, cleared, false for the others
+static bool RISCV_run_resume(RISCV_st *cpu, RISCV_run_st *run)
+{
+	RISCV_dinstr_st di = {0};
+
+	switch(cpu->stop){
+		// New mode or translation, pending interrupts may be enabled now
+		case RISCV_STOP_SWITCH:{
+			cpu->stop = RISCV_STOP_NONE;
+		}return true;
+
+		case RISCV_STOP_TRAP:{
+			// Device accesses trap out of the flat cores, they are run from here
+			if(cpu->mmio && RISCV_mmio_fault(cpu)){
+				run->retired++;
+				return true;
+			}
+			// The VM core already gave it to the guest if it could, the flat
+			// ones leave it at pc
+			if(RISCV_mmu_on(cpu) || !RISCV_priv_guest_traps(cpu))
+				return false;
+			if((cpu->pc >> 1) >= (cpu->mem_size >> 1) || (cpu->pc & 0x1))
+				return RISCV_priv_exception(cpu, NULL);
+			if(cpu->icache[cpu->pc >> 1].exec)
+				return RISCV_priv_exception(cpu, &cpu->icache[cpu->pc >> 1]);
+			RISCV_decode_instr(RISCV_read_instr(cpu, cpu->pc), &di);
+		}return RISCV_priv_exception(cpu, &di);
+
+		default:
+			return false;
+	}
+}
+
+RISCV_run_st RISCV_run(RISCV_st *cpu, uint64_t max_instructions)
+{
+	RISCV_run_st run = {RISCV_STOP_BUDGET, 0};
+	RISCV_core_et core = RISCV_CORE_DEFAULT;
+#if RISCV_STATS
+	uint64_t start = 0;
+#endif
+
+	// Checked once per run, not once per instruction
+	assert(cpu);
+	assert(cpu->mem);
+
+	// Per instruction hooks (trace, statistics, debug prints) need an interpreter
+	core = cpu->core;
+	if(core == RISCV_CORE_JIT && (cpu->trace || cpu->stats || DEBUG))
+		core = RISCV_CORE_GOTO;
+
+#if RISCV_STATS
+	if(cpu->stats)
+		start = RISCV_time_ns();
+#endif
+
+	cpu->stop = RISCV_STOP_NONE;
+	while(run.retired < max_instructions){
+		uint64_t slice = max_instructions - run.retired;
+
+		// Interrupts are taken in between slices
+		if(cpu->priv.mie){
+			RISCV_priv_interrupt(cpu);
+			if(slice > PRIV_SLICE)
+				slice = PRIV_SLICE;
+		}
+
+#if RISCV_HAS_GUARD
+		if(cpu->fault)
+			RISCV_guard_begin(cpu);
+#endif
+		run.retired += RISCV_run_sampled(cpu, core, slice);
+#if RISCV_HAS_GUARD
+		if(cpu->fault)
+			RISCV_guard_end(cpu);
+#endif
+		if(cpu->stop && !RISCV_run_resume(cpu, &run))
+			break;
+	}
+
+	if(cpu->stop)
+		run.reason = cpu->stop;
+	// The host may print next, guest output comes first
+	RISCV_sys_flush(cpu->sys);
+
+#if RISCV_STATS
+	if(cpu->stats){
+		cpu->stats->retired += run.retired;
+		cpu->stats->seconds += (RISCV_time_ns() - start) / 1e9;
+	}
+#endif
+
+	return run;
+}
+
+void RISCV_decode_instr(const uint32_t instr, RISCV_dinstr_st *di)
+{
 	uint8_t opcode = 0;
 	uint8_t funct3 = 0;
 	uint8_t funct7 = 0;
-	uint8_t funct12 = 0;
+	uint16_t funct12 = 0;
 
-	assert(cpu);
-	assert(cpu->mem);
+	assert(di);
 
-	// Fetch instruction
-	instr = RISCV_fetch_instr(cpu);
+	// Compressed instructions are run as the RV32I ones they expand to
+	if(RISCV_INSTR_LEN(instr) == 2){
+		uint32_t expanded = RISCV_rvc_expand(instr & 0xFFFF);
 
-	DEBUG_PRINT("Executing instruction Ox%08x at pc: 0x%08x.\n", instr, cpu->pc);
+		if(expanded){
+			RISCV_decode_instr(expanded, di);
+		}
+		else{
+			fprintf(stderr, "Error, illegal compressed instruction: 0x%04x.\n", instr & 0xFFFF);
+			*di = (RISCV_dinstr_st){.op = RISCV_OP_ILLEGAL, .exec = RISCV_EXEC[RISCV_OP_ILLEGAL]};
+		}
+		di->instr = instr & 0xFFFF;
+		di->len = 2;
+		return;
+	}
 
 	// Decode instruction
 	opcode = instr_decode_opcode(instr);
 		// funct3 = instr_decode_funct3(instr);
 		// funct7 = instr_decode_funct7(instr);
 		// funct12 = instr_decode_funct12(instr);
+
+	// Argument fields, whatever the format (unused ones are ignored)
+	di->instr = instr;
+	di->len = 4;
+	di->rd = instr_decode_rd(instr);
+	di->rs1 = instr_decode_rs1(instr);
+	di->rs2 = instr_decode_rs2(instr);
+
+	// Sign-extended immediate, depends on the format
+	switch(opcode){
+		case OP_LUI:
+		case OP_AUIPC:{
+			di->imm = instr_decode_imm_31_12(instr);
+		}break;
+
+		case OP_JAL:{
+			di->imm = instr_decode_imm_jal(instr);
+		}break;
+
+		case OP_BRANCH:{
+			di->imm = instr_decode_imm_branch(instr);
+		}break;
+
+		case OP_STORE:{
+			di->imm = instr_decode_imm_store(instr);
+		}break;
+
+		case OP_SYSTEM:{
+			// CSR number
+			di->imm = instr_decode_imm_11_0_u(instr);
+		}break;
+
+		default:{
+			di->imm = instr_decode_imm_11_0(instr);
+		}
+	}
 	
 	// 3 possible methods
 	//	-> switch case
 	//	-> callback lookup table
 	//	-> computed goto (gcc only)
 	// Go for switch case because opcodes aren't continuous
+	// The switch only runs once per instruction word, the handler is cached
 	switch(opcode){
 		case OP_LUI:{
-			RISCV_instr_lui(cpu, instr);
+			di->op = RISCV_OP_LUI;
 		}break;
 
 		case OP_AUIPC:{
-			RISCV_instr_auipc(cpu, instr);
+			di->op = RISCV_OP_AUIPC;
 		}break;
 
 		case OP_JAL:{
-			RISCV_instr_jal(cpu, instr);
+			// Jumping to itself is the usual way to end a bare program
+			di->op = di->imm? RISCV_OP_JAL : RISCV_OP_JAL_HALT;
 		}break;
 
 		case OP_JALR:{
-			RISCV_instr_jalr(cpu, instr);
+			di->op = RISCV_OP_JALR;
 		}break;
 
 		case OP_BRANCH:{
 			funct3 = instr_decode_funct3(instr);
 			switch(funct3){
 				case F3_BRANCH_BEQ:{
-					RISCV_instr_beq(cpu, instr);
+					di->op = RISCV_OP_BEQ;
 				}break;
 
 				case F3_BRANCH_BNE:{
-					RISCV_instr_bne(cpu, instr);
+					di->op = RISCV_OP_BNE;
 				}break;
 
 				case F3_BRANCH_BLT:{
-					RISCV_instr_blt(cpu, instr);
+					di->op = RISCV_OP_BLT;
 				}break;
 
 				case F3_BRANCH_BGE:{
-					RISCV_instr_bge(cpu, instr);
+					di->op = RISCV_OP_BGE;
 				}break;
 
 				case F3_BRANCH_BLTU:{
-					RISCV_instr_bltu(cpu, instr);
+					di->op = RISCV_OP_BLTU;
 				}break;
 
 				case F3_BRANCH_BGEU:{
-					RISCV_instr_bgeu(cpu, instr);
+					di->op = RISCV_OP_BGEU;
 				}break;
 
 				default:{
@@ -160,7 +928,7 @@ void RISCV_step(RISCV_st *cpu)
 							"Error, bad funct3 code: 0x%08x (opcode: 0x%08x).\n",
 							funct3, opcode
 							);
-					assert(0 && "Invalid funct3 code!");
+					di->op = RISCV_OP_ILLEGAL;
 				}
 			}
 		}break;
@@ -169,23 +937,23 @@ void RISCV_step(RISCV_st *cpu)
 			funct3 = instr_decode_funct3(instr);
 			switch(funct3){
 				case F3_LOAD_LB:{
-					RISCV_instr_lb(cpu, instr);
+					di->op = RISCV_OP_LB;
 				}break;
 
 				case F3_LOAD_LH:{
-					RISCV_instr_lh(cpu, instr);
+					di->op = RISCV_OP_LH;
 				}break;
 
 				case F3_LOAD_LW:{
-					RISCV_instr_lw(cpu, instr);
+					di->op = RISCV_OP_LW;
 				}break;
 
 				case F3_LOAD_LBU:{
-					RISCV_instr_lbu(cpu, instr);
+					di->op = RISCV_OP_LBU;
 				}break;
 
 				case F3_LOAD_LHU:{
-					RISCV_instr_lhu(cpu, instr);
+					di->op = RISCV_OP_LHU;
 				}break;
 
 				default:{
@@ -193,7 +961,7 @@ void RISCV_step(RISCV_st *cpu)
 							"Error, bad funct3 code: 0x%08x (opcode: 0x%08x).\n",
 							funct3, opcode
 							);
-					assert(0 && "Invalid funct3 code!");
+					di->op = RISCV_OP_ILLEGAL;
 				}
 			}
 		}break;
@@ -202,15 +970,15 @@ void RISCV_step(RISCV_st *cpu)
 			funct3 = instr_decode_funct3(instr);
 			switch(funct3){
 				case F3_STORE_SB:{
-					RISCV_instr_sb(cpu, instr);
+					di->op = RISCV_OP_SB;
 				}break;
 
 				case F3_STORE_SH:{
-					RISCV_instr_sh(cpu, instr);
+					di->op = RISCV_OP_SH;
 				}break;
 
 				case F3_STORE_SW:{
-					RISCV_instr_sw(cpu, instr);
+					di->op = RISCV_OP_SW;
 				}break;
 
 				default:{
@@ -218,7 +986,7 @@ void RISCV_step(RISCV_st *cpu)
 							"Error, bad funct3 code: 0x%08x (opcode: 0x%08x).\n",
 							funct3, opcode
 							);
-					assert(0 && "Invalid funct3 code!");
+					di->op = RISCV_OP_ILLEGAL;
 				}
 			}
 		}break;
@@ -227,38 +995,44 @@ void RISCV_step(RISCV_st *cpu)
 			funct3 = instr_decode_funct3(instr);
 			switch(funct3){
 				case F3_OP_IMM_ADDI:{
-					RISCV_instr_addi(cpu, instr);
+					di->op = RISCV_OP_ADDI;
 				}break;
 
 				case F3_OP_IMM_SLTI:{
-					RISCV_instr_slti(cpu, instr);
+					di->op = RISCV_OP_SLTI;
 				}break;
 
 				case F3_OP_IMM_SLTIU:{
-					RISCV_instr_sltiu(cpu, instr);
+					di->op = RISCV_OP_SLTIU;
 				}break;
 
 				case F3_OP_IMM_XORI:{
-					RISCV_instr_xori(cpu, instr);
+					di->op = RISCV_OP_XORI;
 				}break;
 
 				case F3_OP_IMM_ORI:{
-					RISCV_instr_ori(cpu, instr);
+					di->op = RISCV_OP_ORI;
 				}break;
 
 				case F3_OP_IMM_ANDI:{
-					RISCV_instr_andi(cpu, instr);
+					di->op = RISCV_OP_ANDI;
+				}break;
+
+				case F3_OP_IMM_SLLI:{
+					di->imm = instr_decode_imm_shamt(instr);
+					di->op = RISCV_OP_SLLI;
 				}break;
 
 				case F3_OP_IMM_SRXI:{
+					di->imm = instr_decode_imm_shamt(instr);
 					funct7 = instr_decode_funct7(instr);
 					switch(funct7){
 						case F7_OP_IMM_SRXI_SRLI:{
-							RISCV_instr_srli(cpu, instr);
+							di->op = RISCV_OP_SRLI;
 						}break;
 
 						case F7_OP_IMM_SRXI_SRAI:{
-							RISCV_instr_srai(cpu, instr);
+							di->op = RISCV_OP_SRAI;
 						}break;
 
 						default:{
@@ -266,7 +1040,7 @@ void RISCV_step(RISCV_st *cpu)
 									"Error, bad funct7 code: 0x%08x (opcode: 0x%08x, funct3: 0x%08x).\n",
 									funct7, opcode, funct3
 							);
-							assert(0 && "Invalid funct7 code!");
+							di->op = RISCV_OP_ILLEGAL;
 						}
 					}
 				}break;
@@ -276,23 +1050,61 @@ void RISCV_step(RISCV_st *cpu)
 							"Error, bad funct3 code: 0x%08x (opcode: 0x%08x).\n",
 							funct3, opcode
 							);
-					assert(0 && "Invalid funct3 code!");
+					di->op = RISCV_OP_ILLEGAL;
 				}
 			}
 		}break;
 
 		case OP_OP:{
 			funct3 = instr_decode_funct3(instr);
+			funct7 = instr_decode_funct7(instr);
+			// M extension, every funct3 is taken
+			if(funct7 == F7_OP_MULDIV){
+				switch(funct3){
+					case F3_OP_MULDIV_MUL:{
+						di->op = RISCV_OP_MUL;
+					}break;
+
+					case F3_OP_MULDIV_MULH:{
+						di->op = RISCV_OP_MULH;
+					}break;
+
+					case F3_OP_MULDIV_MULHSU:{
+						di->op = RISCV_OP_MULHSU;
+					}break;
+
+					case F3_OP_MULDIV_MULHU:{
+						di->op = RISCV_OP_MULHU;
+					}break;
+
+					case F3_OP_MULDIV_DIV:{
+						di->op = RISCV_OP_DIV;
+					}break;
+
+					case F3_OP_MULDIV_DIVU:{
+						di->op = RISCV_OP_DIVU;
+					}break;
+
+					case F3_OP_MULDIV_REM:{
+						di->op = RISCV_OP_REM;
+					}break;
+
+					case F3_OP_MULDIV_REMU:{
+						di->op = RISCV_OP_REMU;
+					}break;
+				}
+				break;
+			}
 			switch(funct3){
 				case F3_OP_AS:{
 					funct7 = instr_decode_funct7(instr);
 					switch(funct7){
 						case F7_OP_AS_ADD:{
-							RISCV_instr_add(cpu, instr);
+							di->op = RISCV_OP_ADD;
 						}break;
 
 						case F7_OP_AS_SUB:{
-							RISCV_instr_sub(cpu, instr);
+							di->op = RISCV_OP_SUB;
 						}break;
 
 						default:{
@@ -300,36 +1112,36 @@ void RISCV_step(RISCV_st *cpu)
 									"Error, bad funct7 code: 0x%08x (opcode: 0x%08x, funct3: 0x%08x).\n",
 									funct7, opcode, funct3
 							);
-							assert(0 && "Invalid funct7 code!");
+							di->op = RISCV_OP_ILLEGAL;
 						}
 					}
 				}break;
 
 				case F3_OP_SLL:{
-					RISCV_instr_sll(cpu, instr);
+					di->op = RISCV_OP_SLL;
 				}break;
 
 				case F3_OP_SLT:{
-					RISCV_instr_slt(cpu, instr);
+					di->op = RISCV_OP_SLT;
 				}break;
 
 				case F3_OP_SLTU:{
-					RISCV_instr_sltu(cpu, instr);
+					di->op = RISCV_OP_SLTU;
 				}break;
 
 				case F3_OP_XOR:{
-					RISCV_instr_xor(cpu, instr);
+					di->op = RISCV_OP_XOR;
 				}break;
 
 				case F3_OP_SRLA:{
 					funct7 = instr_decode_funct7(instr);
 					switch(funct7){
 						case F7_OP_SRLA_SRL:{
-							RISCV_instr_srl(cpu, instr);
+							di->op = RISCV_OP_SRL;
 						}break;
 
 						case F7_OP_SRLA_SRA:{
-							RISCV_instr_sra(cpu, instr);
+							di->op = RISCV_OP_SRA;
 						}break;
 
 						default:{
@@ -337,17 +1149,17 @@ void RISCV_step(RISCV_st *cpu)
 									"Error, bad funct7 code: 0x%08x (opcode: 0x%08x, funct3: 0x%08x).\n",
 									funct7, opcode, funct3
 							);
-							assert(0 && "Invalid funct7 code!");
+							di->op = RISCV_OP_ILLEGAL;
 						}
 					}
 				}break;
 
 				case F3_OP_OR:{
-					RISCV_instr_or(cpu, instr);
+					di->op = RISCV_OP_OR;
 				}break;
 
 				case F3_OP_AND:{
-					RISCV_instr_and(cpu, instr);
+					di->op = RISCV_OP_AND;
 				}break;
 
 				default:{
@@ -355,7 +1167,7 @@ void RISCV_step(RISCV_st *cpu)
 							"Error, bad funct3 code: 0x%08x (opcode: 0x%08x).\n",
 							funct3, opcode
 							);
-					assert(0 && "Invalid funct3 code!");
+					di->op = RISCV_OP_ILLEGAL;
 				}
 			}
 		}break;
@@ -364,8 +1176,11 @@ void RISCV_step(RISCV_st *cpu)
 			funct3 = instr_decode_funct3(instr);
 			switch(funct3){
 				case F3_MISC_MEM_FENCE:{
-					assert(0 && "FENCE Not implemented");
-					RISCV_instr_fence(cpu, instr);
+					di->op = RISCV_OP_FENCE;
+				}break;
+
+				case F3_MISC_MEM_FENCE_I:{
+					di->op = RISCV_OP_FENCE_I;
 				}break;
 
 				default:{
@@ -373,10 +1188,11 @@ void RISCV_step(RISCV_st *cpu)
 							"Error, bad funct3 code: 0x%08x (opcode: 0x%08x).\n",
 							funct3, opcode
 							);
-					assert(0 && "Invalid funct3 code!");
+					di->op = RISCV_OP_ILLEGAL;
 				}
 			}
-		}
+		}break;
+
 		case OP_SYSTEM:{
 			funct3 = instr_decode_funct3(instr);
 			switch(funct3){
@@ -384,43 +1200,158 @@ void RISCV_step(RISCV_st *cpu)
 					funct12 = instr_decode_funct12(instr);
 					switch(funct12){
 						case F12_SYSTEM_PRIV_ECALL:{
-							assert(0 && "ECALL Not implemented");
-							RISCV_instr_ecall(cpu, instr);
+							di->op = RISCV_OP_ECALL;
 						}break;
 
 						case F12_SYSTEM_PRIV_EBREAK:{
-							assert(0 && "EBREAK Not implemented");
-							RISCV_instr_ebreak(cpu, instr);
+							di->op = RISCV_OP_EBREAK;
+						}break;
+
+						case F12_SYSTEM_PRIV_MRET:{
+							di->op = RISCV_OP_MRET;
+						}break;
+
+						case F12_SYSTEM_PRIV_SRET:{
+							di->op = RISCV_OP_SRET;
+						}break;
+
+						case F12_SYSTEM_PRIV_WFI:{
+							di->op = RISCV_OP_WFI;
 						}break;
 
 						default:{
+							// Registers as operands, in the funct12 bits
+							if(instr_decode_funct7(instr) == F7_SYSTEM_PRIV_SFENCE_VMA){
+								di->op = RISCV_OP_SFENCE_VMA;
+								break;
+							}
 							fprintf(stderr,
 									"Error, bad funct12 code: 0x%08x (opcode: 0x%08x, funct3: 0x%08x).\n",
 									funct12, opcode, funct3
 							);
-							assert(0 && "Invalid funct12 code!");
+							di->op = RISCV_OP_ILLEGAL;
 						}
 					}
 				}break;
 
+				case F3_SYSTEM_CSRRW:{
+					di->op = RISCV_OP_CSRRW;
+				}break;
+
+				case F3_SYSTEM_CSRRS:{
+					di->op = RISCV_OP_CSRRS;
+				}break;
+
+				case F3_SYSTEM_CSRRC:{
+					di->op = RISCV_OP_CSRRC;
+				}break;
+
+				case F3_SYSTEM_CSRRWI:{
+					di->op = RISCV_OP_CSRRWI;
+				}break;
+
+				case F3_SYSTEM_CSRRSI:{
+					di->op = RISCV_OP_CSRRSI;
+				}break;
+
+				case F3_SYSTEM_CSRRCI:{
+					di->op = RISCV_OP_CSRRCI;
+				}break;
+
 				default:{
 					fprintf(stderr,
 							"Error, bad funct3 code: 0x%08x (opcode: 0x%08x).\n",
 							funct3, opcode
 							);
-					assert(0 && "Invalid funct3 code!");
+					di->op = RISCV_OP_ILLEGAL;
 				}
 			}
 		}break;
 
 		default:{
-			// TODO: cleaner error handling ? 
 			fprintf(stderr, "Error, bad opcode: 0x%08x.\n", opcode);
-			assert(0 && "Invalid opcode!");
+			di->op = RISCV_OP_ILLEGAL;
 		}
 	}
-	// ZERO is always 0
-	cpu->reg[ZERO] = 0;
+
+	di->exec = RISCV_EXEC[di->op];
+}
+
+// Peephole pass on freshly decoded instructions
+//	Turns the instruction at pc into a fused pair with the next one when
+//	they form one of the idioms of RISCV_FUSED_LIST. The next one gets
+//	decoded as well: fused handlers run it from its own cache entry.
+void RISCV_fuse_instr(RISCV_st *cpu, pc_kt pc)
+{
+	RISCV_dinstr_st *di = NULL;
+	uint32_t raw = 0, next = 0;
+	uint8_t op = 0;
+
+	assert(cpu);
+
+	// Traces and statistics need one record per instruction
+	if(cpu->trace || cpu->stats)
+		return;
+
+	di = &cpu->icache[pc >> 1];
+	// Fused handlers don't clear ZERO in between
+	if(di->rd == ZERO || (size_t)pc + di->len + 2 > cpu->mem_size)
+		return;
+
+	// Raw fields first (of the RV32I form), data after the code doesn't get
+	// decoded
+	raw = RISCV_read_instr(cpu, pc + di->len);
+	next = RISCV_instr_expand(raw);
+
+	switch(di->op){
+		case RISCV_OP_LUI:{
+			// lui rd, hi; addi rd, rd, lo
+			if(instr_decode_opcode(next) == OP_OP_IMM &&
+					instr_decode_funct3(next) == F3_OP_IMM_ADDI &&
+					instr_decode_rd(next) == di->rd &&
+					instr_decode_rs1(next) == di->rd)
+				op = RISCV_OP_LUI_ADDI;
+		}break;
+
+		case RISCV_OP_AUIPC:{
+			// auipc rd, hi; jalr rd2, lo(rd)
+			if(instr_decode_opcode(next) == OP_JALR &&
+					instr_decode_rs1(next) == di->rd)
+				op = RISCV_OP_AUIPC_JALR;
+		}break;
+
+		case RISCV_OP_ADDI:{
+			// addi rd, rd, step; bne rd, rs2, loop
+			if(instr_decode_opcode(next) == OP_BRANCH &&
+					instr_decode_funct3(next) == F3_BRANCH_BNE &&
+					(instr_decode_rs1(next) == di->rd || instr_decode_rs2(next) == di->rd))
+				op = RISCV_OP_ADDI_BNE;
+			// addi sp, sp, -frame; sw ra, off(sp)
+			else if(instr_decode_opcode(next) == OP_STORE &&
+					instr_decode_funct3(next) == F3_STORE_SW &&
+					di->rs1 == di->rd &&
+					instr_decode_rs1(next) == di->rd)
+				op = RISCV_OP_ADDI_SW;
+		}break;
+	}
+
+	if(!op)
+		return;
+
+	if(!di[di->len >> 1].exec){
+		RISCV_decode_instr(raw, &di[di->len >> 1]);
+		RISCV_page_code(cpu, pc + di->len);
+	}
+	// Its handler would run the second one, not the breakpoint over it
+	if(di[di->len >> 1].op == RISCV_OP_DEBUG_BREAK)
+		return;
+	di->op = op;
+	di->exec = RISCV_EXEC[op];
+}
+
+uint8_t RISCV_op_first(uint8_t op)
+{
+	return op < RISCV_OP_FUSED? op : RISCV_FIRST[op];
 }
 
 void RISCV_print_reg(RISCV_st *cpu)
@@ -436,9 +1367,15 @@ void RISCV_print_reg(RISCV_st *cpu)
 
 void RISCV_print_pc(RISCV_st *cpu)
 {
+	const RISCV_sym_st *sym = NULL;
+
 	assert(cpu);
 
-	printf("pc:\t0x %08x\n", cpu->pc);
+	sym = RISCV_symtab_lookup(cpu->symtab, cpu->pc);
+	if(sym)
+		printf("pc:\t0x %08x <%s+0x%x>\n", cpu->pc, sym->name, cpu->pc - sym->addr);
+	else
+		printf("pc:\t0x %08x\n", cpu->pc);
 }
 
 void RISCV_print_mem(RISCV_st *cpu, uint32_t from, uint32_t to)
@@ -472,16 +1409,25 @@ void RISCV_print_mem(RISCV_st *cpu, uint32_t from, uint32_t to)
 
 uint32_t RISCV_fetch_instr(RISCV_st *cpu)
 {
-	uint32_t instr = 
-		(uint32_t)cpu->mem[cpu->pc] | 
-		((uint32_t)cpu->mem[cpu->pc + 1] << 8) |
-		((uint32_t)cpu->mem[cpu->pc + 2] << 16) |
-		((uint32_t)cpu->mem[cpu->pc + 3] << 24);
-	cpu->pc += 4;
+	uint32_t instr = RISCV_read_instr(cpu, cpu->pc);
+	cpu->pc += RISCV_INSTR_LEN(instr);
 
 	return instr;
 }
 
+uint32_t RISCV_read_instr(const RISCV_st *cpu, pc_kt pc)
+{
+	uint32_t instr = RISCV_mem_read16(cpu->mem, pc);
+
+	if(RISCV_INSTR_LEN(instr) == 2)
+		return instr;
+	// A 32 bits instruction going past the end of mem: the illegal 0x0000
+	if((size_t)pc + 4 > cpu->mem_size)
+		return 0;
+
+	return instr | (uint32_t)RISCV_mem_read16(cpu->mem, pc + 2) << 16;
+}
+
 // Decoding instructions
 //	Opcodes
 uint8_t instr_decode_opcode(const uint32_t instr)
@@ -505,7 +1451,7 @@ uint8_t instr_decode_funct7(const uint32_t instr)
 	return instr >> 25;
 }
 
-uint8_t instr_decode_funct12(const uint32_t instr)
+uint16_t instr_decode_funct12(const uint32_t instr)
 {
 	// bits n°20 to 31
 	// 1111 1111 1111 xxxx xxxx xxxx xxxx xxxx
@@ -618,491 +1564,615 @@ int16_t instr_decode_imm_store(const uint32_t instr)
 	//		  31 to 25 -> 11 to 5
 	//		   11 to 7 -> 4 to 0
 	uint16_t imm =
-		((instr >> 19)	& 0xFE0) |
+		((instr >> 20)	& 0xFE0) |
 	// 1111 111x X X X X X X -> 1111 111x X
 		((instr >> 7)	& 0x1F);
 	// X X X X X 1111 1xxx X -> X X xxx1 1111
 	
-	// Check sign bit (n°12). If 1, set all leftmost bits to 1.
-	return (int16_t)((imm & 0x100000)? (imm | 0xF000) : imm);
+	// Check sign bit (n°11). If 1, set all leftmost bits to 1.
+	return (int16_t)((imm & 0x800)? (imm | 0xF000) : imm);
 }
 
 uint8_t instr_decode_imm_shamt(const uint32_t instr)
 {
 	// 5 bits unsigned integer
-	// bits n° 0 to 4
-	// ... xxx1 1111
+	// bits n°20 to 24
+	// ... xxx1 1111 xxxx xxxx xxxx xxxx xxxx
 	
-	return instr & 0x1F;
+	return (instr >> 20) & 0x1F;
 }
 
 // Instructions implementation
-void RISCV_instr_lui(RISCV_st *cpu, uint32_t instr)
+//	pc has been incremented before calling them, so pc points to the next instr
+// A store may overwrite cached instructions or a clean page, only flagged
+// pages take the slow path
+static inline void RISCV_store_check(RISCV_st *cpu, uint32_t addr, uint32_t size)
 {
-	DEBUG_PRINT("%s", "instr: lui\n");
-	cpu->reg[instr_decode_rd(instr)] = instr_decode_imm_31_12(instr);
+	if(cpu->pages[addr >> RISCV_PAGE_SHIFT])
+		RISCV_page_write(cpu, addr, size);
 }
 
-void RISCV_instr_auipc(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_lui(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	DEBUG_PRINT("%s", "instr: auipc\n");
-	// TODO: check this not sure, sould it be cpu->pc += imm ?
-	cpu->reg[instr_decode_rd(instr)] = cpu->pc + instr_decode_imm_31_12(instr);
+	DEBUG_PRINT("instr: lui %s, 0x%05x\n", REG_NAMES[di->rd], (uint32_t)di->imm >> 12);
+	cpu->reg[di->rd] = di->imm;
 }
-void RISCV_instr_jal(RISCV_st *cpu, uint32_t instr)
+
+void RISCV_instr_auipc(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	int32_t imm = instr_decode_imm_jal(instr);
+	DEBUG_PRINT("instr: auipc %s, 0x%05x\n", REG_NAMES[di->rd], (uint32_t)di->imm >> 12);
+	// Relative to the auipc instr itself
+	cpu->reg[di->rd] = cpu->pc - di->len + di->imm;
+}
 
-	DEBUG_PRINT("instr: jal %s, 0x%08x\n", REG_NAMES[rd], imm);
+void RISCV_instr_jal(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("instr: jal %s, 0x%08x\n", REG_NAMES[di->rd], di->imm);
 
-	// pc has been incremented in fetch_instr(), so pc points to the next instr
-	cpu->reg[rd] = cpu->pc; // store pc+4
-	cpu->pc += imm - 4; // offset pc by imm
+	cpu->reg[di->rd] = cpu->pc; // store pc+4 (pc+2 when compressed)
+	cpu->pc += di->imm - di->len; // offset pc by imm
+	PROF_JUMP(cpu, di, RISCV_OP_JAL);
 }
 
-void RISCV_instr_jalr(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_jalr(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	int16_t imm = instr_decode_imm_11_0(instr);
+	// rd may be rs1, read it first
+	pc_kt target = (cpu->reg[di->rs1] + di->imm) & ~0x1;
 
-	DEBUG_PRINT("instr: jalr %s, %d(%s)\n", REG_NAMES[rd], imm, REG_NAMES[rs1]);
+	DEBUG_PRINT("instr: jalr %s, %d(%s)\n", REG_NAMES[di->rd], di->imm, REG_NAMES[di->rs1]);
 
-	// pc has been incremented in fetch_instr(), so pc points to the next instr
-	cpu->reg[rd] = cpu->pc; // store pc+4
-	cpu->pc = (cpu->reg[rs1] + imm) & ~0x1;
+	cpu->reg[di->rd] = cpu->pc; // store pc+4 (pc+2 when compressed)
+	cpu->pc = target;
+	PROF_JUMP(cpu, di, RISCV_OP_JALR);
 }
 
-void RISCV_instr_beq(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_beq(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t rs2 = instr_decode_rs2(instr);
-	int16_t imm = instr_decode_imm_branch(instr);
-
-	DEBUG_PRINT("instr: beq %s, %s, 0x%08x\n", REG_NAMES[rs1], REG_NAMES[rs2], imm);
+	DEBUG_PRINT("instr: beq %s, %s, 0x%08x\n", REG_NAMES[di->rs1], REG_NAMES[di->rs2], di->imm);
 
-	// pc has been incremented in fetch_instr(), so pc points to the next instr
-	if(cpu->reg[rs1] == cpu->reg[rs2])
-		cpu->pc += imm - 4;// offset pc by imm
+	if(cpu->reg[di->rs1] == cpu->reg[di->rs2])
+		cpu->pc += di->imm - di->len;// offset pc by imm
 }
 
-void RISCV_instr_bne(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_bne(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t rs2 = instr_decode_rs2(instr);
-	int16_t imm = instr_decode_imm_branch(instr);
+	DEBUG_PRINT("instr: bne %s, %s, 0x%08x\n", REG_NAMES[di->rs1], REG_NAMES[di->rs2], di->imm);
 
-	DEBUG_PRINT("instr: bne %s, %s, 0x%08x\n", REG_NAMES[rs1], REG_NAMES[rs2], imm);
+	if(cpu->reg[di->rs1] != cpu->reg[di->rs2])
+		cpu->pc += di->imm - di->len;// offset pc by imm
+}
+
+void RISCV_instr_blt(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("instr: blt %s, %s, 0x%08x\n", REG_NAMES[di->rs1], REG_NAMES[di->rs2], di->imm);
 
-	// pc has been incremented in fetch_instr(), so pc points to the next instr
-	if(cpu->reg[rs1] != cpu->reg[rs2])
-		cpu->pc += imm - 4;// offset pc by imm
+	if(cpu->reg[di->rs1] < cpu->reg[di->rs2])
+		cpu->pc += di->imm - di->len;// offset pc by imm
 }
 
-void RISCV_instr_blt(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_bge(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t rs2 = instr_decode_rs2(instr);
-	int16_t imm = instr_decode_imm_branch(instr);
+	DEBUG_PRINT("instr: bge %s, %s, 0x%08x\n", REG_NAMES[di->rs1], REG_NAMES[di->rs2], di->imm);
 
-	DEBUG_PRINT("instr: blt %s, %s, 0x%08x\n", REG_NAMES[rs1], REG_NAMES[rs2], imm);
+	if(cpu->reg[di->rs1] >= cpu->reg[di->rs2])
+		cpu->pc += di->imm - di->len;// offset pc by imm
+}
+
+void RISCV_instr_bltu(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("instr: bltu %s, %s, 0x%08x\n", REG_NAMES[di->rs1], REG_NAMES[di->rs2], di->imm);
 
-	// pc has been incremented in fetch_instr(), so pc points to the next instr
-	if(cpu->reg[rs1] < cpu->reg[rs2])
-		cpu->pc += imm - 4;// offset pc by imm
+	if((uint32_t)cpu->reg[di->rs1] < (uint32_t)cpu->reg[di->rs2])
+		cpu->pc += di->imm - di->len;// offset pc by imm
 }
 
-void RISCV_instr_bge(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_bgeu(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t rs2 = instr_decode_rs2(instr);
-	int16_t imm = instr_decode_imm_branch(instr);
+	DEBUG_PRINT("instr: bgeu %s, %s, 0x%08x\n", REG_NAMES[di->rs1], REG_NAMES[di->rs2], di->imm);
+
+	if((uint32_t)cpu->reg[di->rs1] >= (uint32_t)cpu->reg[di->rs2])
+		cpu->pc += di->imm - di->len;// offset pc by imm
+}
 
-	DEBUG_PRINT("instr: bge %s, %s, 0x%08x\n", REG_NAMES[rs1], REG_NAMES[rs2], imm);
+void RISCV_instr_lb(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	uint32_t addr = cpu->reg[di->rs1] + di->imm;
+	
+	DEBUG_PRINT("instr: lb %s, %d(%s)\n", REG_NAMES[di->rd], di->imm, REG_NAMES[di->rs1]);
 
-	// pc has been incremented in fetch_instr(), so pc points to the next instr
-	if(cpu->reg[rs1] >= cpu->reg[rs2])
-		cpu->pc += imm - 4;// offset pc by imm
+	// Unchecked, faults when guest memory is guarded
+	TRACE_MEM(cpu, addr);
+	cpu->reg[di->rd] = (int8_t)RISCV_mem_read8(cpu->mem, addr);
+	GUARD_ACCESS_DONE(cpu);
 }
 
-void RISCV_instr_bltu(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_lh(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t rs2 = instr_decode_rs2(instr);
-	int16_t imm = instr_decode_imm_branch(instr);
+	uint32_t addr = cpu->reg[di->rs1] + di->imm;
 
-	DEBUG_PRINT("instr: bltu %s, %s, 0x%08x\n", REG_NAMES[rs1], REG_NAMES[rs2], imm);
+	DEBUG_PRINT("instr: lh %s, %d(%s)\n", REG_NAMES[di->rd], di->imm, REG_NAMES[di->rs1]);
 
-	// pc has been incremented in fetch_instr(), so pc points to the next instr
-	if((uint32_t)cpu->reg[rs1] < (uint32_t)cpu->reg[rs2])
-		cpu->pc += imm - 4;// offset pc by imm
+	// Unchecked, faults when guest memory is guarded
+	TRACE_MEM(cpu, addr);
+	cpu->reg[di->rd] = (int16_t)RISCV_mem_read16(cpu->mem, addr);
+	GUARD_ACCESS_DONE(cpu);
 }
 
-void RISCV_instr_bgeu(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_lw(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t rs2 = instr_decode_rs2(instr);
-	int16_t imm = instr_decode_imm_branch(instr);
+	uint32_t addr = cpu->reg[di->rs1] + di->imm;
+	
+	DEBUG_PRINT("instr: lw %s, %d(%s)\n", REG_NAMES[di->rd], di->imm, REG_NAMES[di->rs1]);
 
-	DEBUG_PRINT("instr: bgeu %s, %s, 0x%08x\n", REG_NAMES[rs1], REG_NAMES[rs2], imm);
+	// Unchecked, faults when guest memory is guarded
+	TRACE_MEM(cpu, addr);
+	cpu->reg[di->rd] = RISCV_mem_read32(cpu->mem, addr);
+	GUARD_ACCESS_DONE(cpu);
+}
 
-	// pc has been incremented in fetch_instr(), so pc points to the next instr
-	if((uint32_t)cpu->reg[rs1] >= (uint32_t)cpu->reg[rs2])
-		cpu->pc += imm - 4;// offset pc by imm
+void RISCV_instr_lbu(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	uint32_t addr = cpu->reg[di->rs1] + di->imm;
+	
+	DEBUG_PRINT("instr: lbu %s, %d(%s)\n", REG_NAMES[di->rd], di->imm, REG_NAMES[di->rs1]);
+
+	// Unchecked, faults when guest memory is guarded
+	TRACE_MEM(cpu, addr);
+	cpu->reg[di->rd] = RISCV_mem_read8(cpu->mem, addr);
+	GUARD_ACCESS_DONE(cpu);
 }
 
-void RISCV_instr_lb(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_lhu(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	int16_t imm = instr_decode_imm_11_0(instr);
+	uint32_t addr = cpu->reg[di->rs1] + di->imm;
 	
-	DEBUG_PRINT("instr: lb %s, %d(%s)\n", REG_NAMES[rd], imm, REG_NAMES[rs1]);
+	DEBUG_PRINT("instr: lhu %s, %d(%s)\n", REG_NAMES[di->rd], di->imm, REG_NAMES[di->rs1]);
 
-	// TODO: exception if rd is zero register
-	// TODO: check addr > 0 ?
-	// uint32_t value = (uint32_t)cpu->mem[instr_decode_rs1(instr) + instr_decode_imm_11_0(instr)];
-	// Check sign bit (n°7). If 1, set all leftmost bits to 1.
-	// cpu->reg[instr_decode_rd(instr)] = ((value & 0x80)? (value | 0xFFFFFF80) : value); 
-	cpu->reg[rd] = (int8_t) cpu->mem[cpu->reg[rs1] + imm];
+	// Unchecked, faults when guest memory is guarded
+	TRACE_MEM(cpu, addr);
+	cpu->reg[di->rd] = RISCV_mem_read16(cpu->mem, addr);
+	GUARD_ACCESS_DONE(cpu);
 }
 
-void RISCV_instr_lh(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_sb(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	int16_t imm = instr_decode_imm_11_0(instr);
-	int32_t addr = cpu->reg[rs1] + imm;
+	uint32_t addr = cpu->reg[di->rs1] + di->imm;
 
-	DEBUG_PRINT("instr: lh %s, %d(%s)\n", REG_NAMES[rd], imm, REG_NAMES[rs1]);
+	DEBUG_PRINT("instr: sb %s, %d(%s)\n", REG_NAMES[di->rs2], di->imm, REG_NAMES[di->rs1]);
 
-	// TODO: exception if rd is zero register
-	// TODO: check addr > 0 ?
-	cpu->reg[rd] = (int16_t)
-		((uint16_t)cpu->mem[addr] | ((uint16_t)cpu->mem[addr + 1] << 8));
+	// Unchecked, faults when guest memory is guarded
+	TRACE_MEM(cpu, addr);
+	RISCV_mem_write8(cpu->mem, addr, cpu->reg[di->rs2]);
+	GUARD_ACCESS_DONE(cpu);
+	RISCV_store_check(cpu, addr, 1);
 }
 
-void RISCV_instr_lw(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_sh(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	int16_t imm = instr_decode_imm_11_0(instr);
-	int32_t addr = cpu->reg[rs1] + imm;
-	
-	DEBUG_PRINT("instr: lw %s, %d(%s)\n", REG_NAMES[rd], imm, REG_NAMES[rs1]);
+	uint32_t addr = cpu->reg[di->rs1] + di->imm;
 
-	// TODO: exception if rd is zero register
-	// TODO: check addr > 0 ?
-	cpu->reg[rd] = 
-		(uint32_t)cpu->mem[addr] | 
-		((uint32_t)cpu->mem[addr + 1] << 8) |
-		((uint32_t)cpu->mem[addr + 2] << 16) |
-		((uint32_t)cpu->mem[addr + 3] << 24);
+	DEBUG_PRINT("instr: sh %s, %d(%s)\n", REG_NAMES[di->rs2], di->imm, REG_NAMES[di->rs1]);
+
+	// Unchecked, faults when guest memory is guarded
+	TRACE_MEM(cpu, addr);
+	RISCV_mem_write16(cpu->mem, addr, cpu->reg[di->rs2]);
+	GUARD_ACCESS_DONE(cpu);
+	RISCV_store_check(cpu, addr, 2);
 }
 
-void RISCV_instr_lbu(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_sw(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	int16_t imm = instr_decode_imm_11_0(instr);
-	
-	DEBUG_PRINT("instr: lbu %s, %d(%s)\n", REG_NAMES[rd], imm, REG_NAMES[rs1]);
+	uint32_t addr = cpu->reg[di->rs1] + di->imm;
+
+	DEBUG_PRINT("instr: sw %s, %d(%s)\n", REG_NAMES[di->rs2], di->imm, REG_NAMES[di->rs1]);
 
-	// TODO: exception if rd is zero register
-	// TODO: check addr > 0 ?
-	cpu->reg[rd] = cpu->mem[cpu->reg[rs1] + imm];
+	// Unchecked, faults when guest memory is guarded
+	TRACE_MEM(cpu, addr);
+	RISCV_mem_write32(cpu->mem, addr, cpu->reg[di->rs2]);
+	GUARD_ACCESS_DONE(cpu);
+	RISCV_store_check(cpu, addr, 4);
 }
 
-void RISCV_instr_lhu(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_addi(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	int16_t imm = instr_decode_imm_11_0(instr);
-	int32_t addr = cpu->reg[rs1] + imm;
-	
-	DEBUG_PRINT("instr: lhu %s, %d(%s)\n", REG_NAMES[rd], imm, REG_NAMES[rs1]);
+	DEBUG_PRINT("instr: addi %s, %s, %d\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], di->imm);
 
-	// TODO: exception if rd is zero register
-	// TODO: check addr > 0 ?
-	cpu->reg[rd] = 
-		((uint16_t)cpu->mem[addr] | ((uint16_t)cpu->mem[addr + 1] << 8));
+	cpu->reg[di->rd] = cpu->reg[di->rs1] + di->imm;
 }
 
-void RISCV_instr_sb(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_slti(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t rs2 = instr_decode_rs2(instr);
-	int16_t imm = instr_decode_imm_store(instr);
+	DEBUG_PRINT("instr: slti %s, %s, %d\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], di->imm);
 
-	DEBUG_PRINT("instr: sb %s, %d(%s)\n", REG_NAMES[rs1], imm, REG_NAMES[rs2]);
+	cpu->reg[di->rd] = cpu->reg[di->rs1] < di->imm;
+}
 
-	// TODO: check addr > 0 ?
-	cpu->mem[cpu->reg[rs1] + imm] = cpu->reg[rs2] & 0xFF;
+void RISCV_instr_sltiu(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("instr: sltiu %s, %s, %d\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], di->imm);
+
+	// imm is sign-extended first, then compared as unsigned
+	cpu->reg[di->rd] = (uint32_t)cpu->reg[di->rs1] < (uint32_t)di->imm;
 }
 
-void RISCV_instr_sh(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_xori(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t rs2 = instr_decode_rs2(instr);
-	int16_t imm = instr_decode_imm_store(instr);
-	int32_t addr = cpu->reg[rs1] + imm;
+	DEBUG_PRINT("instr: xori %s, %s, %d\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], di->imm);
 
-	DEBUG_PRINT("instr: sh %s, %d(%s)\n", REG_NAMES[rs1], imm, REG_NAMES[rs2]);
+	cpu->reg[di->rd] = cpu->reg[di->rs1] ^ di->imm;
+}
 
-	// TODO: check addr > 0 ?
-	cpu->mem[addr] = cpu->reg[rs2] & 0xFF;
-	cpu->mem[addr + 1] = (cpu->reg[rs2] >> 8) & 0xFF;
+void RISCV_instr_ori(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("instr: ori %s, %s, %d\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], di->imm);
+
+	cpu->reg[di->rd] = cpu->reg[di->rs1] | di->imm;
+}
+
+void RISCV_instr_andi(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("instr: andi %s, %s, %d\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], di->imm);
+
+	cpu->reg[di->rd] = cpu->reg[di->rs1] & di->imm;
 }
 
-void RISCV_instr_sw(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_slli(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t rs2 = instr_decode_rs2(instr);
-	int16_t imm = instr_decode_imm_store(instr);
-	int32_t addr = cpu->reg[rs1] + imm;
+	DEBUG_PRINT("instr: slli %s, %s, %d\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], di->imm);
 
-	DEBUG_PRINT("instr: sw %s, %d(%s)\n", REG_NAMES[rs1], imm, REG_NAMES[rs2]);
+	// imm is shamt
+	cpu->reg[di->rd] = (uint32_t)cpu->reg[di->rs1] << di->imm;
+}
 
-	// TODO: check addr > 0 ?
-	cpu->mem[addr] = cpu->reg[rs2] & 0xFF;
-	cpu->mem[addr + 1] = (cpu->reg[rs2] >> 8) & 0xFF;
-	cpu->mem[addr + 2] = (cpu->reg[rs2] >> 16) & 0xFF;
-	cpu->mem[addr + 3] = (cpu->reg[rs2] >> 24) & 0xFF;
+void RISCV_instr_srli(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("instr: srli %s, %s, %d\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], di->imm);
+
+	// imm is shamt
+	cpu->reg[di->rd] = (uint32_t)cpu->reg[di->rs1] >> di->imm;
 }
 
-void RISCV_instr_addi(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_srai(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	int16_t imm = instr_decode_imm_11_0(instr);
+	int32_t vrs1 = cpu->reg[di->rs1];
 
-	DEBUG_PRINT("instr: addi %s, %s, %d\n", REG_NAMES[rd], REG_NAMES[rs1], imm);
+	DEBUG_PRINT("instr: srai %s, %s, %d\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], di->imm);
 
-	cpu->reg[rd] = cpu->reg[rs1] + imm;
+	// imm is shamt
+	cpu->reg[di->rd] = (vrs1 < 0)? ~(~vrs1 >> di->imm) : vrs1 >> di->imm;
 }
 
-void RISCV_instr_slti(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_add(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	int16_t imm = instr_decode_imm_11_0(instr);
+	DEBUG_PRINT("instr: add %s, %s, %s\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], REG_NAMES[di->rs2]);
+
+	cpu->reg[di->rd] = cpu->reg[di->rs1] + cpu->reg[di->rs2];
+}
 
-	DEBUG_PRINT("instr: slti %s, %s, %d\n", REG_NAMES[rd], REG_NAMES[rs1], imm);
+void RISCV_instr_sub(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("instr: sub %s, %s, %s\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], REG_NAMES[di->rs2]);
 
-	cpu->reg[rd] = cpu->reg[rs1] < imm;
+	cpu->reg[di->rd] = cpu->reg[di->rs1] - cpu->reg[di->rs2];
 }
 
-void RISCV_instr_sltiu(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_sll(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint16_t imm = instr_decode_imm_11_0_u(instr);
+	DEBUG_PRINT("instr: sll %s, %s, %s\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], REG_NAMES[di->rs2]);
+
+	cpu->reg[di->rd] =
+		(uint32_t)cpu->reg[di->rs1] << (uint8_t)(cpu->reg[di->rs2] & 0x1F); // 5 last bits
+}
 
-	DEBUG_PRINT("instr: addi %s, %s, %d\n", REG_NAMES[rd], REG_NAMES[rs1], imm);
+void RISCV_instr_slt(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("instr: slt %s, %s, %s\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], REG_NAMES[di->rs2]);
 
-	cpu->reg[rd] = cpu->reg[rs1] < imm;
+	cpu->reg[di->rd] = cpu->reg[di->rs1] < cpu->reg[di->rs2];
 }
 
-void RISCV_instr_xori(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_sltu(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	int16_t imm = instr_decode_imm_11_0(instr);
+	DEBUG_PRINT("instr: sltu %s, %s, %s\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], REG_NAMES[di->rs2]);
 
-	DEBUG_PRINT("instr: xori %s, %s, %d\n", REG_NAMES[rd], REG_NAMES[rs1], imm);
+	cpu->reg[di->rd] = (uint32_t)cpu->reg[di->rs1] < (uint32_t)cpu->reg[di->rs2];
+}
+void RISCV_instr_xor(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("instr: xor %s, %s, %s\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], REG_NAMES[di->rs2]);
+
+	cpu->reg[di->rd] = cpu->reg[di->rs1] ^ cpu->reg[di->rs2];
+}
+
+void RISCV_instr_srl(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("instr: srl %s, %s, %s\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], REG_NAMES[di->rs2]);
 
-	// TODO: check this
-	cpu->reg[rd] = cpu->reg[rs1] ^ imm;
+	cpu->reg[di->rd] =
+		(uint32_t)cpu->reg[di->rs1] >> 
+		(uint8_t)(cpu->reg[di->rs2] & 0x1F); // 5 last bits
 }
 
-void RISCV_instr_ori(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_sra(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	int16_t imm = instr_decode_imm_11_0(instr);
+	int32_t vrs1 = cpu->reg[di->rs1];
+	uint8_t vrs2 = cpu->reg[di->rs2] & 0x1F; // 5 last bits
 
-	DEBUG_PRINT("instr: ori %s, %s, %d\n", REG_NAMES[rd], REG_NAMES[rs1], imm);
+	DEBUG_PRINT("instr: sra %s, %s, %s\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], REG_NAMES[di->rs2]);
 
-	// TODO: check this
-	cpu->reg[rd] = cpu->reg[rs1] | imm;
+	cpu->reg[di->rd] = (vrs1 < 0)? ~(~vrs1 >> vrs2) : vrs1 >> vrs2;
 }
 
-void RISCV_instr_andi(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_or(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	int16_t imm = instr_decode_imm_11_0(instr);
+	DEBUG_PRINT("instr: or %s, %s, %s\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], REG_NAMES[di->rs2]);
 
-	DEBUG_PRINT("instr: andi %s, %s, %d\n", REG_NAMES[rd], REG_NAMES[rs1], imm);
+	cpu->reg[di->rd] = cpu->reg[di->rs1] | cpu->reg[di->rs2];
+}
+
+void RISCV_instr_and(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("instr: and %s, %s, %s\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], REG_NAMES[di->rs2]);
 
-	// TODO: check this
-	cpu->reg[rd] = cpu->reg[rs1] & imm;
+	cpu->reg[di->rd] = cpu->reg[di->rs1] & cpu->reg[di->rs2];
 }
 
-void RISCV_instr_slli(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_mul(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t shamt = instr_decode_imm_shamt(instr);
+	DEBUG_PRINT("instr: mul %s, %s, %s\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], REG_NAMES[di->rs2]);
+
+	// Low 32 bits are the same signed or not
+	cpu->reg[di->rd] = (uint32_t)cpu->reg[di->rs1] * (uint32_t)cpu->reg[di->rs2];
+}
 
-	DEBUG_PRINT("instr: slli %s, %s, %d\n", REG_NAMES[rd], REG_NAMES[rs1], shamt);
+void RISCV_instr_mulh(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("instr: mulh %s, %s, %s\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], REG_NAMES[di->rs2]);
 
-	// TODO: check this
-	cpu->reg[rd] = (uint32_t)cpu->reg[rs1] << shamt;
+	cpu->reg[di->rd] = (uint64_t)((int64_t)cpu->reg[di->rs1] * (int64_t)cpu->reg[di->rs2]) >> 32;
 }
 
-void RISCV_instr_srli(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_mulhsu(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t shamt = instr_decode_imm_shamt(instr);
+	DEBUG_PRINT("instr: mulhsu %s, %s, %s\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], REG_NAMES[di->rs2]);
 
-	DEBUG_PRINT("instr: srli %s, %s, %d\n", REG_NAMES[rd], REG_NAMES[rs1], shamt);
+	// rs1 signed, rs2 unsigned: the product fits in an int64_t
+	cpu->reg[di->rd] = (uint64_t)((int64_t)cpu->reg[di->rs1] * (int64_t)(uint32_t)cpu->reg[di->rs2]) >> 32;
+}
 
-	// TODO: check this
-	cpu->reg[rd] = (uint32_t)cpu->reg[rs1] >> shamt;
+void RISCV_instr_mulhu(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("instr: mulhu %s, %s, %s\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], REG_NAMES[di->rs2]);
+
+	cpu->reg[di->rd] = ((uint64_t)(uint32_t)cpu->reg[di->rs1] * (uint32_t)cpu->reg[di->rs2]) >> 32;
 }
 
-void RISCV_instr_srai(RISCV_st *cpu, uint32_t instr)
+// Division never traps
+//	by zero: the quotient has all bits set and the remainder is the dividend
+//	INT32_MIN / -1 overflows: the quotient is the dividend and the remainder 0
+void RISCV_instr_div(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t shamt = instr_decode_imm_shamt(instr);
-	int32_t vrs1 = cpu->reg[rs1];
+	int32_t vrs1 = cpu->reg[di->rs1];
+	int32_t vrs2 = cpu->reg[di->rs2];
 
-	DEBUG_PRINT("instr: srai %s, %s, %d\n", REG_NAMES[rd], REG_NAMES[rs1], shamt);
+	DEBUG_PRINT("instr: div %s, %s, %s\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], REG_NAMES[di->rs2]);
 
-	// TODO: check this
-	cpu->reg[rd] = (vrs1 < 0)? ~(~vrs1 >> shamt) : vrs1 >> shamt;
+	if(!vrs2)
+		cpu->reg[di->rd] = -1;
+	else if(vrs1 == INT32_MIN && vrs2 == -1)
+		cpu->reg[di->rd] = vrs1;
+	else
+		cpu->reg[di->rd] = vrs1 / vrs2;
 }
 
-void RISCV_instr_add(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_divu(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t rs2 = instr_decode_rs2(instr);
+	uint32_t vrs1 = cpu->reg[di->rs1];
+	uint32_t vrs2 = cpu->reg[di->rs2];
 
-	DEBUG_PRINT("instr: add %s, %s, %s\n", REG_NAMES[rd], REG_NAMES[rs1], REG_NAMES[rs2]);
+	DEBUG_PRINT("instr: divu %s, %s, %s\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], REG_NAMES[di->rs2]);
 
-	cpu->reg[rd] = cpu->reg[rs1] + cpu->reg[rs2];
+	cpu->reg[di->rd] = vrs2? vrs1 / vrs2 : UINT32_MAX;
 }
 
-void RISCV_instr_sub(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_rem(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t rs2 = instr_decode_rs2(instr);
+	int32_t vrs1 = cpu->reg[di->rs1];
+	int32_t vrs2 = cpu->reg[di->rs2];
 
-	DEBUG_PRINT("instr: sub %s, %s, %s\n", REG_NAMES[rd], REG_NAMES[rs1], REG_NAMES[rs2]);
+	DEBUG_PRINT("instr: rem %s, %s, %s\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], REG_NAMES[di->rs2]);
 
-	cpu->reg[rd] = cpu->reg[rs1] - cpu->reg[rs2];
+	if(!vrs2)
+		cpu->reg[di->rd] = vrs1;
+	else if(vrs1 == INT32_MIN && vrs2 == -1)
+		cpu->reg[di->rd] = 0;
+	else
+		cpu->reg[di->rd] = vrs1 % vrs2;
 }
 
-void RISCV_instr_sll(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_remu(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t rs2 = instr_decode_rs2(instr);
+	uint32_t vrs1 = cpu->reg[di->rs1];
+	uint32_t vrs2 = cpu->reg[di->rs2];
 
-	DEBUG_PRINT("instr: sll %s, %s, %s\n", REG_NAMES[rd], REG_NAMES[rs1], REG_NAMES[rs2]);
+	DEBUG_PRINT("instr: remu %s, %s, %s\n", REG_NAMES[di->rd], REG_NAMES[di->rs1], REG_NAMES[di->rs2]);
 
-	cpu->reg[rd] =
-		(uint32_t)cpu->reg[rs1] << (uint8_t)(cpu->reg[rs2] & 0x1F); // 5 last bits
+	cpu->reg[di->rd] = vrs2? vrs1 % vrs2 : vrs1;
 }
 
-void RISCV_instr_slt(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_fence(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t rs2 = instr_decode_rs2(instr);
+	(void)cpu;
+	(void)di;
 
-	DEBUG_PRINT("instr: slt %s, %s, %s\n", REG_NAMES[rd], REG_NAMES[rs1], REG_NAMES[rs2]);
+	DEBUG_PRINT("%s", "instr: fence\n");
 
-	cpu->reg[rd] = cpu->reg[rs1] < cpu->reg[rs2];
+	// Single hart, memory accesses are done in order: nothing to do
 }
 
-void RISCV_instr_sltu(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_fence_i(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t rs2 = instr_decode_rs2(instr);
+	(void)cpu;
+	(void)di;
 
-	DEBUG_PRINT("instr: sltu %s, %s, %s\n", REG_NAMES[rd], REG_NAMES[rs1], REG_NAMES[rs2]);
+	DEBUG_PRINT("%s", "instr: fence.i\n");
 
-	cpu->reg[rd] = (uint32_t)cpu->reg[rs1] < (uint32_t)cpu->reg[rs2];
+	// Stores dropped the decoded instructions they overwrote already, see
+	// RISCV_page_write(). Translated code ends its block here, what follows
+	// is looked up again.
 }
-void RISCV_instr_xor(RISCV_st *cpu, uint32_t instr)
+
+void RISCV_instr_ecall(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t rs2 = instr_decode_rs2(instr);
+	DEBUG_PRINT("%s", "instr: ecall\n");
 
-	DEBUG_PRINT("instr: xor %s, %s, %s\n", REG_NAMES[rd], REG_NAMES[rs1], REG_NAMES[rs2]);
+	// The guest kernel serves it, bare metal programs get the host ones
+	if(RISCV_priv_guest_traps(cpu)){
+		RISCV_instr_exception(cpu, di);
+		return;
+	}
+	RISCV_sys_call(cpu);
+}
 
-	cpu->reg[rd] = cpu->reg[rs1] ^ cpu->reg[rs2];
+void RISCV_instr_ebreak(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("%s", "instr: ebreak\n");
+
+	if(RISCV_priv_guest_traps(cpu)){
+		RISCV_instr_exception(cpu, di);
+		return;
+	}
+	cpu->stop = RISCV_STOP_BREAKPOINT;
 }
 
-void RISCV_instr_srl(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_mret(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t rs2 = instr_decode_rs2(instr);
+	DEBUG_PRINT("%s", "instr: mret\n");
 
-	DEBUG_PRINT("instr: srl %s, %s, %s\n", REG_NAMES[rd], REG_NAMES[rs1], REG_NAMES[rs2]);
+	if(!RISCV_priv_mret(cpu))
+		RISCV_instr_illegal(cpu, di);
+}
 
-	cpu->reg[rd] =
-		(uint32_t)cpu->reg[rs1] >> 
-		(uint8_t)(cpu->reg[rs2] & 0x1F); // 5 last bits
+void RISCV_instr_sret(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("%s", "instr: sret\n");
+
+	if(!RISCV_priv_sret(cpu))
+		RISCV_instr_illegal(cpu, di);
 }
 
-void RISCV_instr_sra(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_wfi(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t rs2 = instr_decode_rs2(instr);
-	int32_t vrs1 = cpu->reg[rs1];
-	uint8_t vrs2 = cpu->reg[rs2] & 0x1F; // 5 last bits
+	DEBUG_PRINT("%s", "instr: wfi\n");
 
-	DEBUG_PRINT("instr: add %s, %s, %s\n", REG_NAMES[rd], REG_NAMES[rs1], REG_NAMES[rs2]);
+	if(!RISCV_priv_wfi(cpu))
+		RISCV_instr_illegal(cpu, di);
+}
 
-	cpu->reg[rd] = (vrs1 < 0)? ~(~vrs1 >> vrs2) : vrs1 >> vrs2;
+void RISCV_instr_sfence_vma(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("instr: sfence.vma %s, %s\n", REG_NAMES[di->rs1], REG_NAMES[di->rs2]);
+
+	if(!RISCV_priv_sfence_vma(cpu))
+		RISCV_instr_illegal(cpu, di);
+}
+
+// Debugger breakpoint over the instruction (see PolyRISC-V_debug.h), which
+// isn't run: pc points to it
+void RISCV_instr_debug_break(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("%s", "instr: breakpoint\n");
+
+	cpu->pc -= di->len;
+	cpu->stop = RISCV_STOP_DEBUG_BREAK;
+	cpu->debug->hit = (di - cpu->icache) << 1;
+	cpu->debug->hit_pc = cpu->pc;
+	cpu->debug->at_break = true;
 }
 
-void RISCV_instr_or(RISCV_st *cpu, uint32_t instr)
+// Reads the CSR into rd, then writes (old & ~clear) | set to it if write
+//	Illegal if the CSR doesn't exist, is read-only or above the current mode.
+static void RISCV_csr_access(RISCV_st *cpu, const RISCV_dinstr_st *di, bool write, uint32_t clear, uint32_t set)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t rs2 = instr_decode_rs2(instr);
+	uint32_t value = 0;
 
-	DEBUG_PRINT("instr: or %s, %s, %s\n", REG_NAMES[rd], REG_NAMES[rs1], REG_NAMES[rs2]);
+	if(!RISCV_csr_read(cpu, di->imm, &value) || (write && !RISCV_csr_write(cpu, di->imm, (value & ~clear) | set))){
+		RISCV_instr_illegal(cpu, di);
+		return;
+	}
 
-	cpu->reg[rd] = cpu->reg[rs1] | cpu->reg[rs2];
+	cpu->reg[di->rd] = value;
 }
 
-void RISCV_instr_and(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_csrrw(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	uint8_t rd = instr_decode_rd(instr);
-	uint8_t rs1 = instr_decode_rs1(instr);
-	uint8_t rs2 = instr_decode_rs2(instr);
+	DEBUG_PRINT("instr: csrrw %s, 0x%03x, %s\n", REG_NAMES[di->rd], di->imm, REG_NAMES[di->rs1]);
 
-	DEBUG_PRINT("instr: and %s, %s, %s\n", REG_NAMES[rd], REG_NAMES[rs1], REG_NAMES[rs2]);
+	RISCV_csr_access(cpu, di, true, UINT32_MAX, cpu->reg[di->rs1]);
+}
 
-	cpu->reg[rd] = cpu->reg[rs1] & cpu->reg[rs2];
+void RISCV_instr_csrrs(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("instr: csrrs %s, 0x%03x, %s\n", REG_NAMES[di->rd], di->imm, REG_NAMES[di->rs1]);
+
+	// Reads only with ZERO as the mask
+	RISCV_csr_access(cpu, di, di->rs1 != ZERO, 0, cpu->reg[di->rs1]);
+}
+
+void RISCV_instr_csrrc(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("instr: csrrc %s, 0x%03x, %s\n", REG_NAMES[di->rd], di->imm, REG_NAMES[di->rs1]);
+
+	RISCV_csr_access(cpu, di, di->rs1 != ZERO, cpu->reg[di->rs1], 0);
+}
+
+void RISCV_instr_csrrwi(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("instr: csrrwi %s, 0x%03x, %u\n", REG_NAMES[di->rd], di->imm, di->rs1);
+
+	RISCV_csr_access(cpu, di, true, UINT32_MAX, di->rs1);
+}
+
+// The rs1 field is the immediate
+void RISCV_instr_csrrsi(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	DEBUG_PRINT("instr: csrrsi %s, 0x%03x, %u\n", REG_NAMES[di->rd], di->imm, di->rs1);
+
+	RISCV_csr_access(cpu, di, di->rs1 != 0, 0, di->rs1);
 }
 
-void RISCV_instr_fence(RISCV_st *cpu, uint32_t instr)
+void RISCV_instr_csrrci(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	// TODO
-	do{}while(0);
+	DEBUG_PRINT("instr: csrrci %s, 0x%03x, %u\n", REG_NAMES[di->rd], di->imm, di->rs1);
+
+	RISCV_csr_access(cpu, di, di->rs1 != 0, di->rs1, 0);
 }
-void RISCV_instr_ecall(RISCV_st *cpu, uint32_t instr)
+
+void RISCV_instr_jal_halt(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	// TODO
-	do{}while(0);
+	DEBUG_PRINT("instr: jal %s, 0x%08x (halt)\n", REG_NAMES[di->rd], di->imm);
+
+	// Infinite loop, nothing will ever happen again
+	cpu->reg[di->rd] = cpu->pc; // store pc+4 (pc+2 when compressed)
+	cpu->pc -= di->len;
+	cpu->stop = RISCV_STOP_HALT;
 }
-void RISCV_instr_ebreak(RISCV_st *cpu, uint32_t instr)
+
+void RISCV_instr_illegal(RISCV_st *cpu, const RISCV_dinstr_st *di)
 {
-	// TODO
-	do{}while(0);
+	DEBUG_PRINT("instr: illegal 0x%08x\n", di->instr);
+
+	// Not executed, pc points to the illegal instr
+	RISCV_instr_exception(cpu, di);
+}
+
+// Fused pairs
+//	Same as running both handlers in a row, pc moves to the second one in between
+#define RISCV_FUSED_IMPL(NAME, name, FIRST, first, second) \
+void RISCV_instr_##name(RISCV_st *cpu, const RISCV_dinstr_st *di) \
+{ \
+	RISCV_instr_##first(cpu, di); \
+	cpu->pc += RISCV_dinstr_next(di)->len; \
+	RISCV_instr_##second(cpu, RISCV_dinstr_next(di)); \
 }
+RISCV_FUSED_LIST(RISCV_FUSED_IMPL)
@@ -0,0 +1,235 @@
+#include "PolyRISC-V_debug.h"
+#if RISCV_HAS_JIT
+#include "PolyRISC-V_jit.h"
+#endif
+
+// Pages whose stores may write to the watched bytes, starting with the one
+// before (see PAGE_WATCH)
+static uint32_t RISCV_watch_first(const RISCV_watch_st *watch)
+{
+	uint32_t page = watch->addr >> RISCV_PAGE_SHIFT;
+
+	return page? page - 1 : 0;
+}
+
+static uint32_t RISCV_watch_last(const RISCV_watch_st *watch)
+{
+	return (watch->addr + watch->size - 1) >> RISCV_PAGE_SHIFT;
+}
+
+// Flags of the pages from first to last cleared, then the ones of what is
+// left set again
+static void RISCV_debug_flag(RISCV_st *cpu, uint32_t first, uint32_t last, uint8_t flag)
+{
+	const RISCV_debug_st *debug = cpu->debug;
+
+	for(uint32_t page=first ; page<=last ; page++)
+		cpu->pages[page] &= ~flag;
+
+	for(size_t i=0 ; i<debug->break_count ; i++)
+		cpu->pages[debug->breaks[i] >> RISCV_PAGE_SHIFT] |= PAGE_BREAK;
+	for(size_t i=0 ; i<debug->watch_count ; i++){
+		for(uint32_t page=RISCV_watch_first(&debug->watches[i]) ; page<=RISCV_watch_last(&debug->watches[i]) ; page++)
+			cpu->pages[page] |= PAGE_WATCH;
+	}
+}
+
+// The instruction at addr gets decoded again, with its breakpoint or
+// without, and so do the pairs and blocks over it
+static void RISCV_debug_drop(RISCV_st *cpu, uint32_t addr)
+{
+	cpu->icache[addr >> 1].exec = NULL;
+	RISCV_icache_drop_fused(cpu, addr);
+#if RISCV_HAS_JIT
+	if(cpu->jit)
+		RISCV_jit_invalidate(cpu->jit, addr, 2);
+#endif
+}
+
+static bool RISCV_debug_alloc(RISCV_st *cpu)
+{
+	if(cpu->debug)
+		return true;
+
+	cpu->debug = calloc(1, sizeof(RISCV_debug_st));
+	if(!cpu->debug){
+		fprintf(stderr, "Error, could not allocate the debugger state.\n");
+		return false;
+	}
+	return true;
+}
+
+bool RISCV_debug_break(RISCV_st *cpu, pc_kt pc)
+{
+	RISCV_debug_st *debug = NULL;
+
+	assert(cpu);
+
+	if((pc >> 1) >= (cpu->mem_size >> 1) || (pc & 0x1)){
+		fprintf(stderr, "Error, no instruction at 0x%08x.\n", pc);
+		return false;
+	}
+	if(!RISCV_debug_alloc(cpu))
+		return false;
+
+	debug = cpu->debug;
+	for(size_t i=0 ; i<debug->break_count ; i++){
+		if(debug->breaks[i] == pc)
+			return true;
+	}
+	if(debug->break_count == DEBUG_BREAK_MAX){
+		fprintf(stderr, "Error, no more than %d breakpoints.\n", DEBUG_BREAK_MAX);
+		return false;
+	}
+
+	debug->breaks[debug->break_count++] = pc;
+	cpu->pages[pc >> RISCV_PAGE_SHIFT] |= PAGE_BREAK;
+	RISCV_debug_drop(cpu, pc);
+
+	return true;
+}
+
+bool RISCV_debug_watch(RISCV_st *cpu, uint32_t addr, uint32_t size)
+{
+	RISCV_debug_st *debug = NULL;
+	RISCV_watch_st *watch = NULL;
+
+	assert(cpu);
+
+	if(!size || (uint64_t)addr + size > cpu->mem_size){
+		fprintf(stderr, "Error, cannot watch 0x%x bytes at 0x%08x.\n", size, addr);
+		return false;
+	}
+	if(!RISCV_debug_alloc(cpu))
+		return false;
+
+	debug = cpu->debug;
+	if(debug->watch_count == DEBUG_WATCH_MAX){
+		fprintf(stderr, "Error, no more than %d watchpoints.\n", DEBUG_WATCH_MAX);
+		return false;
+	}
+
+	watch = &debug->watches[debug->watch_count++];
+	watch->addr = addr;
+	watch->size = size;
+	for(uint32_t page=RISCV_watch_first(watch) ; page<=RISCV_watch_last(watch) ; page++)
+		cpu->pages[page] |= PAGE_WATCH;
+
+	return true;
+}
+
+bool RISCV_debug_delete(RISCV_st *cpu, uint32_t addr)
+{
+	RISCV_debug_st *debug = NULL;
+
+	assert(cpu);
+
+	debug = cpu->debug;
+	if(!debug)
+		return false;
+
+	for(size_t i=0 ; i<debug->break_count ; i++){
+		if(debug->breaks[i] != addr)
+			continue;
+		debug->breaks[i] = debug->breaks[--debug->break_count];
+		RISCV_debug_flag(cpu, addr >> RISCV_PAGE_SHIFT, addr >> RISCV_PAGE_SHIFT, PAGE_BREAK);
+		RISCV_debug_drop(cpu, addr);
+		return true;
+	}
+
+	for(size_t i=0 ; i<debug->watch_count ; i++){
+		RISCV_watch_st watch = debug->watches[i];
+
+		if(watch.addr != addr)
+			continue;
+		debug->watches[i] = debug->watches[--debug->watch_count];
+		RISCV_debug_flag(cpu, RISCV_watch_first(&watch), RISCV_watch_last(&watch), PAGE_WATCH);
+		return true;
+	}
+
+	return false;
+}
+
+void RISCV_debug_stop(RISCV_st *cpu)
+{
+	assert(cpu);
+
+	if(!cpu->debug)
+		return;
+
+	while(cpu->debug->break_count)
+		RISCV_debug_delete(cpu, cpu->debug->breaks[0]);
+	while(cpu->debug->watch_count)
+		RISCV_debug_delete(cpu, cpu->debug->watches[0].addr);
+	free(cpu->debug);
+	cpu->debug = NULL;
+}
+
+void RISCV_debug_patch(RISCV_st *cpu, pc_kt pc)
+{
+	RISCV_debug_st *debug = cpu->debug;
+
+	// Run once as it is, see RISCV_debug_run()
+	if(!debug || (debug->stepping && pc == debug->hit))
+		return;
+
+	for(size_t i=0 ; i<debug->break_count ; i++){
+		if(debug->breaks[i] == pc){
+			cpu->icache[pc >> 1].op = RISCV_OP_DEBUG_BREAK;
+			cpu->icache[pc >> 1].exec = RISCV_instr_debug_break;
+			return;
+		}
+	}
+}
+
+bool RISCV_debug_store(RISCV_st *cpu, uint32_t addr, uint32_t size)
+{
+	RISCV_debug_st *debug = cpu->debug;
+
+	if(!debug)
+		return false;
+
+	for(size_t i=0 ; i<debug->watch_count ; i++){
+		const RISCV_watch_st *watch = &debug->watches[i];
+
+		if((uint64_t)addr < (uint64_t)watch->addr + watch->size && watch->addr < (uint64_t)addr + size){
+			debug->hit = addr;
+			debug->at_break = false;
+			// Stops set by the instruction itself come first
+			if(!cpu->stop)
+				cpu->stop = RISCV_STOP_DEBUG_WATCH;
+			return true;
+		}
+	}
+	return false;
+}
+
+RISCV_run_st RISCV_debug_run(RISCV_st *cpu, uint64_t max_instructions)
+{
+	RISCV_debug_st *debug = NULL;
+	RISCV_run_st run = {RISCV_STOP_BUDGET, 0}, rest = run;
+	bool over = false;
+
+	assert(cpu);
+
+	debug = cpu->debug;
+	if(debug){
+		over = debug->at_break && debug->hit_pc == cpu->pc;
+		debug->at_break = false;
+	}
+	if(!over || !max_instructions)
+		return RISCV_run(cpu, max_instructions);
+
+	// One instruction without its breakpoint, which comes back once it ran
+	debug->stepping = true;
+	RISCV_debug_drop(cpu, debug->hit);
+	run = RISCV_run(cpu, 1);
+	debug->stepping = false;
+	RISCV_debug_drop(cpu, debug->hit);
+	if(run.reason != RISCV_STOP_BUDGET || max_instructions == 1)
+		return run;
+
+	rest = RISCV_run(cpu, max_instructions - 1);
+	rest.retired += run.retired;
+	return rest;
+}
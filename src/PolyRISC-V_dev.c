@@ -0,0 +1,181 @@
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include "PolyRISC-V_dev.h"
+#include "PolyRISC-V_sys.h"
+#include "PolyRISC-V_priv.h"
+
+typedef struct{
+	uint8_t reg[8];		// as last written
+	uint8_t in[UART_IN_SIZE]; // received, not read yet
+	size_t in_used;
+	size_t in_next;
+}RISCV_uart_st;
+
+// Device and its state in one block
+static RISCV_device_st* RISCV_device_alloc(const char *name, uint32_t base, uint32_t size, size_t data_size)
+{
+	RISCV_device_st *dev = calloc(1, sizeof(RISCV_device_st) + data_size);
+
+	if(!dev)
+		return NULL;
+
+	dev->name = name;
+	dev->base = base;
+	dev->size = size;
+	dev->data = data_size? dev + 1 : NULL;
+
+	return dev;
+}
+
+// Something to read, without blocking
+static bool RISCV_uart_ready(RISCV_st *cpu, RISCV_uart_st *uart)
+{
+	struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+	ssize_t n = 0;
+
+	if(uart->in_next < uart->in_used)
+		return true;
+	// Prompts first, the guest may wait for an answer from now on
+	RISCV_sys_flush(cpu->sys);
+	if(poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLIN))
+		return false;
+
+	do{
+		n = read(STDIN_FILENO, uart->in, sizeof(uart->in));
+	}while(n < 0 && errno == EINTR);
+	uart->in_used = n > 0? n : 0;
+	uart->in_next = 0;
+
+	return uart->in_used;
+}
+
+static uint32_t RISCV_uart_read(RISCV_st *cpu, RISCV_device_st *dev, uint32_t offset, uint8_t size)
+{
+	RISCV_uart_st *uart = dev->data;
+
+	(void)size;
+
+	switch(offset){
+		case UART_RBR:
+			return RISCV_uart_ready(cpu, uart)? uart->in[uart->in_next++] : 0;
+		case UART_IIR:
+			return 0x01;
+		case UART_LSR:
+			return UART_LSR_THRE | UART_LSR_TEMT | (RISCV_uart_ready(cpu, uart)? UART_LSR_DR : 0);
+		case UART_MSR:
+			return 0;
+		default:
+			return offset < sizeof(uart->reg)? uart->reg[offset] : 0;
+	}
+}
+
+static void RISCV_uart_write(RISCV_st *cpu, RISCV_device_st *dev, uint32_t offset, uint8_t size, uint32_t value)
+{
+	RISCV_uart_st *uart = dev->data;
+	uint8_t byte = value;
+
+	(void)size;
+
+	switch(offset){
+		case UART_THR:{
+			if(!RISCV_sys_buffer(cpu->sys, STDOUT_FILENO, &byte, 1)){
+				RISCV_sys_flush(cpu->sys);
+				if(write(STDOUT_FILENO, &byte, 1) != 1)
+					fprintf(stderr, "Error, cannot write the UART output: %s\n", strerror(errno));
+			}
+		}break;
+
+		case UART_FCR:
+		case UART_LSR:
+		case UART_MSR:
+			break;
+
+		default:{
+			if(offset < sizeof(uart->reg))
+				uart->reg[offset] = byte;
+		}
+	}
+}
+
+bool RISCV_uart_map(RISCV_st *cpu, uint32_t base)
+{
+	RISCV_device_st *dev = RISCV_device_alloc("uart", base, UART_SIZE, sizeof(RISCV_uart_st));
+
+	assert(cpu);
+
+	if(!dev)
+		return false;
+	dev->read = RISCV_uart_read;
+	dev->write = RISCV_uart_write;
+
+	return RISCV_mmio_map(cpu, dev);
+}
+
+// Part of a 64 bits register at offset from reg, size bytes
+static uint32_t RISCV_clint_get(uint64_t value, uint32_t offset, uint8_t size)
+{
+	value >>= (offset & 7) * 8;
+	return size == 4? (uint32_t)value : value & ((1u << (size * 8)) - 1);
+}
+
+static uint64_t RISCV_clint_set(uint64_t value, uint32_t offset, uint8_t size, uint32_t part)
+{
+	uint32_t shift = (offset & 7) * 8;
+	uint64_t mask = (size == 4? 0xFFFFFFFFu : (1u << (size * 8)) - 1);
+
+	return (value & ~(mask << shift)) | (((uint64_t)part & mask) << shift);
+}
+
+// The size bytes at offset are inside the register of reg_size bytes at reg
+static bool RISCV_clint_in(uint32_t offset, uint8_t size, uint32_t reg, uint32_t reg_size)
+{
+	return offset >= reg && offset + size <= reg + reg_size;
+}
+
+// msip and mtimecmp are the ones of the hart, cpu->priv
+//	Accesses past the end of a register read 0 and are ignored, like the
+//	ones to no register. msip is bit 0, its other bits read 0 and are
+//	ignored.
+static uint32_t RISCV_clint_read(RISCV_st *cpu, RISCV_device_st *dev, uint32_t offset, uint8_t size)
+{
+	(void)dev;
+
+	if(RISCV_clint_in(offset, size, CLINT_MTIME, 8))
+		return RISCV_clint_get(RISCV_time(cpu), offset, size);
+	if(RISCV_clint_in(offset, size, CLINT_MTIMECMP, 8))
+		return RISCV_clint_get(cpu->priv.mtimecmp, offset, size);
+	if(RISCV_clint_in(offset, size, CLINT_MSIP, 4))
+		return RISCV_clint_get((cpu->priv.mip & MIP_MSIP) >> IRQ_MSI, offset, size);
+
+	return 0;
+}
+
+static void RISCV_clint_write(RISCV_st *cpu, RISCV_device_st *dev, uint32_t offset, uint8_t size, uint32_t value)
+{
+	(void)dev;
+
+	if(RISCV_clint_in(offset, size, CLINT_MTIMECMP, 8)){
+		cpu->priv.mtimecmp = RISCV_clint_set(cpu->priv.mtimecmp, offset, size, value);
+	}
+	else if(offset == CLINT_MSIP){
+		if(value & 1)
+			cpu->priv.mip |= MIP_MSIP;
+		else
+			cpu->priv.mip &= ~MIP_MSIP;
+	}
+}
+
+bool RISCV_clint_map(RISCV_st *cpu, uint32_t base)
+{
+	RISCV_device_st *dev = RISCV_device_alloc("clint", base, CLINT_SIZE, 0);
+
+	assert(cpu);
+
+	if(!dev)
+		return false;
+	dev->read = RISCV_clint_read;
+	dev->write = RISCV_clint_write;
+
+	return RISCV_mmio_map(cpu, dev);
+}
@@ -0,0 +1,143 @@
+#include "PolyRISC-V_dirty.h"
+#include "PolyRISC-V_sys.h"
+#include "PolyRISC-V_mmu.h"
+#if RISCV_HAS_JIT
+#include "PolyRISC-V_jit.h"
+#endif
+
+// Bytes of guest memory in page
+static size_t RISCV_dirty_page_size(const RISCV_st *cpu, uint32_t page)
+{
+	size_t start = (size_t)page << RISCV_PAGE_SHIFT;
+
+	if(start >= cpu->mem_size)
+		return 0;
+	return cpu->mem_size - start < RISCV_PAGE_SIZE? cpu->mem_size - start : RISCV_PAGE_SIZE;
+}
+
+// page is clean again, and so is the end of the one before
+static void RISCV_dirty_clean(RISCV_st *cpu, uint32_t page)
+{
+	cpu->pages[page] |= PAGE_CLEAN;
+	if(page + 1 < cpu->dirty->pages && (cpu->pages[page + 1] & PAGE_CLEAN))
+		cpu->pages[page] |= PAGE_CLEAN_NEXT;
+	if(page)
+		cpu->pages[page - 1] |= PAGE_CLEAN_NEXT;
+}
+
+bool RISCV_dirty_start(RISCV_st *cpu)
+{
+	RISCV_dirty_st *dirty = NULL;
+
+	assert(cpu);
+
+	RISCV_dirty_stop(cpu);
+
+	dirty = calloc(1, sizeof(RISCV_dirty_st));
+	if(!dirty)
+		return false;
+
+	dirty->pages = (cpu->mem_size + RISCV_PAGE_SIZE - 1) >> RISCV_PAGE_SHIFT;
+	dirty->base = RISCV_table_alloc(cpu->mem_size);
+	dirty->list = malloc(dirty->pages * sizeof(uint32_t));
+	if(!dirty->base || !dirty->list){
+		fprintf(stderr, "Error, could not allocate the dirty pages baseline.\n");
+		RISCV_table_free(dirty->base, cpu->mem_size);
+		free(dirty->list);
+		free(dirty);
+		return false;
+	}
+
+	// Zero pages stay untouched in the baseline
+	for(uint32_t page=0 ; page<dirty->pages ; page++){
+		const uint8_t *p = cpu->mem + ((size_t)page << RISCV_PAGE_SHIFT);
+		size_t size = RISCV_dirty_page_size(cpu, page);
+
+		if(!p[0] && !memcmp(p, p + 1, size - 1))
+			continue;
+		memcpy(dirty->base + ((size_t)page << RISCV_PAGE_SHIFT), p, size);
+	}
+	memcpy(dirty->reg, cpu->reg, sizeof(dirty->reg));
+	dirty->pc = cpu->pc;
+	dirty->brk = cpu->sys->brk;
+	dirty->priv = cpu->priv;
+
+	cpu->dirty = dirty;
+	for(uint32_t page=dirty->pages ; page-- ; )
+		RISCV_dirty_clean(cpu, page);
+
+	return true;
+}
+
+void RISCV_dirty_stop(RISCV_st *cpu)
+{
+	RISCV_dirty_st *dirty = NULL;
+
+	assert(cpu);
+
+	dirty = cpu->dirty;
+	if(!dirty)
+		return;
+
+	for(size_t page=0 ; page<dirty->pages ; page++)
+		cpu->pages[page] &= ~(PAGE_CLEAN | PAGE_CLEAN_NEXT);
+	RISCV_table_free(dirty->base, cpu->mem_size);
+	free(dirty->list);
+	free(dirty);
+	cpu->dirty = NULL;
+}
+
+size_t RISCV_dirty_list(const RISCV_st *cpu, const uint32_t **pages)
+{
+	assert(cpu);
+	assert(pages);
+
+	if(!cpu->dirty){
+		*pages = NULL;
+		return 0;
+	}
+
+	*pages = cpu->dirty->list;
+	return cpu->dirty->count;
+}
+
+void RISCV_restore_dirty(RISCV_st *cpu)
+{
+	RISCV_dirty_st *dirty = NULL;
+
+	assert(cpu);
+	assert(cpu->dirty);
+
+	dirty = cpu->dirty;
+	for(size_t i=0 ; i<dirty->count ; i++){
+		uint32_t page = dirty->list[i];
+		size_t start = (size_t)page << RISCV_PAGE_SHIFT;
+		size_t size = RISCV_dirty_page_size(cpu, page);
+
+		memcpy(cpu->mem + start, dirty->base + start, size);
+		RISCV_dirty_clean(cpu, page);
+
+		// Decoded instructions of the page, the 32 bits one which may start
+		// 2 bytes before and pairs fused across its start
+		if(cpu->pages[page] & PAGE_CODE){
+			size_t half = start >> 1;
+
+			memset(&cpu->icache[half], 0, ((size + 1) >> 1) * sizeof(RISCV_dinstr_st));
+			if(half)
+				cpu->icache[half - 1].exec = NULL;
+			RISCV_icache_drop_fused(cpu, start);
+#if RISCV_HAS_JIT
+			if(cpu->jit)
+				RISCV_jit_invalidate(cpu->jit, start, size);
+#endif
+		}
+	}
+	dirty->count = 0;
+
+	memcpy(cpu->reg, dirty->reg, sizeof(cpu->reg));
+	cpu->pc = dirty->pc;
+	RISCV_sys_restore(cpu->sys, dirty->brk);
+	cpu->priv = dirty->priv;
+	RISCV_mmu_flush(cpu);
+	cpu->stop = RISCV_STOP_NONE;
+}
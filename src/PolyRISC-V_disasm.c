@@ -0,0 +1,223 @@
+#include "PolyRISC-V.h"
+#include "PolyRISC-V_rvc.h"
+#include "PolyRISC-V_priv.h"
+
+static const char *disasm_mnemonic(const uint32_t instr)
+{
+	uint8_t funct3 = instr_decode_funct3(instr);
+	uint8_t funct7 = instr_decode_funct7(instr);
+
+	switch(instr_decode_opcode(instr)){
+		case OP_LUI:	return "lui";
+		case OP_AUIPC:	return "auipc";
+		case OP_JAL:	return "jal";
+		case OP_JALR:	return "jalr";
+		case OP_BRANCH:{
+			switch(funct3){
+				case F3_BRANCH_BEQ:		return "beq";
+				case F3_BRANCH_BNE:		return "bne";
+				case F3_BRANCH_BLT:		return "blt";
+				case F3_BRANCH_BGE:		return "bge";
+				case F3_BRANCH_BLTU:	return "bltu";
+				case F3_BRANCH_BGEU:	return "bgeu";
+			}
+		}break;
+		case OP_LOAD:{
+			switch(funct3){
+				case F3_LOAD_LB:	return "lb";
+				case F3_LOAD_LH:	return "lh";
+				case F3_LOAD_LW:	return "lw";
+				case F3_LOAD_LBU:	return "lbu";
+				case F3_LOAD_LHU:	return "lhu";
+			}
+		}break;
+		case OP_STORE:{
+			switch(funct3){
+				case F3_STORE_SB:	return "sb";
+				case F3_STORE_SH:	return "sh";
+				case F3_STORE_SW:	return "sw";
+			}
+		}break;
+		case OP_OP_IMM:{
+			switch(funct3){
+				case F3_OP_IMM_ADDI:	return "addi";
+				case F3_OP_IMM_SLTI:	return "slti";
+				case F3_OP_IMM_SLTIU:	return "sltiu";
+				case F3_OP_IMM_XORI:	return "xori";
+				case F3_OP_IMM_ORI:		return "ori";
+				case F3_OP_IMM_ANDI:	return "andi";
+				case F3_OP_IMM_SLLI:	return "slli";
+				case F3_OP_IMM_SRXI:{
+					if(funct7 == F7_OP_IMM_SRXI_SRLI)	return "srli";
+					if(funct7 == F7_OP_IMM_SRXI_SRAI)	return "srai";
+				}break;
+			}
+		}break;
+		case OP_OP:{
+			if(funct7 == F7_OP_MULDIV){
+				switch(funct3){
+					case F3_OP_MULDIV_MUL:		return "mul";
+					case F3_OP_MULDIV_MULH:		return "mulh";
+					case F3_OP_MULDIV_MULHSU:	return "mulhsu";
+					case F3_OP_MULDIV_MULHU:	return "mulhu";
+					case F3_OP_MULDIV_DIV:		return "div";
+					case F3_OP_MULDIV_DIVU:		return "divu";
+					case F3_OP_MULDIV_REM:		return "rem";
+					case F3_OP_MULDIV_REMU:		return "remu";
+				}
+			}
+			switch(funct3){
+				case F3_OP_AS:{
+					if(funct7 == F7_OP_AS_ADD)	return "add";
+					if(funct7 == F7_OP_AS_SUB)	return "sub";
+				}break;
+				case F3_OP_SLL:		return "sll";
+				case F3_OP_SLT:		return "slt";
+				case F3_OP_SLTU:	return "sltu";
+				case F3_OP_XOR:		return "xor";
+				case F3_OP_SRLA:{
+					if(funct7 == F7_OP_SRLA_SRL)	return "srl";
+					if(funct7 == F7_OP_SRLA_SRA)	return "sra";
+				}break;
+				case F3_OP_OR:		return "or";
+				case F3_OP_AND:		return "and";
+			}
+		}break;
+		case OP_MISC_MEM:{
+			if(funct3 == F3_MISC_MEM_FENCE)		return "fence";
+			if(funct3 == F3_MISC_MEM_FENCE_I)	return "fence.i";
+		}break;
+		case OP_SYSTEM:{
+			switch(funct3){
+				case F3_SYSTEM_PRIV:{
+					switch(instr_decode_funct12(instr)){
+						case F12_SYSTEM_PRIV_ECALL:		return "ecall";
+						case F12_SYSTEM_PRIV_EBREAK:	return "ebreak";
+						case F12_SYSTEM_PRIV_MRET:		return "mret";
+						case F12_SYSTEM_PRIV_SRET:		return "sret";
+						case F12_SYSTEM_PRIV_WFI:		return "wfi";
+					}
+					if(funct7 == F7_SYSTEM_PRIV_SFENCE_VMA)	return "sfence.vma";
+				}break;
+				case F3_SYSTEM_CSRRW:	return "csrrw";
+				case F3_SYSTEM_CSRRS:	return "csrrs";
+				case F3_SYSTEM_CSRRC:	return "csrrc";
+				case F3_SYSTEM_CSRRWI:	return "csrrwi";
+				case F3_SYSTEM_CSRRSI:	return "csrrsi";
+				case F3_SYSTEM_CSRRCI:	return "csrrci";
+			}
+		}break;
+	}
+
+	return NULL;
+}
+
+// Counters and trap CSRs by name, others as a number
+static int disasm_csr(uint16_t csr, char *buf, size_t size)
+{
+	switch(csr){
+		case CSR_CYCLE:		return snprintf(buf, size, "cycle");
+		case CSR_TIME:		return snprintf(buf, size, "time");
+		case CSR_INSTRET:	return snprintf(buf, size, "instret");
+		case CSR_CYCLEH:	return snprintf(buf, size, "cycleh");
+		case CSR_TIMEH:		return snprintf(buf, size, "timeh");
+		case CSR_INSTRETH:	return snprintf(buf, size, "instreth");
+		case CSR_SSTATUS:	return snprintf(buf, size, "sstatus");
+		case CSR_SIE:		return snprintf(buf, size, "sie");
+		case CSR_STVEC:		return snprintf(buf, size, "stvec");
+		case CSR_SSCRATCH:	return snprintf(buf, size, "sscratch");
+		case CSR_SEPC:		return snprintf(buf, size, "sepc");
+		case CSR_SCAUSE:	return snprintf(buf, size, "scause");
+		case CSR_STVAL:		return snprintf(buf, size, "stval");
+		case CSR_SIP:		return snprintf(buf, size, "sip");
+		case CSR_SATP:		return snprintf(buf, size, "satp");
+		case CSR_MSTATUS:	return snprintf(buf, size, "mstatus");
+		case CSR_MEDELEG:	return snprintf(buf, size, "medeleg");
+		case CSR_MIDELEG:	return snprintf(buf, size, "mideleg");
+		case CSR_MIE:		return snprintf(buf, size, "mie");
+		case CSR_MTVEC:		return snprintf(buf, size, "mtvec");
+		case CSR_MSCRATCH:	return snprintf(buf, size, "mscratch");
+		case CSR_MEPC:		return snprintf(buf, size, "mepc");
+		case CSR_MCAUSE:	return snprintf(buf, size, "mcause");
+		case CSR_MTVAL:		return snprintf(buf, size, "mtval");
+		case CSR_MIP:		return snprintf(buf, size, "mip");
+		case CSR_MHARTID:	return snprintf(buf, size, "mhartid");
+		default:			return snprintf(buf, size, "0x%03x", csr);
+	}
+}
+
+int RISCV_disasm(const uint32_t instr, const pc_kt pc, char *buf, size_t size)
+{
+	RISCV_dinstr_st di = {0};
+	const char *mnemonic = NULL;
+
+	assert(buf);
+
+	// Compressed ones as what they expand to, "c." in front
+	if(RISCV_INSTR_LEN(instr) == 2){
+		uint32_t expanded = RISCV_rvc_expand(instr & 0xFFFF);
+		int len = 0;
+
+		if(!expanded)
+			return snprintf(buf, size, ".half 0x%04x", instr & 0xFFFF);
+		len = snprintf(buf, size, "c.");
+		if((size_t)len >= size)
+			return len;
+		return len + RISCV_disasm(expanded, pc, buf + len, size - len);
+	}
+
+	mnemonic = disasm_mnemonic(instr);
+
+	if(!mnemonic)
+		return snprintf(buf, size, ".word 0x%08x", instr);
+
+	// Same fields as the ones the handlers get
+	RISCV_decode_instr(instr, &di);
+
+	switch(instr_decode_opcode(instr)){
+		case OP_LUI:
+		case OP_AUIPC:
+			return snprintf(buf, size, "%s %s, 0x%05x",
+					mnemonic, REG_NAMES[di.rd], (uint32_t)di.imm >> 12);
+		case OP_JAL:
+			return snprintf(buf, size, "%s %s, 0x%08x",
+					mnemonic, REG_NAMES[di.rd], pc + di.imm);
+		case OP_JALR:
+		case OP_LOAD:
+			return snprintf(buf, size, "%s %s, %d(%s)",
+					mnemonic, REG_NAMES[di.rd], di.imm, REG_NAMES[di.rs1]);
+		case OP_BRANCH:
+			return snprintf(buf, size, "%s %s, %s, 0x%08x",
+					mnemonic, REG_NAMES[di.rs1], REG_NAMES[di.rs2], pc + di.imm);
+		case OP_STORE:
+			return snprintf(buf, size, "%s %s, %d(%s)",
+					mnemonic, REG_NAMES[di.rs2], di.imm, REG_NAMES[di.rs1]);
+		case OP_OP_IMM:
+			return snprintf(buf, size, "%s %s, %s, %d",
+					mnemonic, REG_NAMES[di.rd], REG_NAMES[di.rs1], di.imm);
+		case OP_OP:
+			return snprintf(buf, size, "%s %s, %s, %s",
+					mnemonic, REG_NAMES[di.rd], REG_NAMES[di.rs1], REG_NAMES[di.rs2]);
+		case OP_SYSTEM:{
+			char csr[16];
+
+			if(instr_decode_funct3(instr) == F3_SYSTEM_PRIV){
+				if(instr_decode_funct7(instr) == F7_SYSTEM_PRIV_SFENCE_VMA)
+					return snprintf(buf, size, "%s %s, %s",
+							mnemonic, REG_NAMES[di.rs1], REG_NAMES[di.rs2]);
+				break;
+			}
+			disasm_csr(di.imm, csr, sizeof(csr));
+			// The rs1 field is the immediate of the i forms
+			if(instr_decode_funct3(instr) & 0x4)
+				return snprintf(buf, size, "%s %s, %s, %u",
+						mnemonic, REG_NAMES[di.rd], csr, di.rs1);
+			return snprintf(buf, size, "%s %s, %s, %s",
+					mnemonic, REG_NAMES[di.rd], csr, REG_NAMES[di.rs1]);
+		}
+		default:
+			break;
+	}
+
+	return snprintf(buf, size, "%s", mnemonic);
+}
@@ -0,0 +1,345 @@
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "PolyRISC-V_elf.h"
+
+// Reads exactly size bytes at off, false on error or short file
+static bool read_at(int fd, void *buf, size_t size, off_t off)
+{
+	uint8_t *p = buf;
+
+	while(size){
+		ssize_t n = pread(fd, p, size, off);
+		if(n <= 0)
+			return false;
+		p += n;
+		size -= n;
+		off += n;
+	}
+
+	return true;
+}
+
+// Opens path and checks it is a little endian RISC-V ELF32
+//	Returns the file descriptor, -1 on error
+static int RISCV_elf_open(const char *path, Elf32_Ehdr *ehdr, off_t *file_size)
+{
+	struct stat st = {0};
+	int fd = -1;
+
+	fd = open(path, O_RDONLY);
+	if(fd < 0){
+		fprintf(stderr, "Cannot open the ELF file. Path: %s\n", path);
+		return -1;
+	}
+
+	if(fstat(fd, &st) || !read_at(fd, ehdr, sizeof(*ehdr), 0) ||
+			memcmp(ehdr->e_ident, ELFMAG, SELFMAG)){
+		fprintf(stderr, "Error, not an ELF file. Path: %s\n", path);
+		goto error;
+	}
+	if(ehdr->e_ident[EI_CLASS] != ELFCLASS32 || ehdr->e_ident[EI_DATA] != ELFDATA2LSB ||
+			ehdr->e_machine != EM_RISCV){
+		fprintf(stderr, "Error, not a RV32 little endian ELF. Path: %s\n", path);
+		goto error;
+	}
+
+	*file_size = st.st_size;
+	return fd;
+
+error:
+	close(fd);
+	return -1;
+}
+
+static int RISCV_sym_cmp(const void *a, const void *b)
+{
+	const RISCV_sym_st *sa = a, *sb = b;
+
+	// Sized symbols last among the ones at the same address, lookups pick them
+	if(sa->addr != sb->addr)
+		return sa->addr < sb->addr? -1 : 1;
+	if(sa->size != sb->size)
+		return sa->size < sb->size? -1 : 1;
+	return 0;
+}
+
+// NULL when there is no symbol table or on error
+static RISCV_symtab_st* RISCV_symtab_read(int fd, const Elf32_Ehdr *ehdr, off_t file_size)
+{
+	RISCV_symtab_st *symtab = NULL;
+	Elf32_Shdr *shdrs = NULL;
+	Elf32_Sym *syms = NULL;
+	const Elf32_Shdr *sh = NULL, *strsh = NULL;
+	size_t nsyms = 0;
+
+	if(!ehdr->e_shnum || ehdr->e_shentsize != sizeof(Elf32_Shdr))
+		return NULL;
+
+	shdrs = malloc(ehdr->e_shnum * sizeof(Elf32_Shdr));
+	if(!shdrs || !read_at(fd, shdrs, ehdr->e_shnum * sizeof(Elf32_Shdr), ehdr->e_shoff))
+		goto error;
+
+	for(size_t i=0 ; i<ehdr->e_shnum ; i++){
+		if(shdrs[i].sh_type == SHT_SYMTAB){
+			sh = &shdrs[i];
+			break;
+		}
+	}
+	if(!sh || sh->sh_link >= ehdr->e_shnum || sh->sh_entsize != sizeof(Elf32_Sym))
+		goto error;
+	strsh = &shdrs[sh->sh_link];
+	if((off_t)sh->sh_offset + sh->sh_size > file_size ||
+			(off_t)strsh->sh_offset + strsh->sh_size > file_size)
+		goto error;
+
+	symtab = calloc(1, sizeof(RISCV_symtab_st));
+	nsyms = sh->sh_size / sizeof(Elf32_Sym);
+	syms = malloc(nsyms * sizeof(Elf32_Sym));
+	if(!symtab || !syms)
+		goto error;
+	symtab->syms = malloc(nsyms * sizeof(RISCV_sym_st));
+	// NUL terminated even if the file's one isn't
+	symtab->names = calloc(strsh->sh_size + 1, 1);
+	if(!symtab->syms || !symtab->names)
+		goto error;
+	if(!read_at(fd, syms, nsyms * sizeof(Elf32_Sym), sh->sh_offset) ||
+			!read_at(fd, symtab->names, strsh->sh_size, strsh->sh_offset))
+		goto error;
+
+	for(size_t i=0 ; i<nsyms ; i++){
+		const Elf32_Sym *s = &syms[i];
+		uint8_t type = ELF32_ST_TYPE(s->st_info);
+		const char *name = NULL;
+
+		if(s->st_shndx == SHN_UNDEF || s->st_shndx >= SHN_LORESERVE || s->st_name >= strsh->sh_size)
+			continue;
+		if(type != STT_NOTYPE && type != STT_FUNC && type != STT_OBJECT)
+			continue;
+		// Mapping symbols ($x, $d) mark code and data, they aren't names
+		name = symtab->names + s->st_name;
+		if(!name[0] || name[0] == '$')
+			continue;
+
+		symtab->syms[symtab->count].addr = s->st_value;
+		symtab->syms[symtab->count].size = s->st_size;
+		symtab->syms[symtab->count].name = name;
+		symtab->count++;
+	}
+	qsort(symtab->syms, symtab->count, sizeof(RISCV_sym_st), RISCV_sym_cmp);
+
+	free(syms);
+	free(shdrs);
+	return symtab;
+
+error:
+	RISCV_symtab_free(symtab);
+	free(syms);
+	free(shdrs);
+	return NULL;
+}
+
+// Copies [from, to) of the segment from the file
+static bool RISCV_elf_copy(RISCV_st *cpu, int fd, const Elf32_Phdr *ph, uint32_t from, uint32_t to)
+{
+	if(from >= to)
+		return true;
+
+	return read_at(fd, cpu->mem + from, to - from, ph->p_offset + (from - ph->p_vaddr));
+}
+
+// Zeroes [from, to), whole pages are replaced by fresh anonymous ones
+static void RISCV_elf_zero(RISCV_st *cpu, uint32_t from, uint32_t to, uint32_t page)
+{
+	uint32_t pfrom = (from + page - 1) & ~(page - 1);
+	uint32_t pto = to & ~(page - 1);
+
+	if(from >= to)
+		return;
+
+	if(pfrom < pto && mmap(cpu->mem + pfrom, pto - pfrom, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED){
+		memset(cpu->mem + from, 0, pfrom - from);
+		memset(cpu->mem + pto, 0, to - pto);
+		return;
+	}
+
+	memset(cpu->mem + from, 0, to - from);
+}
+
+static bool RISCV_elf_load_segment(RISCV_st *cpu, int fd, const Elf32_Phdr *ph, uint32_t page)
+{
+	uint32_t start = ph->p_vaddr;
+	uint32_t file_end = ph->p_vaddr + ph->p_filesz;
+	uint32_t end = ph->p_vaddr + ph->p_memsz;
+	// Whole pages of file data
+	uint32_t pstart = (start + page - 1) & ~(page - 1);
+	uint32_t pend = file_end & ~(page - 1);
+
+	// Mappable only if the file offset has the same alignment in the page.
+	// Private mapping: guest stores copy the page, the file is never written.
+	if(pstart < pend && (ph->p_offset & (page - 1)) == (start & (page - 1)) &&
+			mmap(cpu->mem + pstart, pend - pstart, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_FIXED, fd, ph->p_offset + (pstart - start)) != MAP_FAILED){
+		// Edges may share their page with another segment, copy them
+		if(!RISCV_elf_copy(cpu, fd, ph, start, pstart) || !RISCV_elf_copy(cpu, fd, ph, pend, file_end))
+			return false;
+	}
+	else if(!RISCV_elf_copy(cpu, fd, ph, start, file_end)){
+		return false;
+	}
+
+	RISCV_elf_zero(cpu, file_end, end, page);
+	return true;
+}
+
+bool RISCV_load_elf(RISCV_st *cpu, const char *path)
+{
+	Elf32_Ehdr ehdr = {0};
+	Elf32_Phdr *phdrs = NULL;
+	off_t file_size = 0;
+	uint32_t page = sysconf(_SC_PAGESIZE);
+	uint32_t top = 0;
+	bool ok = false;
+	int fd = -1;
+
+	assert(cpu);
+	assert(path);
+
+	fd = RISCV_elf_open(path, &ehdr, &file_size);
+	if(fd < 0)
+		return false;
+
+	if(ehdr.e_type != ET_EXEC || ehdr.e_phentsize != sizeof(Elf32_Phdr)){
+		fprintf(stderr, "Error, not an executable ELF (link it). Path: %s\n", path);
+		goto deinit;
+	}
+	if(ehdr.e_entry >= cpu->mem_size){
+		fprintf(stderr, "Error, entry point 0x%08x out of guest memory.\n", ehdr.e_entry);
+		goto deinit;
+	}
+
+	phdrs = malloc(ehdr.e_phnum * sizeof(Elf32_Phdr));
+	if(!phdrs || !read_at(fd, phdrs, ehdr.e_phnum * sizeof(Elf32_Phdr), ehdr.e_phoff)){
+		fprintf(stderr, "Error, cannot read the program headers. Path: %s\n", path);
+		goto deinit;
+	}
+
+	// Everything is checked before guest memory gets touched
+	for(size_t i=0 ; i<ehdr.e_phnum ; i++){
+		const Elf32_Phdr *ph = &phdrs[i];
+
+		if(ph->p_type != PT_LOAD)
+			continue;
+		if(ph->p_filesz > ph->p_memsz || (uint64_t)ph->p_vaddr + ph->p_memsz > cpu->mem_size ||
+				(off_t)ph->p_offset + ph->p_filesz > file_size){
+			fprintf(stderr, "Error, segment at 0x%08x (0x%x bytes) doesn't fit in guest memory (0x%zx bytes).\n",
+					ph->p_vaddr, ph->p_memsz, cpu->mem_size);
+			goto deinit;
+		}
+		if(ph->p_vaddr + ph->p_memsz > top)
+			top = ph->p_vaddr + ph->p_memsz;
+	}
+
+	for(size_t i=0 ; i<ehdr.e_phnum ; i++){
+		if(phdrs[i].p_type == PT_LOAD && !RISCV_elf_load_segment(cpu, fd, &phdrs[i], page)){
+			fprintf(stderr, "Error, cannot load the segment at 0x%08x. Path: %s\n", phdrs[i].p_vaddr, path);
+			goto deinit;
+		}
+	}
+
+	// Set stack lower boundary
+	cpu->stack_bot = top;
+	cpu->entry = ehdr.e_entry;
+
+	RISCV_symtab_free(cpu->symtab);
+	cpu->symtab = RISCV_symtab_read(fd, &ehdr, file_size);
+
+	ok = true;
+
+deinit:
+	// Previously decoded instructions are stale now (memory may be half loaded)
+	RISCV_icache_flush(cpu);
+	free(phdrs);
+	// Mappings keep their own reference to the file
+	close(fd);
+
+	return ok;
+}
+
+bool RISCV_is_elf(const char *path)
+{
+	char magic[SELFMAG] = {0};
+	FILE *f = NULL;
+	bool elf = false;
+
+	assert(path);
+
+	f = fopen(path, "rb");
+	if(!f)
+		return false;
+	elf = fread(magic, SELFMAG, 1, f) == 1 && !memcmp(magic, ELFMAG, SELFMAG);
+	fclose(f);
+
+	return elf;
+}
+
+RISCV_symtab_st* RISCV_symtab_load(const char *path)
+{
+	RISCV_symtab_st *symtab = NULL;
+	Elf32_Ehdr ehdr = {0};
+	off_t file_size = 0;
+	int fd = -1;
+
+	assert(path);
+
+	fd = RISCV_elf_open(path, &ehdr, &file_size);
+	if(fd < 0)
+		return NULL;
+
+	symtab = RISCV_symtab_read(fd, &ehdr, file_size);
+	if(!symtab)
+		fprintf(stderr, "Error, no symbol table. Path: %s\n", path);
+	close(fd);
+
+	return symtab;
+}
+
+void RISCV_symtab_free(RISCV_symtab_st *symtab)
+{
+	if(!symtab)
+		return;
+	free(symtab->syms);
+	free(symtab->names);
+	free(symtab);
+}
+
+const RISCV_sym_st* RISCV_symtab_lookup(const RISCV_symtab_st *symtab, uint32_t addr)
+{
+	const RISCV_sym_st *sym = NULL;
+	size_t lo = 0, hi = 0;
+
+	if(!symtab)
+		return NULL;
+
+	// Last symbol at or below addr
+	hi = symtab->count;
+	while(lo < hi){
+		size_t mid = lo + (hi - lo) / 2;
+		if(symtab->syms[mid].addr <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if(!lo)
+		return NULL;
+
+	// Labels have no size, they cover everything up to the next symbol
+	sym = &symtab->syms[lo - 1];
+	if(sym->size && addr - sym->addr >= sym->size)
+		return NULL;
+
+	return sym;
+}
@@ -0,0 +1,162 @@
+// REG_RIP and friends of ucontext_t
+#define _GNU_SOURCE
+#include "PolyRISC-V.h"
+
+#if RISCV_HAS_GUARD
+#include <pthread.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "PolyRISC-V_guard.h"
+#include "PolyRISC-V_jit.h"
+
+// cpu running on this thread, its faults are guest ones
+static _Thread_local RISCV_st *guard_cpu = NULL;
+static struct sigaction guard_old_action;
+static pthread_once_t guard_once = PTHREAD_ONCE_INIT;
+static size_t guard_page = 0;
+
+// Not a guest access, hand it over to whoever handled SIGSEGV before
+static void RISCV_guard_chain(int sig, siginfo_t *info, void *uctx)
+{
+	if(guard_old_action.sa_flags & SA_SIGINFO){
+		guard_old_action.sa_sigaction(sig, info, uctx);
+		return;
+	}
+	if(guard_old_action.sa_handler != SIG_DFL && guard_old_action.sa_handler != SIG_IGN){
+		guard_old_action.sa_handler(sig);
+		return;
+	}
+
+	// The faulting instruction runs again and kills the process
+	signal(sig, SIG_DFL);
+}
+
+// Interpreted instruction which faulted, pc is already past it
+//	Loads and stores are 2 or 4 bytes long, the cache tells which one ran.
+//	A 32 bits one whose upper half was also run as a compressed one is
+//	taken as the compressed one.
+static pc_kt RISCV_guard_pc(const RISCV_st *cpu)
+{
+	pc_kt pc = cpu->pc - 2;
+
+	if((pc >> 1) < cpu->icache_size && cpu->icache[pc >> 1].exec && cpu->icache[pc >> 1].len == 2)
+		return pc;
+	return cpu->pc - 4;
+}
+
+static void RISCV_guard_handler(int sig, siginfo_t *info, void *uctx)
+{
+	RISCV_st *cpu = guard_cpu;
+	uint8_t *addr = info->si_addr;
+	RISCV_fault_st *fault = NULL;
+	uint8_t *page = NULL;
+
+	if(!cpu || addr < cpu->mem || addr >= cpu->mem + cpu->mem_reserved){
+		RISCV_guard_chain(sig, info, uctx);
+		return;
+	}
+	fault = cpu->fault;
+
+	// Second page of the same access otherwise
+	if(!fault->pending){
+		fault->pending = true;
+		fault->addr = addr - cpu->mem;
+		fault->pc = RISCV_guard_pc(cpu);
+		memcpy(fault->reg, cpu->reg, sizeof(cpu->reg));
+		cpu->stop = RISCV_STOP_TRAP;
+	}
+
+#if RISCV_HAS_JIT
+	if(cpu->jit){
+		greg_t *gregs = ((ucontext_t*)uctx)->uc_mcontext.gregs;
+		uint64_t unretired = 0;
+
+		// Straight back to the dispatch loop, as if the block exited to pc
+		if(RISCV_jit_fault(cpu->jit, gregs[REG_RIP], &fault->pc, &unretired)){
+			gregs[REG_RAX] = fault->pc;
+			gregs[REG_RDX] = gregs[REG_R9] + unretired;
+			gregs[REG_RIP] = (greg_t)(uintptr_t)RISCV_jit_fault_exit(cpu->jit);
+			return;
+		}
+	}
+#endif
+
+	// Interpreted, the instruction completes on a zero page then the run
+	// loop sees the trap
+	page = (uint8_t*)((uintptr_t)addr & ~(guard_page - 1));
+	if(fault->npages >= 2 || mprotect(page, guard_page, PROT_READ | PROT_WRITE)){
+		RISCV_guard_chain(sig, info, uctx);
+		return;
+	}
+	fault->pages[fault->npages++] = page;
+}
+
+static void RISCV_guard_install(void)
+{
+	struct sigaction action = {0};
+
+	guard_page = sysconf(_SC_PAGESIZE);
+
+	action.sa_sigaction = RISCV_guard_handler;
+	action.sa_flags = SA_SIGINFO;
+	sigemptyset(&action.sa_mask);
+	if(sigaction(SIGSEGV, &action, &guard_old_action))
+		fprintf(stderr, "Error, cannot handle SIGSEGV, guest access faults will crash.\n");
+}
+
+uint8_t* RISCV_guard_alloc(size_t mem_size, size_t *reserved)
+{
+	uint8_t *mem = NULL;
+
+	assert(reserved);
+
+	pthread_once(&guard_once, RISCV_guard_install);
+
+	// 4 GiB of address space, no memory behind it until made accessible
+	*reserved = GUARD_RESERVE + guard_page;
+	mem = mmap(NULL, *reserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(mem == MAP_FAILED)
+		return NULL;
+
+	if(mprotect(mem, mem_size, PROT_READ | PROT_WRITE)){
+		munmap(mem, *reserved);
+		return NULL;
+	}
+
+	return mem;
+}
+
+void RISCV_guard_begin(RISCV_st *cpu)
+{
+	assert(cpu);
+
+	cpu->fault->access = false;
+	guard_cpu = cpu;
+}
+
+void RISCV_guard_end(RISCV_st *cpu)
+{
+	RISCV_fault_st *fault = NULL;
+
+	assert(cpu);
+
+	guard_cpu = NULL;
+	fault = cpu->fault;
+	if(!fault->pending)
+		return;
+
+	// Whatever the instruction did is undone
+	memcpy(cpu->reg, fault->reg, sizeof(cpu->reg));
+	cpu->pc = fault->pc;
+	cpu->stop = RISCV_STOP_TRAP;
+	for(size_t i=0 ; i<fault->npages ; i++){
+		madvise(fault->pages[i], guard_page, MADV_DONTNEED);
+		mprotect(fault->pages[i], guard_page, PROT_NONE);
+	}
+	fault->npages = 0;
+	fault->pending = false;
+	fault->access = true;
+}
+
+#endif
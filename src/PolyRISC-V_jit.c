@@ -0,0 +1,1243 @@
+#include "PolyRISC-V.h"
+
+#if RISCV_HAS_JIT
+#include <stddef.h>
+#include <sys/mman.h>
+#include "PolyRISC-V_jit.h"
+#include "PolyRISC-V_prof.h"
+
+// Native register use inside a block
+//	rdi: cpu (guest registers are at the start of it)
+//	rsi: cpu->mem
+//	rdx: cpu->pages
+//	r9: budget left, blocks take their length off it when entered
+//	eax, ecx, r8, r10, r11: scratch
+// Guest registers live in cpu->reg, every instruction loads its sources and
+// stores its result, so the interpreter can take over between any two blocks.
+// Exits return RISCV_jit_ret_st in rax:rdx.
+#define X86_EAX		0
+#define X86_ECX		1
+
+// Exits to a static target start with a jmp rel32, to the next instruction
+// until it is linked to the block of the target
+#define JIT_EXIT_LINK_SIZE	19
+#define JIT_RAS_PUSH_SIZE	51
+
+// ALU ops, "op r/m32, r32" is base + 1 and "op eax, imm32" is base + 5
+#define X86_ALU_ADD	0x00
+#define X86_ALU_OR	0x08
+#define X86_ALU_AND	0x20
+#define X86_ALU_SUB	0x28
+#define X86_ALU_XOR	0x30
+#define X86_ALU_CMP	0x38
+
+// Shifts, ModRM reg field of the D3 (by cl) and C1 (by imm8) opcodes
+#define X86_SHL		4
+#define X86_SHR		5
+#define X86_SAR		7
+
+// Condition codes, the opposite condition is cc ^ 1
+#define X86_CC_B	0x2
+#define X86_CC_AE	0x3
+#define X86_CC_E	0x4
+#define X86_CC_NE	0x5
+#define X86_CC_L	0xC
+#define X86_CC_GE	0xD
+
+// Guest registers are reached with a disp8
+#define REG_DISP(r)	((uint8_t)(offsetof(RISCV_st, reg) + (r) * sizeof(reg_kt)))
+_Static_assert(offsetof(RISCV_st, reg) + 31 * sizeof(reg_kt) < 0x80, "guest registers out of disp8 range");
+
+static uint8_t* emit8(uint8_t *p, uint8_t b)
+{
+	*p = b;
+	return p + 1;
+}
+
+static uint8_t* emit32(uint8_t *p, uint32_t v)
+{
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+static uint8_t* emit64(uint8_t *p, uint64_t v)
+{
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+// Guest register with a value known while translating, see RISCV_jit_consts_st
+static bool is_known(const RISCV_jit_st *jit, uint8_t r)
+{
+	return jit->consts.known & (1u << r);
+}
+
+// mov r32, guest reg
+static uint8_t* emit_load_reg(const RISCV_jit_st *jit, uint8_t *p, uint8_t x86, uint8_t r)
+{
+	if(r == ZERO){
+		// xor r32, r32
+		p = emit8(p, 0x31);
+		return emit8(p, 0xC0 | x86 << 3 | x86);
+	}
+	if(is_known(jit, r)){
+		// mov r32, imm32
+		p = emit8(p, 0xB8 | x86);
+		return emit32(p, jit->consts.value[r]);
+	}
+
+	p = emit8(p, 0x8B);
+	p = emit8(p, 0x47 | x86 << 3); // [rdi + disp8]
+	return emit8(p, REG_DISP(r));
+}
+
+// mov guest reg, r32
+static uint8_t* emit_store_reg(uint8_t *p, uint8_t x86, uint8_t r)
+{
+	// ZERO is never written
+	if(r == ZERO)
+		return p;
+
+	p = emit8(p, 0x89);
+	p = emit8(p, 0x47 | x86 << 3);
+	return emit8(p, REG_DISP(r));
+}
+
+// mov guest reg, imm32
+static uint8_t* emit_store_imm(uint8_t *p, uint8_t r, uint32_t imm)
+{
+	if(r == ZERO)
+		return p;
+
+	p = emit8(p, 0xC7);
+	p = emit8(p, 0x47);
+	p = emit8(p, REG_DISP(r));
+	return emit32(p, imm);
+}
+
+// op eax, ecx
+static uint8_t* emit_alu(uint8_t *p, uint8_t alu)
+{
+	p = emit8(p, alu + 1);
+	return emit8(p, 0xC8);
+}
+
+// op eax, imm32
+static uint8_t* emit_alu_imm(uint8_t *p, uint8_t alu, uint32_t imm)
+{
+	p = emit8(p, alu + 5);
+	return emit32(p, imm);
+}
+
+// cmp eax, guest reg
+static uint8_t* emit_cmp_reg(const RISCV_jit_st *jit, uint8_t *p, uint8_t r)
+{
+	if(is_known(jit, r))
+		return emit_alu_imm(p, X86_ALU_CMP, jit->consts.value[r]);
+
+	p = emit8(p, 0x3B);
+	p = emit8(p, 0x47);
+	return emit8(p, REG_DISP(r));
+}
+
+// Guest load/store address in eax
+static uint8_t* emit_addr(const RISCV_jit_st *jit, uint8_t *p, const RISCV_dinstr_st *di)
+{
+	if(is_known(jit, di->rs1)){
+		// mov eax, imm32
+		p = emit8(p, 0xB8);
+		return emit32(p, jit->consts.value[di->rs1] + di->imm);
+	}
+
+	p = emit_load_reg(jit, p, X86_EAX, di->rs1);
+	if(di->imm)
+		p = emit_alu_imm(p, X86_ALU_ADD, di->imm);
+
+	return p;
+}
+
+// Short forward jump over what follows, see emit_jcc_end()
+static uint8_t* emit_jcc(uint8_t *p, uint8_t cc)
+{
+	p = emit8(p, 0x70 | cc);
+	return emit8(p, 0);
+}
+
+static void emit_jcc_end(uint8_t *jcc, const uint8_t *to)
+{
+	assert(to - (jcc + 2) < 0x80);
+	jcc[1] = to - (jcc + 2);
+}
+
+// Short forward jump, always taken, also ended by emit_jcc_end()
+static uint8_t* emit_jmp(uint8_t *p)
+{
+	p = emit8(p, 0xEB);
+	return emit8(p, 0);
+}
+
+// mov rdx, r9; ret
+static uint8_t* emit_ret(uint8_t *p)
+{
+	p = emit8(p, 0x4C);
+	p = emit8(p, 0x89);
+	p = emit8(p, 0xCA);
+	return emit8(p, 0xC3);
+}
+
+// Back to the dispatch loop, at pc
+static uint8_t* emit_exit(uint8_t *p, pc_kt pc)
+{
+	// mov eax, pc
+	p = emit8(p, 0xB8);
+	p = emit32(p, pc);
+	return emit_ret(p);
+}
+
+// To the block at pc, through the dispatch loop until linked
+static uint8_t* emit_exit_link(RISCV_jit_st *jit, uint8_t *p, pc_kt pc)
+{
+	uint64_t exit = p - jit->code;
+
+	// jmp rel32
+	p = emit8(p, 0xE9);
+	p = emit32(p, 0);
+	// mov rax, exit:pc
+	p = emit8(p, 0x48);
+	p = emit8(p, 0xB8);
+	p = emit64(p, exit << 32 | pc);
+	return emit_ret(p);
+}
+
+// mov r10, &jit->ras; mov r11, [r10] (top)
+static uint8_t* emit_ras_top(RISCV_jit_st *jit, uint8_t *p)
+{
+	p = emit8(p, 0x49);
+	p = emit8(p, 0xBA);
+	p = emit64(p, (uint64_t)(uintptr_t)&jit->ras);
+	p = emit8(p, 0x4D);
+	p = emit8(p, 0x8B);
+	return emit8(p, 0x1A);
+}
+
+// top = (top + delta) % size; mov [r10], r11
+static uint8_t* emit_ras_move(uint8_t *p, bool push)
+{
+	// add/sub r11, sizeof(entry)
+	p = emit8(p, 0x49);
+	p = emit8(p, 0x83);
+	p = emit8(p, push? 0xC3 : 0xEB);
+	p = emit8(p, sizeof(RISCV_jit_ras_entry_st));
+	// and r11, mask
+	p = emit8(p, 0x49);
+	p = emit8(p, 0x81);
+	p = emit8(p, 0xE3);
+	p = emit32(p, JIT_RAS_SIZE * sizeof(RISCV_jit_ras_entry_st) - 1);
+	p = emit8(p, 0x4D);
+	p = emit8(p, 0x89);
+	return emit8(p, 0x1A);
+}
+
+// Call, ret_pc comes with the exit of the calling block emitted right after
+// the call exit, see emit_call()
+static uint8_t* emit_ras_push(RISCV_jit_st *jit, uint8_t *p, pc_kt ret_pc, const uint8_t *native)
+{
+	const uint8_t *start = p;
+
+	p = emit_ras_top(jit, p);
+	p = emit_ras_move(p, true);
+	// mov dword [r10 + r11 + entry.pc], ret_pc
+	p = emit8(p, 0x43);
+	p = emit8(p, 0xC7);
+	p = emit8(p, 0x44);
+	p = emit8(p, 0x1A);
+	p = emit8(p, offsetof(RISCV_jit_ras_st, entry) + offsetof(RISCV_jit_ras_entry_st, pc));
+	p = emit32(p, ret_pc);
+	// mov rax, native; mov [r10 + r11 + entry.native], rax
+	p = emit8(p, 0x48);
+	p = emit8(p, 0xB8);
+	p = emit64(p, (uint64_t)(uintptr_t)native);
+	p = emit8(p, 0x4B);
+	p = emit8(p, 0x89);
+	p = emit8(p, 0x44);
+	p = emit8(p, 0x1A);
+	p = emit8(p, offsetof(RISCV_jit_ras_st, entry) + offsetof(RISCV_jit_ras_entry_st, native));
+
+	assert(p - start == JIT_RAS_PUSH_SIZE);
+	return p;
+}
+
+// Return to the pc in eax, straight to the calling block if predicted
+static uint8_t* emit_ras_pop(RISCV_jit_st *jit, uint8_t *p)
+{
+	uint8_t *miss = NULL;
+
+	p = emit_ras_top(jit, p);
+	// cmp eax, [r10 + r11 + entry.pc]
+	p = emit8(p, 0x43);
+	p = emit8(p, 0x3B);
+	p = emit8(p, 0x44);
+	p = emit8(p, 0x1A);
+	p = emit8(p, offsetof(RISCV_jit_ras_st, entry) + offsetof(RISCV_jit_ras_entry_st, pc));
+	miss = p;
+	p = emit_jcc(p, X86_CC_NE);
+	// mov rcx, [r10 + r11 + entry.native]
+	p = emit8(p, 0x4B);
+	p = emit8(p, 0x8B);
+	p = emit8(p, 0x4C);
+	p = emit8(p, 0x1A);
+	p = emit8(p, offsetof(RISCV_jit_ras_st, entry) + offsetof(RISCV_jit_ras_entry_st, native));
+	p = emit_ras_move(p, false);
+	// jmp rcx
+	p = emit8(p, 0xFF);
+	p = emit8(p, 0xE1);
+	// Mispredicted, back to the dispatch loop (upper rax is 0)
+	emit_jcc_end(miss, p);
+	return emit_ret(p);
+}
+
+// jal/jalr linking ra pushes the return address
+static bool is_call(const RISCV_dinstr_st *di)
+{
+	return di->rd == RA;
+}
+
+static bool is_return(const RISCV_dinstr_st *di)
+{
+	return di->op == RISCV_OP_JALR && di->rd == ZERO && di->rs1 == RA;
+}
+
+static uint8_t* emit_jal(RISCV_jit_st *jit, uint8_t *p, const RISCV_dinstr_st *di, pc_kt pc)
+{
+	p = emit_store_imm(p, di->rd, pc + di->len);
+	if(is_call(di)){
+		// The return exit follows the call one
+		p = emit_ras_push(jit, p, pc + di->len, p + JIT_RAS_PUSH_SIZE + JIT_EXIT_LINK_SIZE);
+		p = emit_exit_link(jit, p, pc + di->imm);
+		return emit_exit_link(jit, p, pc + di->len);
+	}
+
+	return emit_exit_link(jit, p, pc + di->imm);
+}
+
+static uint8_t* emit_jalr(RISCV_jit_st *jit, uint8_t *p, const RISCV_dinstr_st *di, pc_kt pc)
+{
+	// Static target (auipc then jalr), linked like a jal
+	if(is_known(jit, di->rs1) && !is_return(di)){
+		pc_kt target = (jit->consts.value[di->rs1] + di->imm) & ~1u;
+
+		p = emit_store_imm(p, di->rd, pc + di->len);
+		if(is_call(di)){
+			p = emit_ras_push(jit, p, pc + di->len, p + JIT_RAS_PUSH_SIZE + JIT_EXIT_LINK_SIZE);
+			p = emit_exit_link(jit, p, target);
+			return emit_exit_link(jit, p, pc + di->len);
+		}
+		return emit_exit_link(jit, p, target);
+	}
+
+	// Target first, rd may be rs1
+	p = emit_addr(jit, p, di);
+	// and eax, ~1
+	p = emit8(p, 0x83);
+	p = emit8(p, 0xE0);
+	p = emit8(p, 0xFE);
+	p = emit_store_imm(p, di->rd, pc + di->len);
+
+	if(is_return(di))
+		return emit_ras_pop(jit, p);
+
+	if(is_call(di)){
+		// mov ecx, eax, the push uses rax
+		p = emit8(p, 0x89);
+		p = emit8(p, 0xC1);
+		// The return exit follows the dynamic one (mov eax, ecx; mov rdx, r9; ret)
+		p = emit_ras_push(jit, p, pc + di->len, p + JIT_RAS_PUSH_SIZE + 6);
+		p = emit8(p, 0x89);
+		p = emit8(p, 0xC8);
+		p = emit_ret(p);
+		return emit_exit_link(jit, p, pc + di->len);
+	}
+
+	return emit_ret(p);
+}
+
+// rd = rs1 op rs2
+static uint8_t* emit_op(const RISCV_jit_st *jit, uint8_t *p, const RISCV_dinstr_st *di, uint8_t alu)
+{
+	p = emit_load_reg(jit, p, X86_EAX, di->rs1);
+	p = emit_load_reg(jit, p, X86_ECX, di->rs2);
+	p = emit_alu(p, alu);
+	return emit_store_reg(p, X86_EAX, di->rd);
+}
+
+// rd = rs1 op imm
+static uint8_t* emit_op_imm(const RISCV_jit_st *jit, uint8_t *p, const RISCV_dinstr_st *di, uint8_t alu)
+{
+	p = emit_load_reg(jit, p, X86_EAX, di->rs1);
+	p = emit_alu_imm(p, alu, di->imm);
+	return emit_store_reg(p, X86_EAX, di->rd);
+}
+
+// rd = rs1 shift rs2, x86 masks the count to 5 bits like RV32I does
+static uint8_t* emit_shift(const RISCV_jit_st *jit, uint8_t *p, const RISCV_dinstr_st *di, uint8_t shift)
+{
+	p = emit_load_reg(jit, p, X86_EAX, di->rs1);
+	p = emit_load_reg(jit, p, X86_ECX, di->rs2);
+	p = emit8(p, 0xD3);
+	p = emit8(p, 0xC0 | shift << 3);
+	return emit_store_reg(p, X86_EAX, di->rd);
+}
+
+// rd = rs1 shift shamt
+static uint8_t* emit_shift_imm(const RISCV_jit_st *jit, uint8_t *p, const RISCV_dinstr_st *di, uint8_t shift)
+{
+	p = emit_load_reg(jit, p, X86_EAX, di->rs1);
+	p = emit8(p, 0xC1);
+	p = emit8(p, 0xC0 | shift << 3);
+	p = emit8(p, di->imm);
+	return emit_store_reg(p, X86_EAX, di->rd);
+}
+
+// rd = rs1 < rs2 (or imm), signed or not depending on cc
+static uint8_t* emit_set(const RISCV_jit_st *jit, uint8_t *p, const RISCV_dinstr_st *di, uint8_t cc, bool imm)
+{
+	p = emit_load_reg(jit, p, X86_EAX, di->rs1);
+	// xor ecx, ecx before the flags are set
+	p = emit8(p, 0x31);
+	p = emit8(p, 0xC9);
+	if(imm)
+		p = emit_alu_imm(p, X86_ALU_CMP, di->imm);
+	else
+		p = emit_cmp_reg(jit, p, di->rs2);
+	// setcc cl
+	p = emit8(p, 0x0F);
+	p = emit8(p, 0x90 | cc);
+	p = emit8(p, 0xC1);
+	return emit_store_reg(p, X86_ECX, di->rd);
+}
+
+// rd = rs1 * rs2, low half
+static uint8_t* emit_mul(const RISCV_jit_st *jit, uint8_t *p, const RISCV_dinstr_st *di)
+{
+	p = emit_load_reg(jit, p, X86_EAX, di->rs1);
+	if(is_known(jit, di->rs2)){
+		// imul eax, eax, imm32
+		p = emit8(p, 0x69);
+		p = emit8(p, 0xC0);
+		p = emit32(p, jit->consts.value[di->rs2]);
+		return emit_store_reg(p, X86_EAX, di->rd);
+	}
+	// imul eax, guest reg
+	p = emit8(p, 0x0F);
+	p = emit8(p, 0xAF);
+	p = emit8(p, 0x47);
+	p = emit8(p, REG_DISP(di->rs2));
+	return emit_store_reg(p, X86_EAX, di->rd);
+}
+
+// rd = (rs1 * rs2) >> 32, each source sign or zero extended to 64 bits
+//	The product of the extended sources fits in 64 bits, whose low half is
+//	the same for imul and mul
+static uint8_t* emit_mulh(const RISCV_jit_st *jit, uint8_t *p, const RISCV_dinstr_st *di, bool signed1, bool signed2)
+{
+	p = emit_load_reg(jit, p, X86_EAX, di->rs1);
+	p = emit_load_reg(jit, p, X86_ECX, di->rs2);
+	if(signed1){
+		// movsxd rax, eax
+		p = emit8(p, 0x48);
+		p = emit8(p, 0x63);
+		p = emit8(p, 0xC0);
+	}
+	if(signed2){
+		// movsxd rcx, ecx
+		p = emit8(p, 0x48);
+		p = emit8(p, 0x63);
+		p = emit8(p, 0xC9);
+	}
+	// imul rax, rcx; shr rax, 32
+	p = emit8(p, 0x48);
+	p = emit8(p, 0x0F);
+	p = emit8(p, 0xAF);
+	p = emit8(p, 0xC1);
+	p = emit8(p, 0x48);
+	p = emit8(p, 0xC1);
+	p = emit8(p, 0xE8);
+	p = emit8(p, 32);
+	return emit_store_reg(p, X86_EAX, di->rd);
+}
+
+// rd = rs1 / rs2 or rs1 % rs2, without the x86 faults
+//	By zero: the quotient has all bits set, the remainder is rs1.
+//	By -1 (signed): the quotient is -rs1 and the remainder 0, which also
+//	gives INT32_MIN / -1 = INT32_MIN.
+static uint8_t* emit_div(const RISCV_jit_st *jit, uint8_t *p, const RISCV_dinstr_st *di, bool is_signed, bool rem)
+{
+	uint8_t *by_zero = NULL, *by_minus_one = NULL, *done = NULL, *done_minus_one = NULL;
+
+	p = emit_load_reg(jit, p, X86_EAX, di->rs1);
+	p = emit_load_reg(jit, p, X86_ECX, di->rs2);
+	// test ecx, ecx
+	p = emit8(p, 0x85);
+	p = emit8(p, 0xC9);
+	by_zero = p;
+	p = emit_jcc(p, X86_CC_NE);
+	// rem: eax is already rs1
+	if(!rem){
+		// mov eax, -1
+		p = emit8(p, 0xB8);
+		p = emit32(p, UINT32_MAX);
+	}
+	done = p;
+	p = emit_jmp(p);
+	emit_jcc_end(by_zero, p);
+
+	if(is_signed){
+		// cmp ecx, -1
+		p = emit8(p, 0x83);
+		p = emit8(p, 0xF9);
+		p = emit8(p, 0xFF);
+		by_minus_one = p;
+		p = emit_jcc(p, X86_CC_NE);
+		if(rem){
+			// xor eax, eax
+			p = emit8(p, 0x31);
+			p = emit8(p, 0xC0);
+		}
+		else{
+			// neg eax
+			p = emit8(p, 0xF7);
+			p = emit8(p, 0xD8);
+		}
+		done_minus_one = p;
+		p = emit_jmp(p);
+		emit_jcc_end(by_minus_one, p);
+	}
+
+	// edx is clobbered (push rdx; cdq; idiv ecx or xor edx, edx; div ecx)
+	p = emit8(p, 0x52);
+	if(is_signed){
+		p = emit8(p, 0x99);
+		p = emit8(p, 0xF7);
+		p = emit8(p, 0xF9);
+	}
+	else{
+		p = emit8(p, 0x31);
+		p = emit8(p, 0xD2);
+		p = emit8(p, 0xF7);
+		p = emit8(p, 0xF1);
+	}
+	if(rem){
+		// mov eax, edx
+		p = emit8(p, 0x89);
+		p = emit8(p, 0xD0);
+	}
+	// pop rdx
+	p = emit8(p, 0x5A);
+
+	emit_jcc_end(done, p);
+	if(done_minus_one)
+		emit_jcc_end(done_minus_one, p);
+	return emit_store_reg(p, X86_EAX, di->rd);
+}
+
+// x86 condition cc of cmp a, b
+static bool cc_holds(uint8_t cc, uint32_t a, uint32_t b)
+{
+	switch(cc){
+		case X86_CC_B:	return a < b;
+		case X86_CC_AE:	return a >= b;
+		case X86_CC_E:	return a == b;
+		case X86_CC_NE:	return a != b;
+		case X86_CC_L:	return (int32_t)a < (int32_t)b;
+		default:		return (int32_t)a >= (int32_t)b; // X86_CC_GE
+	}
+}
+
+// Conditional branch, ends the block on both paths
+//	Known sources decide it now, a single exit remains
+static uint8_t* emit_branch(RISCV_jit_st *jit, uint8_t *p, const RISCV_dinstr_st *di, pc_kt pc, uint8_t cc)
+{
+	uint8_t *not_taken = NULL;
+
+	if(is_known(jit, di->rs1) && is_known(jit, di->rs2)){
+		bool taken = cc_holds(cc, jit->consts.value[di->rs1], jit->consts.value[di->rs2]);
+		return emit_exit_link(jit, p, taken? pc + di->imm : pc + di->len);
+	}
+
+	p = emit_load_reg(jit, p, X86_EAX, di->rs1);
+	p = emit_cmp_reg(jit, p, di->rs2);
+	not_taken = p;
+	p = emit_jcc(p, cc ^ 1);
+	p = emit_exit_link(jit, p, pc + di->imm);
+	emit_jcc_end(not_taken, p);
+	return emit_exit_link(jit, p, pc + di->len);
+}
+
+// Room for count more guest access sites, false if there isn't
+static bool RISCV_jit_reserve(RISCV_jit_st *jit, size_t count)
+{
+	size_t size = jit->sites_size? jit->sites_size : 0x400;
+	RISCV_jit_site_st *sites = NULL;
+
+	if(jit->sites_count + count <= jit->sites_size)
+		return true;
+	while(size < jit->sites_count + count)
+		size *= 2;
+	sites = realloc(jit->sites, size * sizeof(RISCV_jit_site_st));
+	if(!sites)
+		return false;
+	jit->sites = sites;
+	jit->sites_size = size;
+	return true;
+}
+
+// Guest access instruction at p, false if it can't be recorded
+static bool RISCV_jit_site(RISCV_jit_st *jit, const uint8_t *p, pc_kt pc)
+{
+	RISCV_jit_site_st *site = NULL;
+
+	if(!RISCV_jit_reserve(jit, 1))
+		return false;
+
+	site = &jit->sites[jit->sites_count++];
+	site->native = p - jit->code;
+	site->block = jit->block_ofs;
+	site->pc = pc;
+	// Instructions before it in the block, translated so far
+	site->index = ((const RISCV_jit_block_st*)(jit->code + jit->block_ofs))->len;
+	return true;
+}
+
+// [mem + eax] = ecx, size bytes
+//	Stores to a flagged page go through RISCV_page_write(), so overwritten
+//	code is dropped, written pages are tracked and watched ones stop the run
+static uint8_t* emit_store(RISCV_jit_st *jit, uint8_t *p, const RISCV_dinstr_st *di, pc_kt pc, uint8_t size)
+{
+	const RISCV_jit_block_st *block = (const RISCV_jit_block_st*)(jit->code + jit->block_ofs);
+	uint8_t *fast = NULL, *watched = NULL;
+
+	p = emit_addr(jit, p, di);
+	p = emit_load_reg(jit, p, X86_ECX, di->rs2);
+	if(!RISCV_jit_site(jit, p, pc))
+		return NULL;
+	switch(size){
+		case 1:{
+			// mov [rsi + rax], cl
+			p = emit8(p, 0x88);
+		}break;
+		case 2:{
+			// mov [rsi + rax], cx
+			p = emit8(p, 0x66);
+			p = emit8(p, 0x89);
+		}break;
+		default:{
+			// mov [rsi + rax], ecx
+			p = emit8(p, 0x89);
+		}
+	}
+	p = emit8(p, 0x0C);
+	p = emit8(p, 0x06);
+
+	// mov r8d, eax; shr r8d, RISCV_PAGE_SHIFT
+	p = emit8(p, 0x41);
+	p = emit8(p, 0x89);
+	p = emit8(p, 0xC0);
+	p = emit8(p, 0x41);
+	p = emit8(p, 0xC1);
+	p = emit8(p, 0xE8);
+	p = emit8(p, RISCV_PAGE_SHIFT);
+	// cmp byte [rdx + r8], 0
+	p = emit8(p, 0x42);
+	p = emit8(p, 0x80);
+	p = emit8(p, 0x3C);
+	p = emit8(p, 0x02);
+	p = emit8(p, 0x00);
+	fast = p;
+	p = emit_jcc(p, X86_CC_E);
+	// push rdi; push rsi; push rdx; push r9; sub rsp, 8 (16 bytes aligned)
+	p = emit8(p, 0x57);
+	p = emit8(p, 0x56);
+	p = emit8(p, 0x52);
+	p = emit8(p, 0x41);
+	p = emit8(p, 0x51);
+	p = emit8(p, 0x48);
+	p = emit8(p, 0x83);
+	p = emit8(p, 0xEC);
+	p = emit8(p, 0x08);
+	// mov esi, eax; mov edx, size; mov rax, RISCV_page_write; call rax
+	p = emit8(p, 0x89);
+	p = emit8(p, 0xC6);
+	p = emit8(p, 0xBA);
+	p = emit32(p, size);
+	p = emit8(p, 0x48);
+	p = emit8(p, 0xB8);
+	p = emit64(p, (uint64_t)(uintptr_t)RISCV_page_write);
+	p = emit8(p, 0xFF);
+	p = emit8(p, 0xD0);
+	// add rsp, 8; pop r9; pop rdx; pop rsi; pop rdi
+	p = emit8(p, 0x48);
+	p = emit8(p, 0x83);
+	p = emit8(p, 0xC4);
+	p = emit8(p, 0x08);
+	p = emit8(p, 0x41);
+	p = emit8(p, 0x59);
+	p = emit8(p, 0x5A);
+	p = emit8(p, 0x5E);
+	p = emit8(p, 0x5F);
+	// Watched: exit after the store, the instructions of the block after it
+	// go back to the budget
+	//	test al, al; jz fast; add r9, unretired; exit to the next pc
+	p = emit8(p, 0x84);
+	p = emit8(p, 0xC0);
+	watched = p;
+	p = emit_jcc(p, X86_CC_E);
+	p = emit8(p, 0x49);
+	p = emit8(p, 0x83);
+	p = emit8(p, 0xC1);
+	p = emit8(p, jit->block_count - block->len - 1);
+	p = emit_exit(p, pc + di->len);
+	emit_jcc_end(watched, p);
+	emit_jcc_end(fast, p);
+
+	return p;
+}
+
+// rd = [mem + eax], opcode bytes of the (sign/zero extending) load
+static uint8_t* emit_load(RISCV_jit_st *jit, uint8_t *p, const RISCV_dinstr_st *di, pc_kt pc, uint16_t opcode)
+{
+	p = emit_addr(jit, p, di);
+	if(!RISCV_jit_site(jit, p, pc))
+		return NULL;
+	if(opcode > 0xFF)
+		p = emit8(p, opcode >> 8);
+	p = emit8(p, opcode & 0xFF);
+	// eax, [rsi + rax]
+	p = emit8(p, 0x04);
+	p = emit8(p, 0x06);
+	return emit_store_reg(p, X86_EAX, di->rd);
+}
+
+// Native code for one instruction, NULL if it has to be interpreted
+//	pc is the address of the instruction
+static uint8_t* RISCV_jit_emit(RISCV_jit_st *jit, uint8_t *p, const RISCV_dinstr_st *di, pc_kt pc)
+{
+	// Fused pairs are translated one instruction at a time
+	switch(RISCV_op_first(di->op)){
+		case RISCV_OP_LUI:		return emit_store_imm(p, di->rd, di->imm);
+		case RISCV_OP_AUIPC:	return emit_store_imm(p, di->rd, pc + di->imm);
+		case RISCV_OP_JAL:		return emit_jal(jit, p, di, pc);
+		case RISCV_OP_JALR:		return emit_jalr(jit, p, di, pc);
+		case RISCV_OP_BEQ:		return emit_branch(jit, p, di, pc, X86_CC_E);
+		case RISCV_OP_BNE:		return emit_branch(jit, p, di, pc, X86_CC_NE);
+		case RISCV_OP_BLT:		return emit_branch(jit, p, di, pc, X86_CC_L);
+		case RISCV_OP_BGE:		return emit_branch(jit, p, di, pc, X86_CC_GE);
+		case RISCV_OP_BLTU:		return emit_branch(jit, p, di, pc, X86_CC_B);
+		case RISCV_OP_BGEU:		return emit_branch(jit, p, di, pc, X86_CC_AE);
+		case RISCV_OP_LB:		return emit_load(jit, p, di, pc, 0x0FBE); // movsx eax, byte
+		case RISCV_OP_LH:		return emit_load(jit, p, di, pc, 0x0FBF); // movsx eax, word
+		case RISCV_OP_LW:		return emit_load(jit, p, di, pc, 0x8B);	// mov eax
+		case RISCV_OP_LBU:		return emit_load(jit, p, di, pc, 0x0FB6); // movzx eax, byte
+		case RISCV_OP_LHU:		return emit_load(jit, p, di, pc, 0x0FB7); // movzx eax, word
+		case RISCV_OP_SB:		return emit_store(jit, p, di, pc, 1);
+		case RISCV_OP_SH:		return emit_store(jit, p, di, pc, 2);
+		case RISCV_OP_SW:		return emit_store(jit, p, di, pc, 4);
+		case RISCV_OP_ADDI:		return emit_op_imm(jit, p, di, X86_ALU_ADD);
+		case RISCV_OP_SLTI:		return emit_set(jit, p, di, X86_CC_L, true);
+		case RISCV_OP_SLTIU:	return emit_set(jit, p, di, X86_CC_B, true);
+		case RISCV_OP_XORI:		return emit_op_imm(jit, p, di, X86_ALU_XOR);
+		case RISCV_OP_ORI:		return emit_op_imm(jit, p, di, X86_ALU_OR);
+		case RISCV_OP_ANDI:		return emit_op_imm(jit, p, di, X86_ALU_AND);
+		case RISCV_OP_SLLI:		return emit_shift_imm(jit, p, di, X86_SHL);
+		case RISCV_OP_SRLI:		return emit_shift_imm(jit, p, di, X86_SHR);
+		case RISCV_OP_SRAI:		return emit_shift_imm(jit, p, di, X86_SAR);
+		case RISCV_OP_ADD:		return emit_op(jit, p, di, X86_ALU_ADD);
+		case RISCV_OP_SUB:		return emit_op(jit, p, di, X86_ALU_SUB);
+		case RISCV_OP_SLL:		return emit_shift(jit, p, di, X86_SHL);
+		case RISCV_OP_SLT:		return emit_set(jit, p, di, X86_CC_L, false);
+		case RISCV_OP_SLTU:		return emit_set(jit, p, di, X86_CC_B, false);
+		case RISCV_OP_XOR:		return emit_op(jit, p, di, X86_ALU_XOR);
+		case RISCV_OP_SRL:		return emit_shift(jit, p, di, X86_SHR);
+		case RISCV_OP_SRA:		return emit_shift(jit, p, di, X86_SAR);
+		case RISCV_OP_OR:		return emit_op(jit, p, di, X86_ALU_OR);
+		case RISCV_OP_AND:		return emit_op(jit, p, di, X86_ALU_AND);
+		case RISCV_OP_MUL:		return emit_mul(jit, p, di);
+		case RISCV_OP_MULH:		return emit_mulh(jit, p, di, true, true);
+		case RISCV_OP_MULHSU:	return emit_mulh(jit, p, di, true, false);
+		case RISCV_OP_MULHU:	return emit_mulh(jit, p, di, false, false);
+		case RISCV_OP_DIV:		return emit_div(jit, p, di, true, false);
+		case RISCV_OP_DIVU:		return emit_div(jit, p, di, false, false);
+		case RISCV_OP_REM:		return emit_div(jit, p, di, true, true);
+		case RISCV_OP_REMU:		return emit_div(jit, p, di, false, true);
+		case RISCV_OP_FENCE:	return p; // single hart, nothing to order
+		case RISCV_OP_FENCE_I:	return emit_exit_link(jit, p, pc + di->len); // what follows is looked up again
+		default:				return NULL; // ecall, ebreak, privileged, halt, illegal
+	}
+}
+
+static bool RISCV_jit_ends_block(uint8_t op)
+{
+	switch(op){
+		case RISCV_OP_JAL:
+		case RISCV_OP_JALR:
+		case RISCV_OP_BEQ:
+		case RISCV_OP_BNE:
+		case RISCV_OP_BLT:
+		case RISCV_OP_BGE:
+		case RISCV_OP_BLTU:
+		case RISCV_OP_BGEU:
+		case RISCV_OP_FENCE_I:
+			return true;
+		default:
+			return false;
+	}
+}
+
+RISCV_jit_st* RISCV_jit_init(RISCV_st *cpu)
+{
+	RISCV_jit_st *jit = NULL;
+
+	assert(cpu);
+
+	jit = calloc(1, sizeof(RISCV_jit_st));
+	if(!jit)
+		return NULL;
+
+	jit->code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(jit->code == MAP_FAILED){
+		jit->code = NULL;
+		goto error;
+	}
+
+	jit->halfwords = cpu->icache_size;
+	jit->blocks = RISCV_table_alloc(jit->halfwords * sizeof(uint32_t));
+	if(!jit->blocks)
+		goto error;
+
+	RISCV_jit_flush(jit);
+	return jit;
+
+error:
+	RISCV_jit_deinit(jit);
+	return NULL;
+}
+
+void RISCV_jit_deinit(RISCV_jit_st *jit)
+{
+	if(!jit)
+		return;
+	if(jit->code)
+		munmap(jit->code, JIT_CODE_SIZE);
+	RISCV_table_free(jit->blocks, jit->halfwords * sizeof(uint32_t));
+	free(jit->sites);
+	free(jit);
+}
+
+// Drop every translated block
+//	Must not be called while a block runs
+void RISCV_jit_flush(RISCV_jit_st *jit)
+{
+	assert(jit);
+
+	RISCV_table_clear(jit->blocks, jit->halfwords * sizeof(uint32_t));
+	jit->flushes++;
+	jit->sites_count = 0;
+
+	// Native code of the return addresses is gone, no pc is odd
+	for(size_t i=0 ; i<JIT_RAS_SIZE ; i++)
+		jit->ras.entry[i].pc = 1;
+
+	// Entry trampoline at offset 0 (which means no block in blocks[])
+	//	mov r9, rcx; jmp r8
+	// Then the ret guest access faults resume at, see RISCV_jit_fault()
+	jit->code_used = 16;
+	memcpy(jit->code, (const uint8_t[]){0x49, 0x89, 0xC9, 0x41, 0xFF, 0xE0}, 6);
+	jit->code[JIT_FAULT_EXIT] = 0xC3;
+}
+
+// Block optimizer
+//	The instructions of a block are planned together before translation:
+//	- writes to x0 without side effects are dropped,
+//	- results of known sources (lui, auipc, addi chains...) are computed
+//	  now, they stay constants (RISCV_jit_consts_st) used as immediates,
+//	- register writes overwritten before anything reads them are dropped.
+//	cpu->reg only has to be right where the block may stop: at its exits
+//	and at guest accesses, which may fault (see RISCV_jit_fault()).
+#define JIT_OPT_DEAD	0x01 // nothing to emit
+#define JIT_OPT_FOLD	0x02 // constant result, in value
+
+typedef struct{
+	const RISCV_dinstr_st *di;
+	pc_kt pc;
+	uint8_t op;			// first one of fused pairs, translated alone
+	uint8_t plan;		// JIT_OPT_
+	uint32_t value;
+}RISCV_jit_instr_st;
+
+// Translated, the ones after are left to the interpreter
+static bool RISCV_jit_translatable(uint8_t op)
+{
+	return op < RISCV_OP_ECALL;
+}
+
+// Writes rd and does nothing else
+static bool opt_pure(uint8_t op)
+{
+	return op == RISCV_OP_LUI || op == RISCV_OP_AUIPC || (op >= RISCV_OP_ADDI && op <= RISCV_OP_REMU);
+}
+
+// addi, ori or xori of 0 to the register itself
+static bool opt_nop(uint8_t op, const RISCV_dinstr_st *di)
+{
+	return (op == RISCV_OP_ADDI || op == RISCV_OP_ORI || op == RISCV_OP_XORI) &&
+			di->rd == di->rs1 && !di->imm;
+}
+
+static bool opt_writes(uint8_t op)
+{
+	return opt_pure(op) || op == RISCV_OP_JAL || op == RISCV_OP_JALR ||
+			(op >= RISCV_OP_LB && op <= RISCV_OP_LHU);
+}
+
+// The block may stop there: exits, and guest accesses
+static bool opt_barrier(uint8_t op)
+{
+	return (op >= RISCV_OP_JAL && op <= RISCV_OP_SW) || op == RISCV_OP_FENCE_I;
+}
+
+// Guest registers read, a bit per register
+static uint32_t opt_sources(uint8_t op, const RISCV_dinstr_st *di)
+{
+	switch(op){
+		case RISCV_OP_LUI:
+		case RISCV_OP_AUIPC:
+		case RISCV_OP_JAL:
+		case RISCV_OP_FENCE:
+		case RISCV_OP_FENCE_I:
+			return 0;
+		case RISCV_OP_JALR:
+		case RISCV_OP_LB:
+		case RISCV_OP_LH:
+		case RISCV_OP_LW:
+		case RISCV_OP_LBU:
+		case RISCV_OP_LHU:
+			return 1u << di->rs1;
+		default:
+			// Immediate ones don't have rs2
+			if(op >= RISCV_OP_ADDI && op <= RISCV_OP_SRAI)
+				return 1u << di->rs1;
+			return 1u << di->rs1 | 1u << di->rs2;
+	}
+}
+
+// Arithmetic shift, not implementation defined
+static uint32_t opt_sra(uint32_t a, uint32_t shamt)
+{
+	int32_t v = a;
+
+	shamt &= 0x1F;
+	return v < 0? ~(~v >> shamt) : v >> shamt;
+}
+
+// Result of a pure instruction at pc with sources a and b, as the handlers
+static uint32_t opt_fold(uint8_t op, const RISCV_dinstr_st *di, pc_kt pc, uint32_t a, uint32_t b)
+{
+	uint32_t imm = di->imm;
+
+	switch(op){
+		case RISCV_OP_LUI:		return imm;
+		case RISCV_OP_AUIPC:	return pc + imm;
+		case RISCV_OP_ADDI:		return a + imm;
+		case RISCV_OP_SLTI:		return (int32_t)a < (int32_t)imm;
+		case RISCV_OP_SLTIU:	return a < imm;
+		case RISCV_OP_XORI:		return a ^ imm;
+		case RISCV_OP_ORI:		return a | imm;
+		case RISCV_OP_ANDI:		return a & imm;
+		case RISCV_OP_SLLI:		return a << (imm & 0x1F);
+		case RISCV_OP_SRLI:		return a >> (imm & 0x1F);
+		case RISCV_OP_SRAI:		return opt_sra(a, imm);
+		case RISCV_OP_ADD:		return a + b;
+		case RISCV_OP_SUB:		return a - b;
+		case RISCV_OP_SLL:		return a << (b & 0x1F);
+		case RISCV_OP_SLT:		return (int32_t)a < (int32_t)b;
+		case RISCV_OP_SLTU:		return a < b;
+		case RISCV_OP_XOR:		return a ^ b;
+		case RISCV_OP_SRL:		return a >> (b & 0x1F);
+		case RISCV_OP_SRA:		return opt_sra(a, b);
+		case RISCV_OP_OR:		return a | b;
+		case RISCV_OP_AND:		return a & b;
+		case RISCV_OP_MUL:		return a * b;
+		case RISCV_OP_MULH:		return (uint64_t)((int64_t)(int32_t)a * (int32_t)b) >> 32;
+		case RISCV_OP_MULHSU:	return (uint64_t)((int64_t)(int32_t)a * (int64_t)b) >> 32;
+		case RISCV_OP_MULHU:	return ((uint64_t)a * b) >> 32;
+		case RISCV_OP_DIV:
+			if(!b)
+				return UINT32_MAX;
+			if(a == 0x80000000u && b == UINT32_MAX)
+				return a;
+			return (int32_t)a / (int32_t)b;
+		case RISCV_OP_DIVU:		return b? a / b : UINT32_MAX;
+		case RISCV_OP_REM:
+			if(!b)
+				return a;
+			if(a == 0x80000000u && b == UINT32_MAX)
+				return 0;
+			return (int32_t)a % (int32_t)b;
+		default:				return b? a % b : a; // RISCV_OP_REMU
+	}
+}
+
+// Fills the plan of the count instructions of a block
+static void RISCV_jit_plan(RISCV_jit_instr_st *instr, size_t count)
+{
+	RISCV_jit_consts_st c = {.known = 1u << ZERO};
+	uint32_t known[JIT_BLOCK_MAX]; // before each instruction
+	uint32_t live = UINT32_MAX;
+
+	// Forward: known values
+	for(size_t i=0 ; i<count ; i++){
+		RISCV_jit_instr_st *in = &instr[i];
+		const RISCV_dinstr_st *di = in->di;
+
+		known[i] = c.known;
+		in->plan = 0;
+		if(opt_pure(in->op) && di->rd == ZERO){
+			in->plan = JIT_OPT_DEAD;
+		}
+		else if(opt_pure(in->op) && !(opt_sources(in->op, di) & ~c.known)){
+			in->plan = JIT_OPT_FOLD;
+			in->value = opt_fold(in->op, di, in->pc, c.value[di->rs1], c.value[di->rs2]);
+			c.known |= 1u << di->rd;
+			c.value[di->rd] = in->value;
+		}
+		else if(opt_nop(in->op, di)){
+			// rd keeps its value, known or not
+			in->plan = JIT_OPT_DEAD;
+		}
+		else if(opt_writes(in->op) && di->rd != ZERO){
+			c.known &= ~(1u << di->rd);
+		}
+	}
+
+	// Backward: registers whose value in cpu->reg is read later, all of them
+	// where the block may stop. Known ones are read as immediates.
+	for(size_t i=count ; i-- > 0 ;){
+		RISCV_jit_instr_st *in = &instr[i];
+		const RISCV_dinstr_st *di = in->di;
+
+		if(opt_barrier(in->op)){
+			live = UINT32_MAX;
+		}
+		else if(in->plan & JIT_OPT_FOLD){
+			// Stored later, when the block may stop
+			live &= ~(1u << di->rd);
+		}
+		else if(opt_pure(in->op) && !in->plan){
+			if(!(live & (1u << di->rd))){
+				in->plan = JIT_OPT_DEAD;
+				continue;
+			}
+			live &= ~(1u << di->rd);
+			live |= opt_sources(in->op, di) & ~known[i];
+		}
+	}
+}
+
+// Stores the constants cpu->reg doesn't hold yet
+static uint8_t* emit_consts(RISCV_jit_st *jit, uint8_t *p)
+{
+	RISCV_jit_consts_st *c = &jit->consts;
+
+	for(uint8_t r=1 ; r<32 ; r++){
+		if(c->pending & (1u << r))
+			p = emit_store_imm(p, r, c->value[r]);
+	}
+	c->pending = 0;
+
+	return p;
+}
+
+uint32_t RISCV_jit_translate(RISCV_st *cpu, pc_kt pc)
+{
+	RISCV_jit_st *jit = cpu->jit;
+	RISCV_jit_consts_st *c = &jit->consts;
+	RISCV_jit_instr_st instr[JIT_BLOCK_MAX];
+	RISCV_jit_block_st *block = NULL;
+	RISCV_dinstr_st *di = NULL;
+	uint8_t *p = NULL, *budget = NULL;
+	uint32_t ofs = 0;
+	size_t count = 0, sites = 0;
+	uint8_t op = 0;
+	pc_kt at = pc;
+
+	// Instructions of the block first, up to one left to the interpreter
+	while(count < JIT_BLOCK_MAX && (at >> 1) < (cpu->mem_size >> 1)){
+		// Same decoded instructions as the interpreter
+		di = &cpu->icache[at >> 1];
+		if(!di->exec){
+			RISCV_decode_instr(RISCV_read_instr(cpu, at), di);
+		}
+		RISCV_page_code(cpu, at);
+
+		op = RISCV_op_first(di->op);
+		if(!RISCV_jit_translatable(op))
+			break;
+		// Calls and returns keep the profiler shadow stack, interpreted
+		if(cpu->prof && (op == RISCV_OP_JAL || op == RISCV_OP_JALR) && RISCV_prof_kind(di, op))
+			break;
+
+		instr[count++] = (RISCV_jit_instr_st){.di = di, .pc = at, .op = op};
+		if(op >= RISCV_OP_LB && op <= RISCV_OP_SW)
+			sites++;
+		at += di->len;
+
+		if(RISCV_jit_ends_block(op))
+			break;
+	}
+
+	// Every instruction gets translated once planned
+	if(!count || !RISCV_jit_reserve(jit, sites)){
+		jit->blocks[pc >> 1] = JIT_NO_BLOCK;
+		return JIT_NO_BLOCK;
+	}
+	RISCV_jit_plan(instr, count);
+
+	if(JIT_CODE_SIZE - jit->code_used < JIT_BLOCK_ROOM)
+		RISCV_jit_flush(jit);
+
+	block = (RISCV_jit_block_st*)(jit->code + jit->code_used);
+	jit->block_ofs = jit->code_used;
+	jit->block_count = count;
+	block->pc = pc;
+	block->len = 0;
+	block->end = at;
+	p = (uint8_t*)(block + 1);
+
+	// Entered only if the whole block fits in the budget
+	//	cmp r9, len; jae body; exit to pc; body: sub r9, len
+	p = emit8(p, 0x49);
+	p = emit8(p, 0x83);
+	p = emit8(p, 0xF9);
+	p = emit8(p, count);
+	budget = p;
+	p = emit_jcc(p, X86_CC_AE);
+	p = emit_exit(p, pc);
+	emit_jcc_end(budget, p);
+	p = emit8(p, 0x49);
+	p = emit8(p, 0x83);
+	p = emit8(p, 0xE9);
+	p = emit8(p, count);
+
+	*c = (RISCV_jit_consts_st){.known = 1u << ZERO};
+	for(size_t i=0 ; i<count ; i++){
+		const RISCV_jit_instr_st *in = &instr[i];
+		uint8_t rd = in->di->rd;
+
+		if(in->plan & JIT_OPT_FOLD){
+			c->known |= 1u << rd;
+			c->pending |= 1u << rd;
+			c->value[rd] = in->value;
+		}
+		else{
+			// Guest access sites count the instructions before them
+			if(!(in->plan & JIT_OPT_DEAD)){
+				if(opt_barrier(in->op))
+					p = emit_consts(jit, p);
+				p = RISCV_jit_emit(jit, p, in->di, in->pc);
+				assert(p);
+			}
+			// Written at run time now, or dead
+			if(opt_writes(in->op) && rd != ZERO){
+				c->known &= ~(1u << rd);
+				c->pending &= ~(1u << rd);
+			}
+		}
+		block->len++;
+	}
+
+	// Cut before an instruction left to the interpreter, or too long
+	if(!RISCV_jit_ends_block(instr[count - 1].op)){
+		p = emit_consts(jit, p);
+		p = emit_exit_link(jit, p, at);
+	}
+
+	ofs = jit->code_used;
+	jit->code_used = ((p - jit->code) + 15) & ~(size_t)15;
+	jit->blocks[pc >> 1] = ofs;
+
+	return ofs;
+}
+
+// Jump from a block exit straight to the next block
+void RISCV_jit_link(RISCV_jit_st *jit, uint32_t exit, const RISCV_jit_block_st *block)
+{
+	uint8_t *jmp = jit->code + exit;
+	int32_t rel = (const uint8_t*)RISCV_jit_native(block) - (jmp + 5);
+
+	assert(jmp[0] == 0xE9);
+	memcpy(jmp + 1, &rel, sizeof(rel));
+}
+
+void RISCV_jit_invalidate(RISCV_jit_st *jit, uint32_t addr, uint32_t size)
+{
+	uint32_t last = addr + size - 1;
+	uint32_t first = addr > JIT_BLOCK_SPAN? (addr - JIT_BLOCK_SPAN) >> 1 : 0;
+	uint32_t near = addr >> 1? (addr >> 1) - 1 : 0;
+
+	assert(jit);
+
+	// Blocks starting up to JIT_BLOCK_SPAN bytes before may reach addr
+	for(uint32_t i=first ; i<=(last >> 1) && i<jit->halfwords ; i++){
+		RISCV_jit_block_st *block = NULL;
+		uint8_t *jae = NULL;
+
+		if(!jit->blocks[i])
+			continue;
+		// Interpreted because of the instruction at i, which may have changed
+		if(jit->blocks[i] == JIT_NO_BLOCK){
+			if(i >= near)
+				jit->blocks[i] = 0;
+			continue;
+		}
+
+		block = (RISCV_jit_block_st*)(jit->code + jit->blocks[i]);
+		if(block->end <= addr)
+			continue;
+		jit->blocks[i] = 0;
+		// The budget check falls through to the exit to pc from now on
+		//	(jae body becomes a 2 bytes nop)
+		jae = (uint8_t*)(block + 1) + 4;
+		assert(jae[0] == (0x70 | X86_CC_AE));
+		jae[0] = 0x66;
+		jae[1] = 0x90;
+	}
+}
+
+bool RISCV_jit_fault(const RISCV_jit_st *jit, uintptr_t rip, pc_kt *pc, uint64_t *unretired)
+{
+	const RISCV_jit_block_st *block = NULL;
+	size_t lo = 0, hi = jit->sites_count;
+	uint32_t native = 0;
+
+	if(rip < (uintptr_t)jit->code || rip >= (uintptr_t)jit->code + jit->code_used)
+		return false;
+	native = rip - (uintptr_t)jit->code;
+
+	while(lo < hi){
+		size_t mid = lo + (hi - lo) / 2;
+		if(jit->sites[mid].native < native)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if(lo == jit->sites_count || jit->sites[lo].native != native)
+		return false;
+
+	// The block took its whole length off the budget when entered
+	block = (const RISCV_jit_block_st*)(jit->code + jit->sites[lo].block);
+	*pc = jit->sites[lo].pc;
+	*unretired = block->len - jit->sites[lo].index;
+	return true;
+}
+
+#endif
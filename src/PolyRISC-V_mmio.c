@@ -0,0 +1,149 @@
+#include "PolyRISC-V_mmio.h"
+#include "PolyRISC-V_guard.h"
+
+static void RISCV_device_free(RISCV_device_st *dev)
+{
+	if(dev->free)
+		dev->free(dev);
+	else
+		free(dev);
+}
+
+bool RISCV_mmio_map(RISCV_st *cpu, RISCV_device_st *dev)
+{
+	uint32_t first = 0, last = 0;
+
+	assert(cpu);
+	assert(dev);
+	assert(dev->read);
+	assert(dev->write);
+
+	first = dev->base >> RISCV_PAGE_SHIFT;
+	last = ((uint64_t)dev->base + dev->size - 1) >> RISCV_PAGE_SHIFT;
+
+	if(!cpu->fault){
+		fprintf(stderr, "Error, devices need guarded guest memory (%s).\n", dev->name);
+		goto error;
+	}
+	if(dev->base & (RISCV_PAGE_SIZE - 1) || !dev->size || (uint64_t)dev->base + dev->size > GUARD_RESERVE){
+		fprintf(stderr, "Error, %s at 0x%08x (0x%x bytes) isn't page aligned or doesn't fit.\n",
+				dev->name, dev->base, dev->size);
+		goto error;
+	}
+	// Accesses to RAM don't fault
+	if(dev->base < cpu->mem_size){
+		fprintf(stderr, "Error, %s at 0x%08x is in guest memory (0x%zx bytes).\n",
+				dev->name, dev->base, cpu->mem_size);
+		goto error;
+	}
+
+	if(!cpu->mmio){
+		cpu->mmio = calloc(1, sizeof(RISCV_mmio_st));
+		if(!cpu->mmio)
+			goto error;
+		cpu->mmio->pages = RISCV_table_alloc(MMIO_PAGES_SIZE);
+		if(!cpu->mmio->pages){
+			free(cpu->mmio);
+			cpu->mmio = NULL;
+			goto error;
+		}
+	}
+
+	for(uint32_t page=first ; page<=last ; page++){
+		if(cpu->mmio->pages[page]){
+			fprintf(stderr, "Error, %s at 0x%08x overlaps %s.\n", dev->name, dev->base, cpu->mmio->pages[page]->name);
+			goto error;
+		}
+	}
+	for(uint32_t page=first ; page<=last ; page++)
+		cpu->mmio->pages[page] = dev;
+
+	dev->next = cpu->mmio->devices;
+	cpu->mmio->devices = dev;
+
+	return true;
+
+error:
+	RISCV_device_free(dev);
+	return false;
+}
+
+void RISCV_mmio_free(RISCV_st *cpu)
+{
+	RISCV_device_st *dev = NULL;
+
+	assert(cpu);
+
+	if(!cpu->mmio)
+		return;
+
+	dev = cpu->mmio->devices;
+	while(dev){
+		RISCV_device_st *next = dev->next;
+
+		RISCV_device_free(dev);
+		dev = next;
+	}
+	RISCV_table_free(cpu->mmio->pages, MMIO_PAGES_SIZE);
+	free(cpu->mmio);
+	cpu->mmio = NULL;
+}
+
+bool RISCV_mmio_fault(RISCV_st *cpu)
+{
+#if RISCV_HAS_GUARD
+	RISCV_dinstr_st di = {0};
+	RISCV_device_st *dev = NULL;
+	uint32_t addr = 0, offset = 0, value = 0;
+	uint8_t size = 0;
+	bool load = false;
+
+	assert(cpu);
+
+	if(!cpu->mmio || !cpu->fault || !cpu->fault->access || cpu->stop != RISCV_STOP_TRAP)
+		return false;
+
+	// Registers and pc are as before the faulting instruction
+	RISCV_decode_instr(RISCV_read_instr(cpu, cpu->pc), &di);
+	addr = cpu->reg[di.rs1] + di.imm;
+	switch(di.op){
+		case RISCV_OP_LB: case RISCV_OP_LBU:	size = 1; load = true; break;
+		case RISCV_OP_LH: case RISCV_OP_LHU:	size = 2; load = true; break;
+		case RISCV_OP_LW:						size = 4; load = true; break;
+		case RISCV_OP_SB:						size = 1; break;
+		case RISCV_OP_SH:						size = 2; break;
+		case RISCV_OP_SW:						size = 4; break;
+		default:								return false;
+	}
+
+	// The whole access is in the device
+	dev = RISCV_mmio_device(cpu, addr);
+	if(!dev || (uint64_t)addr + size > (uint64_t)dev->base + dev->size)
+		return false;
+	offset = addr - dev->base;
+
+	DEBUG_PRINT("Device %s, offset 0x%x (%u bytes) at pc: 0x%08x.\n", dev->name, offset, size, cpu->pc);
+
+	switch(di.op){
+		case RISCV_OP_LB:	value = (int8_t)dev->read(cpu, dev, offset, size); break;
+		case RISCV_OP_LH:	value = (int16_t)dev->read(cpu, dev, offset, size); break;
+		case RISCV_OP_LBU:	value = (uint8_t)dev->read(cpu, dev, offset, size); break;
+		case RISCV_OP_LHU:	value = (uint16_t)dev->read(cpu, dev, offset, size); break;
+		case RISCV_OP_LW:	value = dev->read(cpu, dev, offset, size); break;
+		default:			dev->write(cpu, dev, offset, size, cpu->reg[di.rs2]); break;
+	}
+	if(load && di.rd != ZERO)
+		cpu->reg[di.rd] = value;
+
+	// Retired, as if by the core
+	cpu->pc += di.len;
+	cpu->csr.instret++;
+	cpu->fault->access = false;
+	cpu->stop = RISCV_STOP_NONE;
+
+	return true;
+#else
+	(void)cpu;
+	return false;
+#endif
+}
@@ -0,0 +1,232 @@
+#include "PolyRISC-V_mmu.h"
+#include "PolyRISC-V_mmio.h"
+
+static const uint32_t MMU_PAGE_FAULT[3] = {CAUSE_FETCH_PAGE, CAUSE_LOAD_PAGE, CAUSE_STORE_PAGE};
+static const uint32_t MMU_ACCESS_FAULT[3] = {CAUSE_FETCH_ACCESS, CAUSE_LOAD_ACCESS, CAUSE_STORE_ACCESS};
+
+static void RISCV_tlb_clear(RISCV_mmu_st *mmu)
+{
+	for(int access=0 ; access<3 ; access++){
+		for(int i=0 ; i<MMU_TLB_SIZE ; i++)
+			mmu->tlb[access][i].tag = MMU_TLB_INVALID;
+	}
+}
+
+RISCV_mmu_st* RISCV_mmu_init(void)
+{
+	RISCV_mmu_st *mmu = calloc(1, sizeof(RISCV_mmu_st));
+
+	if(!mmu)
+		return NULL;
+	RISCV_tlb_clear(mmu);
+
+	return mmu;
+}
+
+void RISCV_mmu_deinit(RISCV_mmu_st *mmu)
+{
+	free(mmu);
+}
+
+void RISCV_mmu_flush(RISCV_st *cpu)
+{
+	assert(cpu);
+
+	if(cpu->mmu)
+		RISCV_tlb_clear(cpu->mmu);
+}
+
+// Always false, for the callers to return it
+static bool RISCV_mmu_fault(RISCV_st *cpu, uint32_t cause, uint32_t va)
+{
+	cpu->mmu->fault = true;
+	cpu->mmu->cause = cause;
+	cpu->mmu->tval = va;
+
+	return false;
+}
+
+// Translation of the page of va, when it is all in guest memory
+static void RISCV_tlb_fill(RISCV_st *cpu, RISCV_access_et access, uint32_t va, uint64_t pa)
+{
+	RISCV_tlb_st *e = &cpu->mmu->tlb[access][(va >> RISCV_PAGE_SHIFT) % MMU_TLB_SIZE];
+	uint64_t page = pa >> RISCV_PAGE_SHIFT;
+
+	if(((page + 1) << RISCV_PAGE_SHIFT) > cpu->mem_size)
+		return;
+
+	e->tag = va & ~(RISCV_PAGE_SIZE - 1);
+	e->page = page;
+	e->host = cpu->mem + (page << RISCV_PAGE_SHIFT);
+}
+
+bool RISCV_mmu_translate(RISCV_st *cpu, uint32_t va, RISCV_access_et access, uint64_t *pa)
+{
+	const RISCV_priv_st *priv = &cpu->priv;
+	uint64_t table = (uint64_t)(priv->satp & SATP_PPN) << RISCV_PAGE_SHIFT;
+	uint64_t addr = 0;
+	uint32_t pte = 0, needed = 0;
+	int level = 1;
+	bool allowed = false;
+
+	for(;;){
+		addr = table + ((va >> (RISCV_PAGE_SHIFT + PTE_VPN_BITS * level)) & ((1u << PTE_VPN_BITS) - 1)) * 4;
+		if(addr + 4 > cpu->mem_size)
+			return RISCV_mmu_fault(cpu, MMU_ACCESS_FAULT[access], va);
+
+		pte = RISCV_mem_read32(cpu->mem, addr);
+		if(!(pte & PTE_V) || ((pte & PTE_W) && !(pte & PTE_R)))
+			return RISCV_mmu_fault(cpu, MMU_PAGE_FAULT[access], va);
+		// Leaf
+		if(pte & (PTE_R | PTE_X))
+			break;
+		// Pointer to the next level, there is none after the last one
+		if(!level--)
+			return RISCV_mmu_fault(cpu, MMU_PAGE_FAULT[access], va);
+		table = (uint64_t)(pte >> PTE_PPN_SHIFT) << RISCV_PAGE_SHIFT;
+	}
+
+	// U pages are for U mode, and S mode when it asks for them (never to
+	// execute)
+	if(priv->mode == PRIV_U)
+		allowed = pte & PTE_U;
+	else
+		allowed = !(pte & PTE_U) || (access != MMU_FETCH && (priv->mstatus & MSTATUS_SUM));
+	switch(access){
+		case MMU_FETCH:	allowed = allowed && (pte & PTE_X); break;
+		case MMU_LOAD:	allowed = allowed && ((pte & PTE_R) || ((pte & PTE_X) && (priv->mstatus & MSTATUS_MXR))); break;
+		case MMU_STORE:	allowed = allowed && (pte & PTE_W); break;
+	}
+	// Superpages are aligned on their size
+	if(!allowed || (level && ((pte >> PTE_PPN_SHIFT) & ((1u << PTE_VPN_BITS) - 1))))
+		return RISCV_mmu_fault(cpu, MMU_PAGE_FAULT[access], va);
+
+	// Accessed and dirty get set rather than trapping for the kernel to do it
+	needed = PTE_A | (access == MMU_STORE? PTE_D : 0);
+	if((pte & needed) != needed){
+		pte |= needed;
+		RISCV_mem_write32(cpu->mem, addr, pte);
+		if(cpu->pages[addr >> RISCV_PAGE_SHIFT])
+			RISCV_page_write(cpu, addr, 4);
+	}
+
+	// Physical addresses are 34 bits
+	if(level)
+		*pa = ((uint64_t)(pte >> (PTE_PPN_SHIFT + PTE_VPN_BITS)) << (RISCV_PAGE_SHIFT + PTE_VPN_BITS)) |
+			(va & ((1u << (RISCV_PAGE_SHIFT + PTE_VPN_BITS)) - 1));
+	else
+		*pa = ((uint64_t)(pte >> PTE_PPN_SHIFT) << RISCV_PAGE_SHIFT) | (va & (RISCV_PAGE_SIZE - 1));
+
+	return true;
+}
+
+// Device of the access of size bytes at pa, NULL if there is none
+static RISCV_device_st* RISCV_mmu_device(const RISCV_st *cpu, uint64_t pa, uint32_t size)
+{
+	RISCV_device_st *dev = NULL;
+
+	if(pa >> BITS)
+		return NULL;
+	dev = RISCV_mmio_device(cpu, pa);
+	if(!dev || pa + size > (uint64_t)dev->base + dev->size)
+		return NULL;
+
+	return dev;
+}
+
+bool RISCV_mmu_fetch_slow(RISCV_st *cpu, uint32_t va, uint32_t *pa)
+{
+	uint64_t addr = 0;
+
+	if(!RISCV_mmu_translate(cpu, va, MMU_FETCH, &addr))
+		return false;
+	// Instructions only come from guest memory
+	if(addr + 2 > cpu->mem_size)
+		return RISCV_mmu_fault(cpu, CAUSE_FETCH_ACCESS, va);
+
+	RISCV_tlb_fill(cpu, MMU_FETCH, va, addr);
+	*pa = addr;
+
+	return true;
+}
+
+bool RISCV_mmu_load_slow(RISCV_st *cpu, uint32_t va, uint32_t size, uint32_t *value)
+{
+	RISCV_device_st *dev = NULL;
+	uint64_t pa = 0;
+
+	// Bytes on 2 pages, translated one at a time
+	if((va & (RISCV_PAGE_SIZE - 1)) > RISCV_PAGE_SIZE - size){
+		uint32_t byte = 0, bytes = 0;
+
+		for(uint32_t i=0 ; i<size ; i++){
+			if(!RISCV_mmu_load(cpu, va + i, 1, &byte))
+				return false;
+			bytes |= byte << (8 * i);
+		}
+		*value = bytes;
+		return true;
+	}
+
+	if(!RISCV_mmu_translate(cpu, va, MMU_LOAD, &pa))
+		return false;
+
+	if(pa + size <= cpu->mem_size){
+		RISCV_tlb_fill(cpu, MMU_LOAD, va, pa);
+		switch(size){
+			case 1:		*value = RISCV_mem_read8(cpu->mem, pa); break;
+			case 2:		*value = RISCV_mem_read16(cpu->mem, pa); break;
+			default:	*value = RISCV_mem_read32(cpu->mem, pa); break;
+		}
+		return true;
+	}
+
+	dev = RISCV_mmu_device(cpu, pa, size);
+	if(!dev)
+		return RISCV_mmu_fault(cpu, CAUSE_LOAD_ACCESS, va);
+	*value = dev->read(cpu, dev, pa - dev->base, size);
+	if(size < 4)
+		*value &= (1u << (8 * size)) - 1;
+
+	return true;
+}
+
+bool RISCV_mmu_store_slow(RISCV_st *cpu, uint32_t va, uint32_t size, uint32_t value)
+{
+	RISCV_device_st *dev = NULL;
+	uint64_t pa = 0;
+
+	// Bytes on 2 pages, the second one is checked first: a fault writes
+	// nothing
+	if((va & (RISCV_PAGE_SIZE - 1)) > RISCV_PAGE_SIZE - size){
+		if(!RISCV_mmu_translate(cpu, va + size - 1, MMU_STORE, &pa))
+			return false;
+		for(uint32_t i=0 ; i<size ; i++){
+			if(!RISCV_mmu_store(cpu, va + i, 1, value >> (8 * i)))
+				return false;
+		}
+		return true;
+	}
+
+	if(!RISCV_mmu_translate(cpu, va, MMU_STORE, &pa))
+		return false;
+
+	if(pa + size <= cpu->mem_size){
+		RISCV_tlb_fill(cpu, MMU_STORE, va, pa);
+		switch(size){
+			case 1:		RISCV_mem_write8(cpu->mem, pa, value); break;
+			case 2:		RISCV_mem_write16(cpu->mem, pa, value); break;
+			default:	RISCV_mem_write32(cpu->mem, pa, value); break;
+		}
+		if(cpu->pages[pa >> RISCV_PAGE_SHIFT])
+			RISCV_page_write(cpu, pa, size);
+		return true;
+	}
+
+	dev = RISCV_mmu_device(cpu, pa, size);
+	if(!dev)
+		return RISCV_mmu_fault(cpu, CAUSE_STORE_ACCESS, va);
+	dev->write(cpu, dev, pa - dev->base, size, value);
+
+	return true;
+}
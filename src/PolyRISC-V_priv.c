@@ -0,0 +1,387 @@
+#include "PolyRISC-V_priv.h"
+#include "PolyRISC-V_mmu.h"
+#include "PolyRISC-V_guard.h"
+
+// Interrupts, highest priority first
+static const uint8_t PRIV_IRQS[] = {IRQ_MEI, IRQ_MSI, IRQ_MTI, IRQ_SEI, IRQ_SSI, IRQ_STI};
+
+void RISCV_priv_reset(RISCV_st *cpu)
+{
+	assert(cpu);
+
+	memset(&cpu->priv, 0, sizeof(cpu->priv));
+	cpu->priv.mode = PRIV_M;
+	cpu->priv.mtimecmp = UINT64_MAX;
+	RISCV_mmu_flush(cpu);
+}
+
+// mip with the timer interrupt, pending as long as mtime >= mtimecmp
+static uint32_t RISCV_priv_mip(const RISCV_st *cpu)
+{
+	uint32_t mip = cpu->priv.mip;
+
+	if(cpu->priv.mtimecmp != UINT64_MAX && RISCV_time(cpu) >= cpu->priv.mtimecmp)
+		mip |= MIP_MTIP;
+
+	return mip;
+}
+
+// Trap vector base and mode, the modes past vectored are reserved
+static uint32_t RISCV_priv_tvec(uint32_t value)
+{
+	return (value & 0x3) > 1? value & ~0x3u : value;
+}
+
+static void RISCV_priv_mstatus(RISCV_st *cpu, uint32_t value)
+{
+	uint32_t old = cpu->priv.mstatus;
+
+	value &= MSTATUS_MASK;
+	// MPP can't hold the reserved mode 2
+	if(((value & MSTATUS_MPP) >> MSTATUS_MPP_SHIFT) == 2)
+		value = (value & ~MSTATUS_MPP) | (old & MSTATUS_MPP);
+	// Translations depend on them
+	if((old ^ value) & (MSTATUS_SUM | MSTATUS_MXR))
+		RISCV_mmu_flush(cpu);
+
+	cpu->priv.mstatus = value;
+}
+
+bool RISCV_csr_read(const RISCV_st *cpu, uint16_t csr, uint32_t *value)
+{
+	const RISCV_priv_st *priv = &cpu->priv;
+	uint64_t instret = cpu->csr.instret + cpu->csr.retired;
+
+	assert(value);
+
+	if(CSR_MODE(csr) > priv->mode)
+		return false;
+
+	switch(csr){
+		// No timing model behind cycle, one cycle per instruction
+		case CSR_CYCLE:
+		case CSR_INSTRET:
+		case CSR_MCYCLE:
+		case CSR_MINSTRET:	*value = instret; break;
+		case CSR_CYCLEH:
+		case CSR_INSTRETH:
+		case CSR_MCYCLEH:
+		case CSR_MINSTRETH:	*value = instret >> 32; break;
+		case CSR_TIME:		*value = RISCV_time(cpu); break;
+		case CSR_TIMEH:		*value = RISCV_time(cpu) >> 32; break;
+
+		case CSR_SSTATUS:	*value = priv->mstatus & SSTATUS_MASK; break;
+		case CSR_SIE:		*value = priv->mie & priv->mideleg; break;
+		case CSR_STVEC:		*value = priv->stvec; break;
+		case CSR_SCOUNTEREN:*value = priv->scounteren; break;
+		case CSR_SSCRATCH:	*value = priv->sscratch; break;
+		case CSR_SEPC:		*value = priv->sepc; break;
+		case CSR_SCAUSE:	*value = priv->scause; break;
+		case CSR_STVAL:		*value = priv->stval; break;
+		case CSR_SIP:		*value = RISCV_priv_mip(cpu) & priv->mideleg; break;
+		case CSR_SATP:{
+			if(priv->mode == PRIV_S && (priv->mstatus & MSTATUS_TVM))
+				return false;
+			*value = priv->satp;
+		}break;
+
+		case CSR_MSTATUS:	*value = priv->mstatus; break;
+		case CSR_MISA:		*value = MISA_VALUE; break;
+		case CSR_MEDELEG:	*value = priv->medeleg; break;
+		case CSR_MIDELEG:	*value = priv->mideleg; break;
+		case CSR_MIE:		*value = priv->mie; break;
+		case CSR_MTVEC:		*value = priv->mtvec; break;
+		case CSR_MCOUNTEREN:*value = priv->mcounteren; break;
+		case CSR_MSCRATCH:	*value = priv->mscratch; break;
+		case CSR_MEPC:		*value = priv->mepc; break;
+		case CSR_MCAUSE:	*value = priv->mcause; break;
+		case CSR_MTVAL:		*value = priv->mtval; break;
+		case CSR_MIP:		*value = RISCV_priv_mip(cpu); break;
+		// Little endian, no vendor, single hart
+		case CSR_MSTATUSH:
+		case CSR_MVENDORID:
+		case CSR_MARCHID:
+		case CSR_MIMPID:
+		case CSR_MHARTID:
+		case CSR_MCONFIGPTR:*value = 0; break;
+
+		default:{
+			// No PMP, there are no entries
+			if((csr >= CSR_PMPCFG0 && csr < CSR_PMPCFG0 + 4) || (csr >= CSR_PMPADDR0 && csr < CSR_PMPADDR0 + 16))
+				*value = 0;
+			else
+				return false;
+		}
+	}
+
+	return true;
+}
+
+bool RISCV_csr_write(RISCV_st *cpu, uint16_t csr, uint32_t value)
+{
+	RISCV_priv_st *priv = &cpu->priv;
+
+	assert(cpu);
+
+	if(CSR_MODE(csr) > priv->mode || CSR_READ_ONLY(csr))
+		return false;
+
+	switch(csr){
+		case CSR_SSTATUS:	RISCV_priv_mstatus(cpu, (priv->mstatus & ~SSTATUS_MASK) | (value & SSTATUS_MASK)); break;
+		case CSR_SIE:		priv->mie = (priv->mie & ~priv->mideleg) | (value & priv->mideleg); break;
+		case CSR_STVEC:		priv->stvec = RISCV_priv_tvec(value); return true;
+		case CSR_SCOUNTEREN:priv->scounteren = value; return true;
+		case CSR_SSCRATCH:	priv->sscratch = value; return true;
+		case CSR_SEPC:		priv->sepc = value & ~0x1u; return true;
+		case CSR_SCAUSE:	priv->scause = value; return true;
+		case CSR_STVAL:		priv->stval = value; return true;
+		// S mode only sets its software interrupt
+		case CSR_SIP:		priv->mip = (priv->mip & ~(priv->mideleg & MIP_SSIP)) | (value & priv->mideleg & MIP_SSIP); break;
+		case CSR_SATP:{
+			if(priv->mode == PRIV_S && (priv->mstatus & MSTATUS_TVM))
+				return false;
+			priv->satp = value & (SATP_MODE | SATP_PPN);
+			RISCV_mmu_flush(cpu);
+		}break;
+
+		case CSR_MSTATUS:	RISCV_priv_mstatus(cpu, value); break;
+		case CSR_MEDELEG:	priv->medeleg = value & MEDELEG_MASK; return true;
+		case CSR_MIDELEG:	priv->mideleg = value & MIP_S_MASK; break;
+		case CSR_MIE:		priv->mie = value & MIE_MASK; break;
+		case CSR_MTVEC:		priv->mtvec = RISCV_priv_tvec(value); return true;
+		case CSR_MCOUNTEREN:priv->mcounteren = value; return true;
+		case CSR_MSCRATCH:	priv->mscratch = value; return true;
+		case CSR_MEPC:		priv->mepc = value & ~0x1u; return true;
+		case CSR_MCAUSE:	priv->mcause = value; return true;
+		case CSR_MTVAL:		priv->mtval = value; return true;
+		// The others come from devices
+		case CSR_MIP:		priv->mip = (priv->mip & ~MIP_S_MASK) | (value & MIP_S_MASK); break;
+
+		// Fixed, writes are ignored
+		case CSR_MISA:
+		case CSR_MSTATUSH:
+		case CSR_MCYCLE:
+		case CSR_MINSTRET:
+		case CSR_MCYCLEH:
+		case CSR_MINSTRETH:	return true;
+
+		default:{
+			if((csr >= CSR_PMPCFG0 && csr < CSR_PMPCFG0 + 4) || (csr >= CSR_PMPADDR0 && csr < CSR_PMPADDR0 + 16))
+				return true;
+			return false;
+		}
+	}
+
+	// Translation or enabled interrupts may have changed
+	cpu->stop = RISCV_STOP_SWITCH;
+	return true;
+}
+
+// Mode taking the trap of cause, M mode ones are never delegated
+static uint8_t RISCV_priv_target(const RISCV_st *cpu, uint32_t cause)
+{
+	uint32_t deleg = (cause & CAUSE_INTERRUPT)? cpu->priv.mideleg : cpu->priv.medeleg;
+
+	if(cpu->priv.mode != PRIV_M && ((deleg >> (cause & 0x1F)) & 1))
+		return PRIV_S;
+	return PRIV_M;
+}
+
+// Handler address, vectored mode is for interrupts only
+static uint32_t RISCV_priv_vector(uint32_t tvec, uint32_t cause)
+{
+	if((tvec & 0x3) == 1 && (cause & CAUSE_INTERRUPT))
+		return (tvec & ~0x3u) + 4 * (cause & ~CAUSE_INTERRUPT);
+	return tvec & ~0x3u;
+}
+
+void RISCV_trap(RISCV_st *cpu, uint32_t cause, uint32_t tval)
+{
+	RISCV_priv_st *priv = NULL;
+	uint8_t from = 0;
+
+	assert(cpu);
+
+	priv = &cpu->priv;
+	from = priv->mode;
+
+	DEBUG_PRINT("Trap, cause: 0x%08x, tval: 0x%08x at pc: 0x%08x.\n", cause, tval, cpu->pc);
+
+	if(RISCV_priv_target(cpu, cause) == PRIV_S){
+		priv->sepc = cpu->pc;
+		priv->scause = cause;
+		priv->stval = tval;
+		priv->mstatus &= ~(MSTATUS_SPP | MSTATUS_SPIE);
+		if(from == PRIV_S)
+			priv->mstatus |= MSTATUS_SPP;
+		if(priv->mstatus & MSTATUS_SIE)
+			priv->mstatus |= MSTATUS_SPIE;
+		priv->mstatus &= ~MSTATUS_SIE;
+		priv->mode = PRIV_S;
+		cpu->pc = RISCV_priv_vector(priv->stvec, cause);
+	}
+	else{
+		priv->mepc = cpu->pc;
+		priv->mcause = cause;
+		priv->mtval = tval;
+		priv->mstatus &= ~(MSTATUS_MPP | MSTATUS_MPIE);
+		priv->mstatus |= (uint32_t)from << MSTATUS_MPP_SHIFT;
+		if(priv->mstatus & MSTATUS_MIE)
+			priv->mstatus |= MSTATUS_MPIE;
+		priv->mstatus &= ~MSTATUS_MIE;
+		priv->mode = PRIV_M;
+		cpu->pc = RISCV_priv_vector(priv->mtvec, cause);
+	}
+
+	// Permissions of the translations depend on the mode
+	if(priv->mode != from)
+		RISCV_mmu_flush(cpu);
+}
+
+bool RISCV_priv_exception(RISCV_st *cpu, const RISCV_dinstr_st *di)
+{
+	uint32_t cause = CAUSE_ILLEGAL, tval = 0, vector = 0;
+	uint8_t op = 0;
+	bool mmu_fault = false;
+
+	assert(cpu);
+
+	// Translation faults are told by the access, in the VM core
+	mmu_fault = cpu->mmu->fault;
+	cpu->mmu->fault = false;
+	if(!RISCV_priv_guest_traps(cpu))
+		return false;
+
+	if(mmu_fault){
+		cause = cpu->mmu->cause;
+		tval = cpu->mmu->tval;
+	}
+	else if(!di){
+		cause = (cpu->pc & 0x1)? CAUSE_MISALIGNED_FETCH : CAUSE_FETCH_ACCESS;
+		tval = cpu->pc;
+	}
+	else if(cpu->fault && cpu->fault->access){
+		op = RISCV_op_first(di->op);
+		cause = (op >= RISCV_OP_LB && op <= RISCV_OP_LHU)? CAUSE_LOAD_ACCESS : CAUSE_STORE_ACCESS;
+		tval = cpu->fault->addr;
+	}
+	else{
+		switch(RISCV_op_first(di->op)){
+			case RISCV_OP_ECALL:	cause = CAUSE_ECALL_U + cpu->priv.mode; break;
+			case RISCV_OP_EBREAK:	cause = CAUSE_BREAKPOINT; tval = cpu->pc; break;
+			default:				cause = CAUSE_ILLEGAL; tval = di->instr; break;
+		}
+	}
+
+	// The handler itself traps, this would go on forever
+	if(RISCV_priv_target(cpu, cause) == PRIV_S)
+		vector = RISCV_priv_vector(cpu->priv.stvec, cause);
+	else
+		vector = RISCV_priv_vector(cpu->priv.mtvec, cause);
+	if(cpu->pc == vector)
+		return false;
+
+	RISCV_trap(cpu, cause, tval);
+	cpu->stop = RISCV_STOP_NONE;
+	if(cpu->fault)
+		cpu->fault->access = false;
+
+	return true;
+}
+
+bool RISCV_priv_interrupt(RISCV_st *cpu)
+{
+	const RISCV_priv_st *priv = NULL;
+	uint32_t pending = 0, enabled = 0;
+
+	assert(cpu);
+
+	priv = &cpu->priv;
+	pending = RISCV_priv_mip(cpu) & priv->mie;
+	if(!pending || !RISCV_priv_guest_traps(cpu))
+		return false;
+
+	// Not delegated: enabled by MIE in M mode, always below
+	if(priv->mode != PRIV_M || (priv->mstatus & MSTATUS_MIE))
+		enabled |= pending & ~priv->mideleg;
+	// Delegated: enabled by SIE in S mode, always in U mode, never in M mode
+	if(priv->mode == PRIV_U || (priv->mode == PRIV_S && (priv->mstatus & MSTATUS_SIE)))
+		enabled |= pending & priv->mideleg;
+
+	for(size_t i=0 ; i<sizeof(PRIV_IRQS) ; i++){
+		if(enabled & (1u << PRIV_IRQS[i])){
+			RISCV_trap(cpu, CAUSE_INTERRUPT | PRIV_IRQS[i], 0);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool RISCV_priv_mret(RISCV_st *cpu)
+{
+	RISCV_priv_st *priv = &cpu->priv;
+	uint8_t to = (priv->mstatus & MSTATUS_MPP) >> MSTATUS_MPP_SHIFT;
+
+	if(priv->mode != PRIV_M)
+		return false;
+
+	priv->mstatus &= ~(MSTATUS_MIE | MSTATUS_MPP);
+	if(priv->mstatus & MSTATUS_MPIE)
+		priv->mstatus |= MSTATUS_MIE;
+	priv->mstatus |= MSTATUS_MPIE;
+	if(to != PRIV_M)
+		priv->mstatus &= ~MSTATUS_MPRV;
+	priv->mode = to;
+	cpu->pc = priv->mepc;
+
+	if(to != PRIV_M)
+		RISCV_mmu_flush(cpu);
+	cpu->stop = RISCV_STOP_SWITCH;
+	return true;
+}
+
+bool RISCV_priv_sret(RISCV_st *cpu)
+{
+	RISCV_priv_st *priv = &cpu->priv;
+	uint8_t to = (priv->mstatus & MSTATUS_SPP)? PRIV_S : PRIV_U;
+
+	if(priv->mode == PRIV_U || (priv->mode == PRIV_S && (priv->mstatus & MSTATUS_TSR)))
+		return false;
+
+	priv->mstatus &= ~(MSTATUS_SIE | MSTATUS_SPP | MSTATUS_MPRV);
+	if(priv->mstatus & MSTATUS_SPIE)
+		priv->mstatus |= MSTATUS_SIE;
+	priv->mstatus |= MSTATUS_SPIE;
+	if(to != priv->mode)
+		RISCV_mmu_flush(cpu);
+	priv->mode = to;
+	cpu->pc = priv->sepc;
+
+	cpu->stop = RISCV_STOP_SWITCH;
+	return true;
+}
+
+bool RISCV_priv_wfi(RISCV_st *cpu)
+{
+	const RISCV_priv_st *priv = &cpu->priv;
+
+	if(priv->mode == PRIV_U || (priv->mode == PRIV_S && (priv->mstatus & MSTATUS_TW)))
+		return false;
+
+	// No waiting, back to RISCV_run() for pending interrupts
+	cpu->stop = RISCV_STOP_SWITCH;
+	return true;
+}
+
+bool RISCV_priv_sfence_vma(RISCV_st *cpu)
+{
+	const RISCV_priv_st *priv = &cpu->priv;
+
+	if(priv->mode == PRIV_U || (priv->mode == PRIV_S && (priv->mstatus & MSTATUS_TVM)))
+		return false;
+
+	// Whatever the address and ASID
+	RISCV_mmu_flush(cpu);
+	return true;
+}
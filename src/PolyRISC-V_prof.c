@@ -0,0 +1,205 @@
+#include <inttypes.h>
+#include "PolyRISC-V_prof.h"
+#include "PolyRISC-V_elf.h"
+
+#define PROF_STACKS_MIN 256 // initial slots
+
+// Start of the function addr belongs to, addr itself without symbols
+static pc_kt RISCV_prof_function(const RISCV_st *cpu, pc_kt addr)
+{
+	const RISCV_sym_st *sym = RISCV_symtab_lookup(cpu->symtab, addr);
+
+	return sym? sym->addr : addr;
+}
+
+bool RISCV_prof_start(RISCV_st *cpu, uint64_t period)
+{
+	RISCV_prof_st *prof = NULL;
+
+	assert(cpu);
+
+	if(!RISCV_PROF){
+		fprintf(stderr, "Error, profiling isn't built in (build with PROF=1).\n");
+		return false;
+	}
+
+	if(cpu->prof)
+		RISCV_prof_stop(cpu);
+
+	prof = calloc(1, sizeof(RISCV_prof_st));
+	if(!prof)
+		return false;
+
+	prof->stacks_size = PROF_STACKS_MIN;
+	prof->stacks = calloc(prof->stacks_size, sizeof(RISCV_prof_stack_st));
+	if(!prof->stacks){
+		free(prof);
+		return false;
+	}
+	prof->period = period? period : PROF_PERIOD;
+	prof->left = prof->period;
+	prof->root = RISCV_prof_function(cpu, cpu->pc);
+
+	cpu->prof = prof;
+	// Translated calls and returns would skip the shadow stack
+	RISCV_icache_flush(cpu);
+	return true;
+}
+
+void RISCV_prof_stop(RISCV_st *cpu)
+{
+	RISCV_prof_st *prof = NULL;
+
+	assert(cpu);
+
+	prof = cpu->prof;
+	if(!prof)
+		return;
+	cpu->prof = NULL;
+
+	free(prof->stacks);
+	free(prof->pool);
+	free(prof);
+	// Calls and returns can be translated again
+	RISCV_icache_flush(cpu);
+}
+
+static uint32_t RISCV_prof_hash(const pc_kt *frames, uint32_t depth)
+{
+	uint32_t hash = 2166136261u; // FNV-1a
+
+	for(uint32_t i=0 ; i<depth ; i++){
+		hash ^= frames[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+// Slot of the stack, or the empty one it goes to
+static RISCV_prof_stack_st* RISCV_prof_find(const RISCV_prof_st *prof,
+		const pc_kt *frames, uint32_t depth, uint32_t hash)
+{
+	size_t mask = prof->stacks_size - 1;
+
+	for(size_t i=hash & mask ; ; i=(i + 1) & mask){
+		RISCV_prof_stack_st *stack = &prof->stacks[i];
+
+		if(!stack->depth)
+			return stack;
+		if(stack->hash == hash && stack->depth == depth &&
+				!memcmp(&prof->pool[stack->frames], frames, depth * sizeof(pc_kt)))
+			return stack;
+	}
+}
+
+// Twice as many slots, kept at most half full
+static bool RISCV_prof_grow(RISCV_prof_st *prof)
+{
+	RISCV_prof_stack_st *old = prof->stacks;
+	size_t old_size = prof->stacks_size;
+
+	prof->stacks = calloc(old_size * 2, sizeof(RISCV_prof_stack_st));
+	if(!prof->stacks){
+		prof->stacks = old;
+		return false;
+	}
+	prof->stacks_size = old_size * 2;
+
+	for(size_t i=0 ; i<old_size ; i++){
+		if(old[i].depth)
+			*RISCV_prof_find(prof, &prof->pool[old[i].frames], old[i].depth, old[i].hash) = old[i];
+	}
+	free(old);
+
+	return true;
+}
+
+void RISCV_prof_sample(RISCV_st *cpu)
+{
+	RISCV_prof_st *prof = NULL;
+	RISCV_prof_stack_st *stack = NULL;
+	pc_kt frames[PROF_DEPTH + 2];
+	uint32_t depth = 0, hash = 0;
+	pc_kt leaf = 0;
+
+	assert(cpu);
+	assert(cpu->prof);
+
+	prof = cpu->prof;
+	prof->samples++;
+
+	// root, callees, then the function of pc if it isn't the last callee
+	//	(jumped to without a call). Without symbols, pc is in the last one.
+	frames[depth++] = prof->root;
+	for(uint32_t i=0 ; i<prof->depth && i<PROF_DEPTH ; i++)
+		frames[depth++] = prof->stack[i];
+	if(cpu->symtab){
+		leaf = RISCV_prof_function(cpu, cpu->pc);
+		if(leaf != frames[depth - 1])
+			frames[depth++] = leaf;
+	}
+
+	hash = RISCV_prof_hash(frames, depth);
+	stack = RISCV_prof_find(prof, frames, depth, hash);
+	if(stack->depth){
+		stack->count++;
+		return;
+	}
+
+	// New stack
+	if(prof->pool_size - prof->pool_used < depth){
+		size_t size = prof->pool_size? prof->pool_size * 2 : 0x1000;
+		pc_kt *pool = NULL;
+
+		while(size - prof->pool_used < depth)
+			size *= 2;
+		pool = realloc(prof->pool, size * sizeof(pc_kt));
+		if(!pool){
+			fprintf(stderr, "Error, could not allocate profiler stacks, sample dropped.\n");
+			return;
+		}
+		prof->pool = pool;
+		prof->pool_size = size;
+	}
+	memcpy(&prof->pool[prof->pool_used], frames, depth * sizeof(pc_kt));
+	*stack = (RISCV_prof_stack_st){hash, depth, prof->pool_used, 1};
+	prof->pool_used += depth;
+	prof->stacks_used++;
+
+	if(prof->stacks_used * 2 > prof->stacks_size && !RISCV_prof_grow(prof))
+		fprintf(stderr, "Error, could not grow the profiler stacks table.\n");
+}
+
+bool RISCV_prof_write(const RISCV_st *cpu, FILE *f)
+{
+	const RISCV_prof_st *prof = NULL;
+
+	assert(cpu);
+	assert(f);
+
+	prof = cpu->prof;
+	if(!prof)
+		return false;
+
+	for(size_t i=0 ; i<prof->stacks_size ; i++){
+		const RISCV_prof_stack_st *stack = &prof->stacks[i];
+
+		if(!stack->depth)
+			continue;
+		for(uint32_t j=0 ; j<stack->depth ; j++){
+			pc_kt addr = prof->pool[stack->frames + j];
+			const RISCV_sym_st *sym = RISCV_symtab_lookup(cpu->symtab, addr);
+
+			if(j)
+				fputc(';', f);
+			if(sym)
+				fputs(sym->name, f);
+			else
+				fprintf(f, "0x%08x", addr);
+		}
+		fprintf(f, " %" PRIu64 "\n", stack->count);
+	}
+
+	return !ferror(f);
+}
@@ -0,0 +1,256 @@
+#include "PolyRISC-V_rvc.h"
+
+// Quadrants, bits 0 to 1 (3 is a 32 bits instruction)
+#define C_Q0	0x0
+#define C_Q1	0x1
+#define C_Q2	0x2
+
+// funct3, bits 13 to 15
+#define C_Q0_ADDI4SPN	0x0
+#define C_Q0_LW			0x2
+#define C_Q0_SW			0x6
+#define C_Q1_ADDI		0x0
+#define C_Q1_JAL		0x1
+#define C_Q1_LI			0x2
+#define C_Q1_LUI		0x3 // addi16sp with rd = sp
+#define C_Q1_MISC_ALU	0x4
+#define C_Q1_J			0x5
+#define C_Q1_BEQZ		0x6
+#define C_Q1_BNEZ		0x7
+#define C_Q2_SLLI		0x0
+#define C_Q2_LWSP		0x2
+#define C_Q2_JR_MV_ADD	0x4 // jalr and ebreak as well
+#define C_Q2_SWSP		0x6
+
+// Bits from to to of instr, at bit at
+#define C_BITS(instr, from, to, at) ((((uint32_t)(instr) >> (to)) & ((1u << ((from) - (to) + 1)) - 1)) << (at))
+
+// Register fields, rd'/rs1'/rs2' are x8 to x15
+#define C_RD(instr)		C_BITS(instr, 11, 7, 0)
+#define C_RS2(instr)	C_BITS(instr, 6, 2, 0)
+#define C_RDP(instr)	(8 + C_BITS(instr, 4, 2, 0))
+#define C_RS1P(instr)	(8 + C_BITS(instr, 9, 7, 0))
+
+static int32_t sign_extend(uint32_t value, uint8_t bits)
+{
+	uint32_t sign = 1u << (bits - 1);
+
+	return (int32_t)((value ^ sign) - sign);
+}
+
+// RV32I encodings
+static uint32_t encode_r(uint8_t opcode, uint8_t funct3, uint8_t funct7, uint8_t rd, uint8_t rs1, uint8_t rs2)
+{
+	return (uint32_t)funct7 << 25 | (uint32_t)rs2 << 20 | (uint32_t)rs1 << 15 |
+		(uint32_t)funct3 << 12 | (uint32_t)rd << 7 | opcode;
+}
+
+static uint32_t encode_i(uint8_t opcode, uint8_t funct3, uint8_t rd, uint8_t rs1, int32_t imm)
+{
+	return ((uint32_t)imm & 0xFFF) << 20 | (uint32_t)rs1 << 15 | (uint32_t)funct3 << 12 | (uint32_t)rd << 7 | opcode;
+}
+
+static uint32_t encode_s(uint8_t funct3, uint8_t rs1, uint8_t rs2, int32_t imm)
+{
+	return C_BITS(imm, 11, 5, 25) | (uint32_t)rs2 << 20 | (uint32_t)rs1 << 15 |
+		(uint32_t)funct3 << 12 | C_BITS(imm, 4, 0, 7) | OP_STORE;
+}
+
+static uint32_t encode_b(uint8_t funct3, uint8_t rs1, uint8_t rs2, int32_t imm)
+{
+	return C_BITS(imm, 12, 12, 31) | C_BITS(imm, 10, 5, 25) | (uint32_t)rs2 << 20 | (uint32_t)rs1 << 15 |
+		(uint32_t)funct3 << 12 | C_BITS(imm, 4, 1, 8) | C_BITS(imm, 11, 11, 7) | OP_BRANCH;
+}
+
+static uint32_t encode_j(uint8_t rd, int32_t imm)
+{
+	return C_BITS(imm, 20, 20, 31) | C_BITS(imm, 10, 1, 21) | C_BITS(imm, 11, 11, 20) |
+		C_BITS(imm, 19, 12, 12) | (uint32_t)rd << 7 | OP_JAL;
+}
+
+// c.jal and c.j offset
+static int32_t decode_cj(uint16_t instr)
+{
+	return sign_extend(
+		C_BITS(instr, 12, 12, 11) | C_BITS(instr, 11, 11, 4) | C_BITS(instr, 10, 9, 8) |
+		C_BITS(instr, 8, 8, 10) | C_BITS(instr, 7, 7, 6) | C_BITS(instr, 6, 6, 7) |
+		C_BITS(instr, 5, 3, 1) | C_BITS(instr, 2, 2, 5), 12);
+}
+
+// c.beqz and c.bnez offset
+static int32_t decode_cb(uint16_t instr)
+{
+	return sign_extend(
+		C_BITS(instr, 12, 12, 8) | C_BITS(instr, 11, 10, 3) | C_BITS(instr, 6, 5, 6) |
+		C_BITS(instr, 4, 3, 1) | C_BITS(instr, 2, 2, 5), 9);
+}
+
+// 6 bits immediate of c.addi, c.li, c.andi
+static int32_t decode_ci(uint16_t instr)
+{
+	return sign_extend(C_BITS(instr, 12, 12, 5) | C_BITS(instr, 6, 2, 0), 6);
+}
+
+// c.lw and c.sw offset
+static int32_t decode_cl(uint16_t instr)
+{
+	return C_BITS(instr, 12, 10, 3) | C_BITS(instr, 6, 6, 2) | C_BITS(instr, 5, 5, 6);
+}
+
+static uint32_t expand_q0(uint16_t instr)
+{
+	switch(C_BITS(instr, 15, 13, 0)){
+		case C_Q0_ADDI4SPN:{
+			uint32_t imm = C_BITS(instr, 12, 11, 4) | C_BITS(instr, 10, 7, 6) |
+				C_BITS(instr, 6, 6, 2) | C_BITS(instr, 5, 5, 3);
+
+			// 0 is reserved, which makes 0x0000 illegal
+			if(!imm)
+				return 0;
+			return encode_i(OP_OP_IMM, F3_OP_IMM_ADDI, C_RDP(instr), SP, imm);
+		}
+
+		case C_Q0_LW:
+			return encode_i(OP_LOAD, F3_LOAD_LW, C_RDP(instr), C_RS1P(instr), decode_cl(instr));
+
+		case C_Q0_SW:
+			return encode_s(F3_STORE_SW, C_RS1P(instr), C_RDP(instr), decode_cl(instr));
+
+		default:
+			// Floating point, reserved
+			return 0;
+	}
+}
+
+static uint32_t expand_q1_misc_alu(uint16_t instr)
+{
+	uint8_t rd = C_RS1P(instr);
+
+	switch(C_BITS(instr, 11, 10, 0)){
+		case 0x0:
+		case 0x1:{
+			// shamt[5] must be 0 on RV32
+			if(C_BITS(instr, 12, 12, 0))
+				return 0;
+			return encode_r(OP_OP_IMM, F3_OP_IMM_SRXI,
+					C_BITS(instr, 10, 10, 0)? F7_OP_IMM_SRXI_SRAI : F7_OP_IMM_SRXI_SRLI,
+					rd, rd, C_RS2(instr));
+		}
+
+		case 0x2:
+			return encode_i(OP_OP_IMM, F3_OP_IMM_ANDI, rd, rd, decode_ci(instr));
+
+		default:{
+			// RV64 subw, addw and reserved ones
+			if(C_BITS(instr, 12, 12, 0))
+				return 0;
+			switch(C_BITS(instr, 6, 5, 0)){
+				case 0x0:	return encode_r(OP_OP, F3_OP_AS, F7_OP_AS_SUB, rd, rd, C_RDP(instr));
+				case 0x1:	return encode_r(OP_OP, F3_OP_XOR, 0, rd, rd, C_RDP(instr));
+				case 0x2:	return encode_r(OP_OP, F3_OP_OR, 0, rd, rd, C_RDP(instr));
+				default:	return encode_r(OP_OP, F3_OP_AND, 0, rd, rd, C_RDP(instr));
+			}
+		}
+	}
+}
+
+static uint32_t expand_q1(uint16_t instr)
+{
+	uint8_t rd = C_RD(instr);
+
+	switch(C_BITS(instr, 15, 13, 0)){
+		case C_Q1_ADDI:
+			return encode_i(OP_OP_IMM, F3_OP_IMM_ADDI, rd, rd, decode_ci(instr));
+
+		case C_Q1_JAL:
+			return encode_j(RA, decode_cj(instr));
+
+		case C_Q1_LI:
+			return encode_i(OP_OP_IMM, F3_OP_IMM_ADDI, rd, ZERO, decode_ci(instr));
+
+		case C_Q1_LUI:{
+			int32_t imm = 0;
+
+			if(rd == SP){
+				// c.addi16sp
+				imm = sign_extend(C_BITS(instr, 12, 12, 9) | C_BITS(instr, 6, 6, 4) |
+						C_BITS(instr, 5, 5, 6) | C_BITS(instr, 4, 3, 7) | C_BITS(instr, 2, 2, 5), 10);
+				if(!imm)
+					return 0;
+				return encode_i(OP_OP_IMM, F3_OP_IMM_ADDI, SP, SP, imm);
+			}
+
+			imm = sign_extend(C_BITS(instr, 12, 12, 17) | C_BITS(instr, 6, 2, 12), 18);
+			if(!imm)
+				return 0;
+			return ((uint32_t)imm & 0xFFFFF000) | (uint32_t)rd << 7 | OP_LUI;
+		}
+
+		case C_Q1_MISC_ALU:
+			return expand_q1_misc_alu(instr);
+
+		case C_Q1_J:
+			return encode_j(ZERO, decode_cj(instr));
+
+		case C_Q1_BEQZ:
+			return encode_b(F3_BRANCH_BEQ, C_RS1P(instr), ZERO, decode_cb(instr));
+
+		default:
+			return encode_b(F3_BRANCH_BNE, C_RS1P(instr), ZERO, decode_cb(instr));
+	}
+}
+
+static uint32_t expand_q2(uint16_t instr)
+{
+	uint8_t rd = C_RD(instr);
+	uint8_t rs2 = C_RS2(instr);
+
+	switch(C_BITS(instr, 15, 13, 0)){
+		case C_Q2_SLLI:{
+			if(C_BITS(instr, 12, 12, 0))
+				return 0;
+			return encode_r(OP_OP_IMM, F3_OP_IMM_SLLI, 0, rd, rd, rs2);
+		}
+
+		case C_Q2_LWSP:{
+			if(rd == ZERO)
+				return 0;
+			return encode_i(OP_LOAD, F3_LOAD_LW, rd, SP,
+					C_BITS(instr, 12, 12, 5) | C_BITS(instr, 6, 4, 2) | C_BITS(instr, 3, 2, 6));
+		}
+
+		case C_Q2_JR_MV_ADD:{
+			if(!C_BITS(instr, 12, 12, 0)){
+				// c.jr, c.mv
+				if(rs2 != ZERO)
+					return encode_r(OP_OP, F3_OP_AS, F7_OP_AS_ADD, rd, ZERO, rs2);
+				if(rd == ZERO)
+					return 0;
+				return encode_i(OP_JALR, 0, ZERO, rd, 0);
+			}
+			// c.ebreak, c.jalr, c.add
+			if(rs2 != ZERO)
+				return encode_r(OP_OP, F3_OP_AS, F7_OP_AS_ADD, rd, rd, rs2);
+			if(rd == ZERO)
+				return encode_i(OP_SYSTEM, F3_SYSTEM_PRIV, ZERO, ZERO, F12_SYSTEM_PRIV_EBREAK);
+			return encode_i(OP_JALR, 0, RA, rd, 0);
+		}
+
+		case C_Q2_SWSP:
+			return encode_s(F3_STORE_SW, SP, rs2, C_BITS(instr, 12, 9, 2) | C_BITS(instr, 8, 7, 6));
+
+		default:
+			// Floating point
+			return 0;
+	}
+}
+
+uint32_t RISCV_rvc_expand(uint16_t instr)
+{
+	switch(C_BITS(instr, 1, 0, 0)){
+		case C_Q0:	return expand_q0(instr);
+		case C_Q1:	return expand_q1(instr);
+		case C_Q2:	return expand_q2(instr);
+		default:	return 0; // not compressed
+	}
+}
@@ -0,0 +1,212 @@
+#include <sched.h>
+#include <unistd.h>
+#include "PolyRISC-V_sched.h"
+
+// Owner only
+static void RISCV_sched_push(RISCV_sched_worker_st *worker, uint32_t job)
+{
+	int64_t bottom = atomic_load_explicit(&worker->bottom, memory_order_relaxed);
+
+	atomic_store_explicit(&worker->queue[bottom & worker->mask], job, memory_order_relaxed);
+	atomic_store_explicit(&worker->bottom, bottom + 1, memory_order_release);
+}
+
+// Any thread, false once the queue is empty
+//	A slot can't be reused before top moves past it: a queue never holds
+//	more jobs than there are, and its size is at least that.
+static bool RISCV_sched_take(RISCV_sched_worker_st *worker, uint32_t *job)
+{
+	int64_t top = 0, bottom = 0;
+
+	for(;;){
+		top = atomic_load_explicit(&worker->top, memory_order_acquire);
+		bottom = atomic_load_explicit(&worker->bottom, memory_order_acquire);
+		if(top >= bottom)
+			return false;
+
+		*job = atomic_load_explicit(&worker->queue[top & worker->mask], memory_order_relaxed);
+		if(atomic_compare_exchange_strong_explicit(&worker->top, &top, top + 1,
+					memory_order_acq_rel, memory_order_relaxed))
+			return true;
+	}
+}
+
+static bool RISCV_sched_steal(RISCV_sched_worker_st *worker, uint32_t *job)
+{
+	RISCV_sched_st *sched = worker->sched;
+	size_t threads = sched->op.threads;
+
+	for(size_t i=1 ; i<threads ; i++){
+		if(RISCV_sched_take(&sched->workers[(worker->id + i) % threads], job)){
+			worker->steals++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// One quantum of job, back in the queue if it has to go on
+static void RISCV_sched_slice(RISCV_sched_worker_st *worker, uint32_t index)
+{
+	RISCV_sched_st *sched = worker->sched;
+	RISCV_job_st *job = &sched->jobs[index];
+	uint64_t left = job->max_instructions - job->run.retired;
+	RISCV_run_st run = {0};
+
+	run = RISCV_run(job->cpu, left < sched->op.quantum? left : sched->op.quantum);
+	job->run.reason = run.reason;
+	job->run.retired += run.retired;
+	job->slices++;
+	worker->retired += run.retired;
+
+	if(run.reason == RISCV_STOP_BUDGET && job->run.retired < job->max_instructions){
+		RISCV_sched_push(worker, index);
+		return;
+	}
+
+	job->done = true;
+	atomic_fetch_sub_explicit(&sched->remaining, 1, memory_order_release);
+}
+
+static void* RISCV_sched_worker(void *arg)
+{
+	RISCV_sched_worker_st *worker = arg;
+	RISCV_sched_st *sched = worker->sched;
+	uint32_t job = 0;
+
+	while(atomic_load_explicit(&sched->remaining, memory_order_acquire)){
+		if(RISCV_sched_take(worker, &job) || RISCV_sched_steal(worker, &job))
+			RISCV_sched_slice(worker, job);
+		else
+			// Everything left is running elsewhere
+			sched_yield();
+	}
+
+	return NULL;
+}
+
+RISCV_sched_st* RISCV_sched_init(const RISCV_sched_op_st *options)
+{
+	RISCV_sched_st *sched = NULL;
+
+	assert(options);
+
+	sched = calloc(1, sizeof(RISCV_sched_st));
+	if(!sched)
+		return NULL;
+
+	sched->op = *options;
+	if(!sched->op.threads){
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		sched->op.threads = online > 0? (size_t)online : 1;
+	}
+	if(!sched->op.quantum)
+		sched->op.quantum = SCHED_QUANTUM;
+
+	// Owner and thief fields sit on their own cache lines
+	sched->workers = aligned_alloc(_Alignof(RISCV_sched_worker_st),
+			sched->op.threads * sizeof(RISCV_sched_worker_st));
+	if(!sched->workers){
+		fprintf(stderr, "Error, could not allocate %zu scheduler threads.\n", sched->op.threads);
+		free(sched);
+		return NULL;
+	}
+	memset(sched->workers, 0, sched->op.threads * sizeof(RISCV_sched_worker_st));
+	for(size_t i=0 ; i<sched->op.threads ; i++){
+		sched->workers[i].sched = sched;
+		sched->workers[i].id = i;
+	}
+
+	return sched;
+}
+
+void RISCV_sched_deinit(RISCV_sched_st *sched)
+{
+	if(!sched)
+		return;
+
+	for(size_t i=0 ; i<sched->jobs_count ; i++)
+		RISCV_deinit(sched->jobs[i].cpu);
+	for(size_t i=0 ; i<sched->op.threads ; i++)
+		free(sched->workers[i].queue);
+	free(sched->workers);
+	free(sched->jobs);
+	free(sched);
+}
+
+bool RISCV_sched_add(RISCV_sched_st *sched, RISCV_st *cpu, uint64_t max_instructions)
+{
+	assert(sched);
+	assert(cpu);
+
+	if(sched->jobs_count == sched->jobs_size){
+		size_t size = sched->jobs_size? sched->jobs_size * 2 : 0x40;
+		RISCV_job_st *jobs = NULL;
+
+		if(size > UINT32_MAX)
+			goto error;
+		jobs = realloc(sched->jobs, size * sizeof(RISCV_job_st));
+		if(!jobs)
+			goto error;
+		sched->jobs = jobs;
+		sched->jobs_size = size;
+	}
+
+	sched->jobs[sched->jobs_count++] = (RISCV_job_st){cpu, max_instructions, {RISCV_STOP_NONE, 0}, 0, false};
+	return true;
+
+error:
+	fprintf(stderr, "Error, could not add job %zu to the scheduler.\n", sched->jobs_count);
+	RISCV_deinit(cpu);
+	return false;
+}
+
+bool RISCV_sched_run(RISCV_sched_st *sched)
+{
+	size_t threads = 0, started = 1, pending = 0, size = 1;
+
+	assert(sched);
+
+	threads = sched->op.threads;
+	while(size < sched->jobs_count)
+		size <<= 1;
+
+	for(size_t i=0 ; i<threads ; i++){
+		RISCV_sched_worker_st *worker = &sched->workers[i];
+
+		free(worker->queue);
+		worker->queue = calloc(size, sizeof(*worker->queue));
+		if(!worker->queue){
+			fprintf(stderr, "Error, could not allocate a run queue of %zu jobs.\n", size);
+			return false;
+		}
+		worker->mask = size - 1;
+		atomic_store(&worker->top, 0);
+		atomic_store(&worker->bottom, 0);
+		worker->retired = 0;
+		worker->steals = 0;
+	}
+
+	// Spread evenly, stealing evens out the rest
+	for(size_t i=0 ; i<sched->jobs_count ; i++){
+		if(sched->jobs[i].done)
+			continue;
+		RISCV_sched_push(&sched->workers[pending++ % threads], i);
+	}
+	atomic_store(&sched->remaining, pending);
+
+	// The calling thread is worker 0, queues of threads which failed to start
+	// get stolen from
+	for( ; started<threads ; started++){
+		if(pthread_create(&sched->workers[started].thread, NULL, RISCV_sched_worker, &sched->workers[started])){
+			fprintf(stderr, "Error, could not start scheduler thread %zu, running with %zu.\n", started, started);
+			break;
+		}
+	}
+	RISCV_sched_worker(&sched->workers[0]);
+	for(size_t i=1 ; i<started ; i++)
+		pthread_join(sched->workers[i].thread, NULL);
+
+	return true;
+}
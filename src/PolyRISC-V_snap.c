@@ -0,0 +1,169 @@
+// memfd_create()
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <sys/mman.h>
+#include "PolyRISC-V_snap.h"
+#include "PolyRISC-V_sys.h"
+#include "PolyRISC-V_mmu.h"
+
+#if RISCV_HAS_SNAP
+// Writes exactly size bytes at off, false on error
+static bool write_at(int fd, const void *buf, size_t size, off_t off)
+{
+	const uint8_t *p = buf;
+
+	while(size){
+		ssize_t n = pwrite(fd, p, size, off);
+		if(n <= 0)
+			return false;
+		p += n;
+		size -= n;
+		off += n;
+	}
+
+	return true;
+}
+
+// Guest memory of cpu from the snapshot, private copy on write
+static bool RISCV_snap_map(RISCV_st *cpu, const RISCV_snap_st *snap)
+{
+	void *mem = mmap(cpu->mem, snap->size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_FIXED, snap->fd, 0);
+
+	if(mem == MAP_FAILED){
+		fprintf(stderr, "Error, cannot map the snapshot memory.\n");
+		return false;
+	}
+
+	return true;
+}
+#endif
+
+RISCV_snap_st* RISCV_snap_take(RISCV_st *cpu)
+{
+#if RISCV_HAS_SNAP
+	RISCV_snap_st *snap = NULL;
+	size_t page = sysconf(_SC_PAGESIZE);
+
+	assert(cpu);
+
+	snap = calloc(1, sizeof(RISCV_snap_st));
+	if(!snap)
+		return NULL;
+
+	snap->size = (cpu->mem_size + page - 1) & ~(page - 1);
+	snap->fd = memfd_create("riscv-snapshot", MFD_CLOEXEC);
+	if(snap->fd < 0 || ftruncate(snap->fd, snap->size)){
+		fprintf(stderr, "Error, cannot create the snapshot memory file.\n");
+		goto error;
+	}
+
+	// Zero pages stay holes of the file
+	for(size_t ofs=0 ; ofs<snap->size ; ofs+=page){
+		const uint8_t *p = cpu->mem + ofs;
+
+		if(!p[0] && !memcmp(p, p + 1, page - 1))
+			continue;
+		if(!write_at(snap->fd, p, page, ofs)){
+			fprintf(stderr, "Error, cannot write the snapshot memory file.\n");
+			goto error;
+		}
+	}
+
+	snap->mem_size = cpu->mem_size;
+	memcpy(snap->reg, cpu->reg, sizeof(snap->reg));
+	snap->pc = cpu->pc;
+	snap->entry = cpu->entry;
+	snap->stack_top = cpu->stack_top;
+	snap->stack_bot = cpu->stack_bot;
+	snap->brk = cpu->sys->brk;
+	snap->priv = cpu->priv;
+	snap->core = cpu->core;
+	snap->guard = cpu->fault != NULL;
+
+	// Same content, decoded instructions stay valid
+	if(!RISCV_snap_map(cpu, snap))
+		goto error;
+
+	return snap;
+
+error:
+	RISCV_snap_free(snap);
+	return NULL;
+#else
+	(void)cpu;
+	fprintf(stderr, "Error, snapshots need Linux.\n");
+	return NULL;
+#endif
+}
+
+void RISCV_snap_free(RISCV_snap_st *snap)
+{
+	if(!snap)
+		return;
+#if RISCV_HAS_SNAP
+	// Mappings keep the file alive
+	if(snap->fd >= 0)
+		close(snap->fd);
+#endif
+	free(snap);
+}
+
+bool RISCV_snap_restore(RISCV_st *cpu, const RISCV_snap_st *snap)
+{
+#if RISCV_HAS_SNAP
+	assert(cpu);
+	assert(snap);
+
+	if(cpu->mem_size != snap->mem_size){
+		fprintf(stderr, "Error, snapshot of %zu bytes, cpu memory is %zu bytes.\n",
+				snap->mem_size, cpu->mem_size);
+		return false;
+	}
+
+	if(!RISCV_snap_map(cpu, snap))
+		return false;
+	RISCV_icache_flush(cpu);
+
+	memcpy(cpu->reg, snap->reg, sizeof(cpu->reg));
+	cpu->pc = snap->pc;
+	cpu->entry = snap->entry;
+	cpu->stack_top = snap->stack_top;
+	cpu->stack_bot = snap->stack_bot;
+	RISCV_sys_restore(cpu->sys, snap->brk);
+	cpu->priv = snap->priv;
+	RISCV_mmu_flush(cpu);
+	cpu->stop = RISCV_STOP_NONE;
+
+	return true;
+#else
+	(void)cpu;
+	(void)snap;
+	fprintf(stderr, "Error, snapshots need Linux.\n");
+	return false;
+#endif
+}
+
+RISCV_st* RISCV_snap_fork(const RISCV_snap_st *snap)
+{
+	RISCV_init_op_st iop = {0};
+	RISCV_st *cpu = NULL;
+
+	assert(snap);
+
+	// mem_size is already rounded up when guarded
+	iop.mem_size = snap->mem_size;
+	iop.stack_size = snap->mem_size - snap->stack_bot;
+	iop.core = snap->core;
+	iop.guard = snap->guard;
+	cpu = RISCV_init(&iop);
+	if(!cpu)
+		return NULL;
+
+	if(!RISCV_snap_restore(cpu, snap)){
+		RISCV_deinit(cpu);
+		return NULL;
+	}
+
+	return cpu;
+}
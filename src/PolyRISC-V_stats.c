@@ -0,0 +1,175 @@
+#include <inttypes.h>
+#include "PolyRISC-V_stats.h"
+#include "PolyRISC-V_elf.h"
+#include "PolyRISC-V_rvc.h"
+
+// Opcode groups of the instruction mix
+static const char * const STATS_CLASSES[32] = {
+	[OP_LOAD >> 2] = "load",
+	[OP_MISC_MEM >> 2] = "misc-mem",
+	[OP_OP_IMM >> 2] = "op-imm",
+	[OP_AUIPC >> 2] = "auipc",
+	[OP_STORE >> 2] = "store",
+	[OP_OP >> 2] = "op",
+	[OP_LUI >> 2] = "lui",
+	[OP_BRANCH >> 2] = "branch",
+	[OP_JALR >> 2] = "jalr",
+	[OP_JAL >> 2] = "jal",
+	[OP_SYSTEM >> 2] = "system"
+};
+
+#define STATS_OP_NAME(NAME, name) #name,
+static const char * const STATS_OPS[RISCV_OP_COUNT] = {
+	RISCV_INSTR_LIST(STATS_OP_NAME)
+	[RISCV_OP_CSR] = RISCV_CSR_LIST(STATS_OP_NAME)
+};
+#undef STATS_OP_NAME
+
+typedef struct{
+	pc_kt pc;
+	uint64_t hits;
+}RISCV_stats_hot_st;
+
+bool RISCV_stats_start(RISCV_st *cpu)
+{
+	RISCV_stats_st *stats = NULL;
+
+	assert(cpu);
+
+	if(!RISCV_STATS){
+		fprintf(stderr, "Error, statistics aren't built in (build with STATS=1).\n");
+		return false;
+	}
+
+	if(cpu->stats)
+		RISCV_stats_stop(cpu);
+
+	stats = calloc(1, sizeof(RISCV_stats_st));
+	if(!stats)
+		return false;
+
+	// Counters of code never run stay untouched zero pages
+	stats->hits = RISCV_table_alloc(cpu->icache_size * sizeof(uint64_t));
+	if(!stats->hits){
+		fprintf(stderr, "Error, could not allocate the execution counters.\n");
+		free(stats);
+		return false;
+	}
+
+	cpu->stats = stats;
+	// Fused pairs would only count their first instruction
+	RISCV_icache_flush(cpu);
+	return true;
+}
+
+void RISCV_stats_stop(RISCV_st *cpu)
+{
+	RISCV_stats_st *stats = NULL;
+
+	assert(cpu);
+
+	stats = cpu->stats;
+	if(!stats)
+		return;
+	cpu->stats = NULL;
+
+	RISCV_table_free(stats->hits, cpu->icache_size * sizeof(uint64_t));
+	free(stats);
+}
+
+// Instruction run from halfword i
+//	Code overwritten since it ran is counted as what is there now
+static uint32_t RISCV_stats_instr(const RISCV_st *cpu, size_t i)
+{
+	if(cpu->icache[i].exec)
+		return cpu->icache[i].instr;
+	return RISCV_read_instr(cpu, i << 1);
+}
+
+// Hottest first
+static int RISCV_stats_hot_cmp(const void *a, const void *b)
+{
+	const RISCV_stats_hot_st *x = a;
+	const RISCV_stats_hot_st *y = b;
+
+	if(x->hits != y->hits)
+		return x->hits < y->hits? 1 : -1;
+	return x->pc < y->pc? -1 : x->pc > y->pc;
+}
+
+void RISCV_stats_report(const RISCV_st *cpu, FILE *f, size_t top)
+{
+	const RISCV_stats_st *stats = NULL;
+	RISCV_stats_hot_st *hot = NULL;
+	uint64_t classes[32] = {0};
+	uint64_t ops[RISCV_OP_COUNT] = {0};
+	uint64_t total = 0;
+	size_t count = 0;
+
+	assert(cpu);
+	assert(f);
+
+	stats = cpu->stats;
+	if(!stats)
+		return;
+
+	// Executed pcs, and the mix of the instructions found there
+	for(size_t i=0 ; i<cpu->icache_size ; i++){
+		RISCV_dinstr_st di = {0};
+
+		if(!stats->hits[i])
+			continue;
+		count++;
+		total += stats->hits[i];
+		RISCV_decode_instr(RISCV_stats_instr(cpu, i), &di);
+		classes[instr_decode_opcode(RISCV_instr_expand(di.instr)) >> 2] += stats->hits[i];
+		ops[di.op] += stats->hits[i];
+	}
+
+	fprintf(f, "retired: %" PRIu64 ", time: %.6f s, MIPS: %.2f\n",
+			stats->retired, stats->seconds,
+			stats->seconds > 0? stats->retired / stats->seconds / 1e6 : 0.0);
+	if(!total)
+		return;
+
+	fprintf(f, "instruction classes:\n");
+	for(size_t i=0 ; i<32 ; i++){
+		if(classes[i])
+			fprintf(f, "  %-10s %14" PRIu64 "  %6.2f%%\n",
+					STATS_CLASSES[i]? STATS_CLASSES[i] : "other", classes[i], 100.0 * classes[i] / total);
+	}
+	fprintf(f, "instructions:\n");
+	for(size_t i=0 ; i<RISCV_OP_COUNT ; i++){
+		if(ops[i])
+			fprintf(f, "  %-10s %14" PRIu64 "  %6.2f%%\n",
+					STATS_OPS[i]? STATS_OPS[i] : "?", ops[i], 100.0 * ops[i] / total);
+	}
+
+	// Hot spots
+	hot = malloc(count * sizeof(RISCV_stats_hot_st));
+	if(!hot){
+		fprintf(stderr, "Error, could not allocate the hot spots report.\n");
+		return;
+	}
+	count = 0;
+	for(size_t i=0 ; i<cpu->icache_size ; i++){
+		if(stats->hits[i])
+			hot[count++] = (RISCV_stats_hot_st){i << 1, stats->hits[i]};
+	}
+	qsort(hot, count, sizeof(RISCV_stats_hot_st), RISCV_stats_hot_cmp);
+
+	fprintf(f, "hot spots:\n");
+	for(size_t i=0 ; i<count && i<top ; i++){
+		const RISCV_sym_st *sym = RISCV_symtab_lookup(cpu->symtab, hot[i].pc);
+		char text[64];
+
+		RISCV_disasm(RISCV_stats_instr(cpu, hot[i].pc >> 1), hot[i].pc, text, sizeof(text));
+		fprintf(f, "  %08x: %14" PRIu64 "  %6.2f%%  %-28s", hot[i].pc, hot[i].hits,
+				100.0 * hot[i].hits / total, text);
+		if(sym)
+			fprintf(f, "  <%s+0x%x>", sym->name, hot[i].pc - sym->addr);
+		fprintf(f, "\n");
+	}
+
+	free(hot);
+}
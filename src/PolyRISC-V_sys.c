@@ -0,0 +1,460 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "PolyRISC-V_sys.h"
+
+// errno values of newlib which aren't the Linux ones
+//	They agree up to ERANGE.
+#define SYS_ENOSYS			88
+#define SYS_ENAMETOOLONG	91
+#define SYS_ELOOP			92
+#define SYS_EOVERFLOW		139
+
+// struct timespec and struct timeval of newlib, 64 bits time_t
+typedef struct{
+	int64_t sec;
+	int32_t frac;		// ns or us
+	int32_t pad;
+}RISCV_sys_time_st;
+
+// struct kernel_stat of libgloss
+typedef struct{
+	uint64_t dev;
+	uint64_t ino;
+	uint32_t mode;
+	uint32_t nlink;
+	uint32_t uid;
+	uint32_t gid;
+	uint64_t rdev;
+	uint64_t pad1;
+	int64_t size;
+	int32_t blksize;
+	int32_t pad2;
+	int64_t blocks;
+	RISCV_sys_time_st atim;
+	RISCV_sys_time_st mtim;
+	RISCV_sys_time_st ctim;
+	int32_t reserved[2];
+}RISCV_sys_stat_st;
+
+_Static_assert(sizeof(RISCV_sys_stat_st) == 128, "struct kernel_stat of libgloss is 128 bytes");
+
+RISCV_sys_st* RISCV_sys_init(void)
+{
+	RISCV_sys_st *sys = calloc(1, sizeof(RISCV_sys_st));
+
+	if(!sys)
+		return NULL;
+
+	for(size_t i=0 ; i<SYS_FDS ; i++)
+		sys->fds[i] = i <= STDERR_FILENO? (int)i : -1;
+	sys->out_fd = -1;
+
+	return sys;
+}
+
+// Files the guest opened are closed, its fds 0 to 2 are the host ones again
+static void RISCV_sys_close_all(RISCV_sys_st *sys)
+{
+	for(size_t i=0 ; i<SYS_FDS ; i++){
+		if(sys->fds[i] > STDERR_FILENO)
+			close(sys->fds[i]);
+		sys->fds[i] = i <= STDERR_FILENO? (int)i : -1;
+	}
+}
+
+void RISCV_sys_deinit(RISCV_sys_st *sys)
+{
+	if(!sys)
+		return;
+
+	RISCV_sys_flush(sys);
+	RISCV_sys_close_all(sys);
+	free(sys->out);
+	free(sys);
+}
+
+void RISCV_sys_restore(RISCV_sys_st *sys, uint32_t brk)
+{
+	assert(sys);
+
+	// Output of the last run first
+	RISCV_sys_flush(sys);
+	RISCV_sys_close_all(sys);
+	sys->brk = brk;
+	sys->exited = false;
+	sys->exit_code = 0;
+}
+
+bool RISCV_sys_flush(RISCV_sys_st *sys)
+{
+	size_t done = 0;
+	bool ok = true;
+
+	assert(sys);
+
+	while(done < sys->out_used){
+		ssize_t n = write(sys->out_fd, sys->out + done, sys->out_used - done);
+
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0){
+			fprintf(stderr, "Error, cannot write the guest output (host fd %d): %s\n",
+					sys->out_fd, strerror(errno));
+			ok = false;
+			break;
+		}
+		done += n;
+	}
+	sys->out_used = 0;
+
+	return ok;
+}
+
+bool RISCV_sys_buffer(RISCV_sys_st *sys, int host, const uint8_t *data, size_t size)
+{
+	assert(sys);
+
+	// One fd at a time in the buffer, so that the order is kept
+	if(sys->out_used && (sys->out_fd != host || sys->out_used + size > SYS_OUT_SIZE))
+		RISCV_sys_flush(sys);
+
+	if(size >= SYS_OUT_DIRECT)
+		return false;
+	if(!sys->out)
+		sys->out = malloc(SYS_OUT_SIZE);
+	if(!sys->out)
+		return false;
+
+	memcpy(sys->out + sys->out_used, data, size);
+	sys->out_used += size;
+	sys->out_fd = host;
+	return true;
+}
+
+// -errno for the guest
+static int32_t RISCV_sys_error(int error)
+{
+	if(error <= ERANGE)
+		return -error;
+
+	switch(error){
+		case ENOSYS:		return -SYS_ENOSYS;
+		case ENAMETOOLONG:	return -SYS_ENAMETOOLONG;
+		case ELOOP:			return -SYS_ELOOP;
+		case EOVERFLOW:		return -SYS_EOVERFLOW;
+		default:			return -EIO;
+	}
+}
+
+// Host fd of guest fd, -1 if not open
+static int RISCV_sys_fd(const RISCV_sys_st *sys, uint32_t fd)
+{
+	return fd < SYS_FDS? sys->fds[fd] : -1;
+}
+
+// size bytes at addr are in guest memory
+static bool RISCV_sys_range(const RISCV_st *cpu, uint32_t addr, uint32_t size)
+{
+	return (uint64_t)addr + size <= cpu->mem_size;
+}
+
+// The host wrote size bytes at addr
+//	Same as guest stores: overwritten instructions are dropped, clean pages
+//	get dirty. Flags are per page, so is the check.
+static void RISCV_sys_stored(RISCV_st *cpu, uint32_t addr, uint32_t size)
+{
+	while(size){
+		uint32_t chunk = RISCV_PAGE_SIZE - (addr & (RISCV_PAGE_SIZE - 1));
+
+		if(chunk > size)
+			chunk = size;
+		if(cpu->pages[addr >> RISCV_PAGE_SHIFT])
+			RISCV_page_write(cpu, addr, chunk);
+		addr += chunk;
+		size -= chunk;
+	}
+}
+
+static int32_t RISCV_sys_write(RISCV_st *cpu, uint32_t fd, uint32_t addr, uint32_t size)
+{
+	RISCV_sys_st *sys = cpu->sys;
+	int host = RISCV_sys_fd(sys, fd);
+	ssize_t n = 0;
+
+	if(host < 0)
+		return -EBADF;
+	if(!RISCV_sys_range(cpu, addr, size))
+		return -EFAULT;
+
+	if(RISCV_sys_buffer(sys, host, cpu->mem + addr, size))
+		return size;
+
+	// Straight from guest memory
+	RISCV_sys_flush(sys);
+	do{
+		n = write(host, cpu->mem + addr, size);
+	}while(n < 0 && errno == EINTR);
+
+	return n < 0? RISCV_sys_error(errno) : (int32_t)n;
+}
+
+static int32_t RISCV_sys_read(RISCV_st *cpu, uint32_t fd, uint32_t addr, uint32_t size)
+{
+	RISCV_sys_st *sys = cpu->sys;
+	int host = RISCV_sys_fd(sys, fd);
+	ssize_t n = 0;
+
+	if(host < 0)
+		return -EBADF;
+	if(!RISCV_sys_range(cpu, addr, size))
+		return -EFAULT;
+
+	// Prompts first
+	RISCV_sys_flush(sys);
+
+	// Straight into guest memory
+	do{
+		n = read(host, cpu->mem + addr, size);
+	}while(n < 0 && errno == EINTR);
+	if(n < 0)
+		return RISCV_sys_error(errno);
+
+	RISCV_sys_stored(cpu, addr, n);
+	return n;
+}
+
+static int32_t RISCV_sys_openat(RISCV_st *cpu, int32_t dirfd, uint32_t path, uint32_t flags, uint32_t mode)
+{
+	RISCV_sys_st *sys = cpu->sys;
+	int host_dirfd = AT_FDCWD;
+	int host_flags = O_CLOEXEC;
+	int host = -1;
+	uint32_t fd = 0;
+
+	// NUL terminated in guest memory, used in place
+	if(path >= cpu->mem_size || !memchr(cpu->mem + path, 0, cpu->mem_size - path))
+		return -EFAULT;
+
+	if(dirfd != SYS_AT_FDCWD){
+		host_dirfd = RISCV_sys_fd(sys, dirfd);
+		if(host_dirfd < 0)
+			return -EBADF;
+	}
+
+	// Lowest free one
+	while(fd < SYS_FDS && sys->fds[fd] >= 0)
+		fd++;
+	if(fd == SYS_FDS)
+		return -EMFILE;
+
+	switch(flags & SYS_O_ACCMODE){
+		case 0:		host_flags |= O_RDONLY; break;
+		case 1:		host_flags |= O_WRONLY; break;
+		default:	host_flags |= O_RDWR; break;
+	}
+	if(flags & SYS_O_APPEND)
+		host_flags |= O_APPEND;
+	if(flags & SYS_O_CREAT)
+		host_flags |= O_CREAT;
+	if(flags & SYS_O_TRUNC)
+		host_flags |= O_TRUNC;
+	if(flags & SYS_O_EXCL)
+		host_flags |= O_EXCL;
+
+	host = openat(host_dirfd, (const char *)cpu->mem + path, host_flags, (mode_t)mode);
+	if(host < 0)
+		return RISCV_sys_error(errno);
+
+	sys->fds[fd] = host;
+	return fd;
+}
+
+static int32_t RISCV_sys_close(RISCV_st *cpu, uint32_t fd)
+{
+	RISCV_sys_st *sys = cpu->sys;
+	int host = RISCV_sys_fd(sys, fd);
+
+	if(host < 0)
+		return -EBADF;
+
+	RISCV_sys_flush(sys);
+	sys->fds[fd] = -1;
+	// The host keeps its own standard streams
+	if(host > STDERR_FILENO && close(host))
+		return RISCV_sys_error(errno);
+
+	return 0;
+}
+
+static int32_t RISCV_sys_lseek(RISCV_st *cpu, uint32_t fd, int32_t offset, uint32_t whence)
+{
+	RISCV_sys_st *sys = cpu->sys;
+	int host = RISCV_sys_fd(sys, fd);
+	off_t pos = 0;
+
+	if(host < 0)
+		return -EBADF;
+
+	RISCV_sys_flush(sys);
+	pos = lseek(host, offset, whence);
+	if(pos < 0)
+		return RISCV_sys_error(errno);
+	if(pos > INT32_MAX)
+		return -SYS_EOVERFLOW;
+
+	return pos;
+}
+
+static RISCV_sys_time_st RISCV_sys_timespec(const struct timespec *ts)
+{
+	return (RISCV_sys_time_st){ts->tv_sec, ts->tv_nsec, 0};
+}
+
+static int32_t RISCV_sys_fstat(RISCV_st *cpu, uint32_t fd, uint32_t addr)
+{
+	RISCV_sys_st *sys = cpu->sys;
+	int host = RISCV_sys_fd(sys, fd);
+	RISCV_sys_stat_st gst = {0};
+	struct stat st = {0};
+
+	if(host < 0)
+		return -EBADF;
+	if(!RISCV_sys_range(cpu, addr, sizeof(gst)))
+		return -EFAULT;
+
+	// Sizes count what was written so far
+	RISCV_sys_flush(sys);
+	if(fstat(host, &st))
+		return RISCV_sys_error(errno);
+
+	gst.dev = st.st_dev;
+	gst.ino = st.st_ino;
+	gst.mode = st.st_mode;
+	gst.nlink = st.st_nlink;
+	gst.uid = st.st_uid;
+	gst.gid = st.st_gid;
+	gst.rdev = st.st_rdev;
+	gst.size = st.st_size;
+	gst.blksize = st.st_blksize;
+	gst.blocks = st.st_blocks;
+	gst.atim = RISCV_sys_timespec(&st.st_atim);
+	gst.mtim = RISCV_sys_timespec(&st.st_mtim);
+	gst.ctim = RISCV_sys_timespec(&st.st_ctim);
+
+	memcpy(cpu->mem + addr, &gst, sizeof(gst));
+	RISCV_sys_stored(cpu, addr, sizeof(gst));
+	return 0;
+}
+
+// clock_gettime64(), or gettimeofday() with us
+static int32_t RISCV_sys_time(RISCV_st *cpu, uint32_t clock, uint32_t addr, bool us)
+{
+	RISCV_sys_time_st gts = {0};
+	struct timespec ts = {0};
+
+	if(clock != CLOCK_REALTIME && clock != CLOCK_MONOTONIC)
+		return -EINVAL;
+	// gettimeofday() may be given no timeval, only a timezone. A NULL
+	// timespec faults as on Linux, 0 is where flat binaries start.
+	if(!addr)
+		return us? 0 : -EFAULT;
+	if(!RISCV_sys_range(cpu, addr, sizeof(gts)))
+		return -EFAULT;
+
+	clock_gettime(clock, &ts);
+	gts = RISCV_sys_timespec(&ts);
+	if(us)
+		gts.frac /= 1000;
+
+	memcpy(cpu->mem + addr, &gts, sizeof(gts));
+	RISCV_sys_stored(cpu, addr, sizeof(gts));
+	return 0;
+}
+
+// New program break, the current one if addr isn't between the end of the
+// program and the stack
+static uint32_t RISCV_sys_brk(RISCV_st *cpu, uint32_t addr)
+{
+	RISCV_sys_st *sys = cpu->sys;
+
+	if(!sys->brk)
+		sys->brk = cpu->stack_bot;
+	if(addr >= cpu->stack_bot && addr < (uint32_t)cpu->reg[SP])
+		sys->brk = addr;
+
+	return sys->brk;
+}
+
+static void RISCV_sys_exit(RISCV_st *cpu, int32_t code)
+{
+	RISCV_sys_st *sys = cpu->sys;
+
+	RISCV_sys_flush(sys);
+	sys->exited = true;
+	sys->exit_code = code;
+	cpu->stop = RISCV_STOP_HALT;
+}
+
+void RISCV_sys_call(RISCV_st *cpu)
+{
+	reg_kt *a = &cpu->reg[A0];
+	uint32_t number = cpu->reg[A7];
+
+	assert(cpu);
+	assert(cpu->sys);
+
+	DEBUG_PRINT("Syscall %u (0x%08x, 0x%08x, 0x%08x, 0x%08x).\n", number,
+			(uint32_t)a[0], (uint32_t)a[1], (uint32_t)a[2], (uint32_t)a[3]);
+
+	switch(number){
+		case SYS_EXIT:
+		case SYS_EXIT_GROUP:{
+			RISCV_sys_exit(cpu, a[0]);
+		}break;
+
+		case SYS_WRITE:{
+			a[0] = RISCV_sys_write(cpu, a[0], a[1], a[2]);
+		}break;
+
+		case SYS_READ:{
+			a[0] = RISCV_sys_read(cpu, a[0], a[1], a[2]);
+		}break;
+
+		case SYS_OPENAT:{
+			a[0] = RISCV_sys_openat(cpu, a[0], a[1], a[2], a[3]);
+		}break;
+
+		case SYS_CLOSE:{
+			a[0] = RISCV_sys_close(cpu, a[0]);
+		}break;
+
+		case SYS_LSEEK:{
+			a[0] = RISCV_sys_lseek(cpu, a[0], a[1], a[2]);
+		}break;
+
+		case SYS_FSTAT:{
+			a[0] = RISCV_sys_fstat(cpu, a[0], a[1]);
+		}break;
+
+		case SYS_BRK:{
+			a[0] = RISCV_sys_brk(cpu, a[0]);
+		}break;
+
+		case SYS_GETTIMEOFDAY:{
+			a[0] = RISCV_sys_time(cpu, CLOCK_REALTIME, a[0], true);
+		}break;
+
+		case SYS_CLOCK_GETTIME64:{
+			a[0] = RISCV_sys_time(cpu, a[0], a[1], false);
+		}break;
+
+		default:{
+			// ecall has no compressed form
+			fprintf(stderr, "Error, unknown syscall %u at pc: 0x%08x.\n", number, cpu->pc - 4);
+			a[0] = -SYS_ENOSYS;
+		}
+	}
+}
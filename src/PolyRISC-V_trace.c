@@ -0,0 +1,103 @@
+#include <time.h>
+#include "PolyRISC-V_trace.h"
+
+static void* RISCV_trace_writer(void *arg)
+{
+	RISCV_trace_st *trace = arg;
+	const struct timespec idle = {0, 100000}; // 100us
+	uint64_t tail = atomic_load(&trace->tail);
+	uint64_t head = 0;
+	bool stop = false;
+
+	for(;;){
+		// Read stop first: once set, head won't move anymore
+		stop = atomic_load(&trace->stop);
+		head = atomic_load_explicit(&trace->head, memory_order_acquire);
+		if(head == tail){
+			if(stop)
+				break;
+			nanosleep(&idle, NULL);
+			continue;
+		}
+
+		// Drain by contiguous chunks
+		while(tail != head){
+			size_t idx = tail & (TRACE_RING_SIZE - 1);
+			size_t count = head - tail;
+			if(count > TRACE_RING_SIZE - idx)
+				count = TRACE_RING_SIZE - idx;
+
+			fwrite(&trace->ring[idx], sizeof(RISCV_trace_rec_st), count, trace->f);
+			tail += count;
+			atomic_store_explicit(&trace->tail, tail, memory_order_release);
+		}
+	}
+
+	return NULL;
+}
+
+bool RISCV_trace_start(RISCV_st *cpu, const char *path)
+{
+	RISCV_trace_st *trace = NULL;
+
+	assert(cpu);
+	assert(path);
+
+	if(!RISCV_TRACE){
+		fprintf(stderr, "Error, tracing isn't built in (build with TRACE=1).\n");
+		return false;
+	}
+
+	if(cpu->trace)
+		RISCV_trace_stop(cpu);
+
+	trace = calloc(1, sizeof(RISCV_trace_st));
+	if(!trace)
+		return false;
+
+	trace->ring = malloc(TRACE_RING_SIZE * sizeof(RISCV_trace_rec_st));
+	if(!trace->ring)
+		goto error;
+
+	trace->f = fopen(path, "wb");
+	if(!trace->f){
+		fprintf(stderr, "Cannot open the trace file. Path: %s\n", path);
+		goto error;
+	}
+	fwrite(TRACE_MAGIC, 1, sizeof(TRACE_MAGIC) - 1, trace->f);
+
+	if(pthread_create(&trace->writer, NULL, RISCV_trace_writer, trace))
+		goto error;
+
+	cpu->trace = trace;
+	// Fused pairs would record a single instruction
+	RISCV_icache_flush(cpu);
+	return true;
+
+error:
+	if(trace->f)
+		fclose(trace->f);
+	free(trace->ring);
+	free(trace);
+	return false;
+}
+
+void RISCV_trace_stop(RISCV_st *cpu)
+{
+	RISCV_trace_st *trace = NULL;
+
+	assert(cpu);
+
+	trace = cpu->trace;
+	if(!trace)
+		return;
+	cpu->trace = NULL;
+
+	// Let the writer drain what's left
+	atomic_store(&trace->stop, true);
+	pthread_join(trace->writer, NULL);
+
+	fclose(trace->f);
+	free(trace->ring);
+	free(trace);
+}
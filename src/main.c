@@ -3,32 +3,187 @@
 #include <string.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <inttypes.h>
 #include "PolyRISC-V.h"
+#include "PolyRISC-V_trace.h"
+#include "PolyRISC-V_stats.h"
+#include "PolyRISC-V_prof.h"
+#include "PolyRISC-V_elf.h"
+#include "PolyRISC-V_guard.h"
+#include "PolyRISC-V_sched.h"
+#include "PolyRISC-V_sys.h"
+#include "PolyRISC-V_dev.h"
+#include "PolyRISC-V_debug.h"
+#include "PolyRISC-V_dirty.h"
 
 #define INPUT_BUFFER_SIZE 256
+#define STATS_TOP 20 // hot spots reported
+
+static const char *STOP_NAMES[] = {"none", "budget", "halt", "trap", "breakpoint", "debug breakpoint", "watchpoint", "switch"};
 
 void interactive_run(RISCV_st *cpu);
 void interactive_run_help(void);
+int batch_run(RISCV_st *cpu, uint64_t max_instructions, uint32_t runs);
+int sched_run(RISCV_init_op_st *iop, char **paths, int count, size_t threads, uint64_t max_instructions);
+void usage(const char *exec);
+bool load_raw(RISCV_st *cpu, const char *path);
+bool load(RISCV_st *cpu, const char *path);
+bool prof_write(const RISCV_st *cpu, const char *path);
 
 int main(int argc, char *argv[])
 {
 	int status = EXIT_SUCCESS;
 	RISCV_st *cpu = NULL;
-	RISCV_init_op_st iop = {1024, 512, false};
+	RISCV_init_op_st iop = {1024, 512, false, RISCV_CORE_DEFAULT, true};
+	char *fprog_def_path = "./bin/elfriscv";
+	char *fprog_path = fprog_def_path;
+	char *ftrace_path = NULL;
+	char *fprof_path = NULL;
+	int opt = 0;
+	bool batch = false;
+	bool many = false;
+	bool stats = false;
+	bool devices = false;
+	size_t threads = 0;
+	uint32_t runs = 1;
+	uint64_t max_instructions = UINT64_MAX;
+
+	while((opt = getopt(argc, argv, "t:c:rn:m:uj:sp:dk:")) != -1){
+		switch(opt){
+			case 't':{
+				ftrace_path = optarg;
+			}break;
+			case 'c':{
+				if(!strcmp(optarg, "call"))
+					iop.core = RISCV_CORE_CALL;
+				else if(!strcmp(optarg, "goto"))
+					iop.core = RISCV_CORE_GOTO;
+				else if(!strcmp(optarg, "jit"))
+					iop.core = RISCV_CORE_JIT;
+				else{
+					usage(argv[0]);
+					return EXIT_FAILURE;
+				}
+			}break;
+			case 'r':{
+				batch = true;
+			}break;
+			case 'n':{
+				max_instructions = strtoull(optarg, NULL, 0);
+			}break;
+			case 'm':{
+				iop.mem_size = strtoul(optarg, NULL, 0);
+			}break;
+			case 'u':{
+				iop.guard = false;
+			}break;
+			case 'j':{
+				many = true;
+				threads = strtoul(optarg, NULL, 0);
+			}break;
+			case 's':{
+				stats = true;
+			}break;
+			case 'p':{
+				fprof_path = optarg;
+			}break;
+			case 'd':{
+				devices = true;
+			}break;
+			case 'k':{
+				runs = strtoul(optarg, NULL, 0);
+			}break;
+			default:{
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+		}
+	}
+	if(!runs){
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if(many){
+		if(optind >= argc){
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+		return sched_run(&iop, &argv[optind], argc - optind, threads, max_instructions);
+	}
+	if(optind < argc)
+		fprog_path = argv[optind];
+
+	cpu = RISCV_init(&iop);
+	if(!cpu){
+		fprintf(stderr, "Error initializing RISCV cpu.\n");
+		status = EXIT_FAILURE;
+		goto deinit;
+	}
+
+	if(!load(cpu, fprog_path)){
+		status = EXIT_FAILURE;
+		goto deinit;
+	}
+
+	RISCV_reset(cpu);
+
+	if(devices && (!RISCV_uart_map(cpu, UART_BASE) || !RISCV_clint_map(cpu, CLINT_BASE))){
+		status = EXIT_FAILURE;
+		goto deinit;
+	}
+
+	if(ftrace_path && !RISCV_trace_start(cpu, ftrace_path)){
+		status = EXIT_FAILURE;
+		goto deinit;
+	}
+
+	if(stats && !RISCV_stats_start(cpu)){
+		status = EXIT_FAILURE;
+		goto deinit;
+	}
+
+	if(fprof_path && !RISCV_prof_start(cpu, 0)){
+		status = EXIT_FAILURE;
+		goto deinit;
+	}
+
+	if(batch)
+		status = batch_run(cpu, max_instructions, runs);
+	else
+		interactive_run(cpu);
+
+	if(stats)
+		RISCV_stats_report(cpu, stdout, STATS_TOP);
+	if(fprof_path && !prof_write(cpu, fprof_path))
+		status = EXIT_FAILURE;
+
+deinit:
+	if(cpu){
+		RISCV_deinit(cpu);
+		cpu = NULL;
+	}	
+
+	return status;
+}
+
+// ELF segments are mapped in place, flat binaries are copied to 0
+bool load(RISCV_st *cpu, const char *path)
+{
+	return RISCV_is_elf(path)? RISCV_load_elf(cpu, path) : load_raw(cpu, path);
+}
+
+bool load_raw(RISCV_st *cpu, const char *path)
+{
 	uint8_t *code = NULL;
 	size_t code_size = 0;
-	char *fraw_def_path = "./bin/rawriscv";
-	char *fraw_path = fraw_def_path;
 	FILE *fraw = NULL;
 
-	if(argc > 1)
-		fraw_path = argv[1];
-
-	fraw = fopen(fraw_path, "r");
+	fraw = fopen(path, "r");
 	if(!fraw){
-		fprintf(stderr, "Cannot open the file. Path: %s\nErrno: %s\n", fraw_path, strerror(errno));
-		status = EXIT_FAILURE;
-		goto deinit;
+		fprintf(stderr, "Cannot open the file. Path: %s\nErrno: %s\n", path, strerror(errno));
+		return false;
 	}
 
 	fseek(fraw, 0, SEEK_END);
@@ -38,41 +193,158 @@ int main(int argc, char *argv[])
 	code = malloc(code_size);
 	if(!code){
 		fprintf(stderr, "Could not allocate %lu bytes for riscv instr code.\n", code_size);
-		status = EXIT_FAILURE;
-		goto deinit;
+		fclose(fraw);
+		return false;
 	}
 	
 	fread(code, code_size, 1, fraw);
 	fclose(fraw);
-	fraw = NULL;
 
-	cpu = RISCV_init(&iop);
-	if(!cpu){
-		fprintf(stderr, "Error initializing RISCV cpu.\n");
-		status = EXIT_FAILURE;
-		goto deinit;
+	RISCV_load_raw_program(cpu, code, code_size);
+	free(code);
+
+	return true;
+}
+
+bool prof_write(const RISCV_st *cpu, const char *path)
+{
+	FILE *fprof = fopen(path, "w");
+	bool ok = false;
+
+	if(!fprof){
+		fprintf(stderr, "Cannot open the profile file. Path: %s\nErrno: %s\n", path, strerror(errno));
+		return false;
 	}
+	ok = RISCV_prof_write(cpu, fprof);
+	if(fclose(fprof))
+		ok = false;
+	if(!ok)
+		fprintf(stderr, "Error, could not write the profile. Path: %s\n", path);
 
-	RISCV_load_raw_program(cpu, code, code_size);
-	RISCV_reset(cpu);
-	interactive_run(cpu);
+	return ok;
+}
 
-deinit:
-	if(cpu){
-		RISCV_deinit(cpu);
-		cpu = NULL;
-	}	
+void usage(const char *exec)
+{
+	fprintf(stderr, "Usage: %s [-r] [-n max_instr] [-c call|goto|jit] [-m mem_size] [-u] [-t trace_file] [-s] [-p profile] [-d] [-k runs] [program]\n", exec);
+	fprintf(stderr, "       %s -j threads [-n max_instr] [-c call|goto|jit] [-m mem_size] [-u] program...\n", exec);
+	fprintf(stderr, "\t-r\trun without interaction, then print statistics\n");
+	fprintf(stderr, "\t-n\tstop after max_instr instructions (with -r)\n");
+	fprintf(stderr, "\t-c\texecution core (jit: x86-64 Linux only)\n");
+	fprintf(stderr, "\t-m\tguest memory size in bytes\n");
+	fprintf(stderr, "\t-u\tunguarded guest memory, out of range accesses aren't caught\n");
+	fprintf(stderr, "\t-t\trecord a binary trace (TRACE=1 builds)\n");
+	fprintf(stderr, "\t-s\tprint the instruction mix and hot spots on exit (STATS=1 builds)\n");
+	fprintf(stderr, "\t-p\twrite sampled call stacks, folded for flamegraphs (PROF=1 builds)\n");
+	fprintf(stderr, "\t-d\tmap a UART at 0x%08x and a CLINT timer at 0x%08x (guarded memory only)\n", UART_BASE, CLINT_BASE);
+	fprintf(stderr, "\t-k\trun that many times (with -r), the memory written is restored in between\n");
+	fprintf(stderr, "\t-j\trun every program at once on that many threads (0: one per cpu)\n");
+	fprintf(stderr, "\tprogram\tRV32 ELF executable, or flat binary loaded at 0\n");
+}
+
+// Exit status of the guest, if it called exit(). Runs after the first one
+//	start over from the state it started from, see RISCV_restore_dirty(),
+//	until one doesn't halt. The last one is reported, the instructions and
+//	time of all of them.
+int batch_run(RISCV_st *cpu, uint64_t max_instructions, uint32_t runs)
+{
+	struct timespec start = {0}, stop = {0};
+	RISCV_run_st run = {0};
+	uint64_t retired = 0;
+	double seconds = 0;
 
-	if(code){
-		free(code);
-		code = NULL;
+	assert(cpu);
+	assert(runs);
+
+	if(runs > 1 && !RISCV_dirty_start(cpu))
+		return EXIT_FAILURE;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(uint32_t i=0 ; i<runs ; i++){
+		if(i)
+			RISCV_restore_dirty(cpu);
+		run = RISCV_run(cpu, max_instructions);
+		retired += run.retired;
+		if(run.reason != RISCV_STOP_HALT)
+			break;
 	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
 
-	if(fraw){
-		fclose(fraw);
-		fraw = NULL;
+	printf("stop: %s, pc: 0x%08x\n", STOP_NAMES[run.reason], cpu->pc);
+#if RISCV_HAS_GUARD
+	if(run.reason == RISCV_STOP_TRAP && cpu->fault && cpu->fault->access)
+		printf("access fault at 0x%08x\n", cpu->fault->addr);
+#endif
+	printf("retired: %" PRIu64 ", time: %.6f s, MIPS: %.2f\n",
+			retired, seconds, seconds > 0? retired / seconds / 1e6 : 0.0);
+	if(!cpu->sys->exited)
+		return EXIT_SUCCESS;
+	printf("exit: %" PRId32 "\n", cpu->sys->exit_code);
+
+	return cpu->sys->exit_code;
+}
+
+int sched_run(RISCV_init_op_st *iop, char **paths, int count, size_t threads, uint64_t max_instructions)
+{
+	int status = EXIT_SUCCESS;
+	RISCV_sched_op_st sop = {threads, 0};
+	RISCV_sched_st *sched = NULL;
+	RISCV_st *cpu = NULL;
+	struct timespec start = {0}, stop = {0};
+	uint64_t retired = 0;
+	double seconds = 0;
+
+	assert(iop);
+	assert(paths);
+
+	sched = RISCV_sched_init(&sop);
+	if(!sched)
+		return EXIT_FAILURE;
+
+	for(int i=0 ; i<count ; i++){
+		cpu = RISCV_init(iop);
+		if(!cpu){
+			fprintf(stderr, "Error initializing RISCV cpu.\n");
+			status = EXIT_FAILURE;
+			goto deinit;
+		}
+		if(!load(cpu, paths[i])){
+			RISCV_deinit(cpu);
+			status = EXIT_FAILURE;
+			goto deinit;
+		}
+		RISCV_reset(cpu);
+		if(!RISCV_sched_add(sched, cpu, max_instructions)){
+			status = EXIT_FAILURE;
+			goto deinit;
+		}
 	}
 
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if(!RISCV_sched_run(sched)){
+		status = EXIT_FAILURE;
+		goto deinit;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+
+	for(size_t i=0 ; i<sched->jobs_count ; i++){
+		RISCV_job_st *job = &sched->jobs[i];
+
+		printf("%s: stop: %s, pc: 0x%08x, retired: %" PRIu64 ", slices: %" PRIu32 "\n",
+				paths[i], STOP_NAMES[job->run.reason], job->cpu->pc, job->run.retired, job->slices);
+		retired += job->run.retired;
+	}
+	for(size_t i=0 ; i<sched->op.threads ; i++)
+		printf("thread %zu: retired: %" PRIu64 ", steals: %" PRIu64 "\n",
+				i, sched->workers[i].retired, sched->workers[i].steals);
+	printf("programs: %d, threads: %zu, retired: %" PRIu64 ", time: %.6f s, MIPS: %.2f\n",
+			count, sched->op.threads, retired, seconds, seconds > 0? retired / seconds / 1e6 : 0.0);
+
+deinit:
+	RISCV_sched_deinit(sched);
+
 	return status;
 }
 
@@ -80,20 +352,43 @@ void interactive_run(RISCV_st *cpu)
 {
 	char cmd = 0;
 	uint32_t from = 0, to = 0;
+	RISCV_run_st run = {0};
 	// char buffer[INPUT_BUFFER_SIZE] = {0};
 
 	assert(cpu);
 
 	while(cmd != 'q'){
 		if(cmd != '\n')
-			printf("cmd: (r[estet], s[tep], q[uit], p[rint reg], m[em] from to)? ");
+			printf("cmd: (r[estet], s[tep], c[ontinue], b[reak] addr, w[atch] addr size, d[elete] addr, q[uit], p[rint reg], m[em] from to)? ");
 		scanf("%c", &cmd);
 		switch(cmd){
 			case 'r':{
 				RISCV_reset(cpu);
 			 }break;
 			case 's':{
-				RISCV_step(cpu);
+				// Over the breakpoint it stopped at, if any
+				RISCV_debug_run(cpu, 1);
+			 }break;
+			case 'c':{
+				// Until a breakpoint, a watchpoint or the end
+				run = RISCV_debug_run(cpu, UINT64_MAX);
+				printf("stop: %s, pc: 0x%08x, retired: %" PRIu64 "\n", STOP_NAMES[run.reason], cpu->pc, run.retired);
+				if(run.reason == RISCV_STOP_DEBUG_WATCH)
+					printf("store to 0x%08x\n", cpu->debug->hit);
+			 }break;
+			case 'b':{
+				scanf("%x", &from);
+				RISCV_debug_break(cpu, from);
+			 }break;
+			case 'w':{
+				scanf("%x", &from);
+				scanf("%x", &to);
+				RISCV_debug_watch(cpu, from, to);
+			 }break;
+			case 'd':{
+				scanf("%x", &from);
+				if(!RISCV_debug_delete(cpu, from))
+					fprintf(stderr, "Error, no breakpoint nor watchpoint at 0x%08x.\n", from);
 			 }break;
 			case 'p':{
 				RISCV_print_reg(cpu);
@@ -117,7 +412,10 @@ void interactive_run(RISCV_st *cpu)
 void interactive_run_help(void)
 {
 	printf("Usage: [cmd] [OPTION]...\n");
-	printf("cmd: r (reset), s (step), q (quit), p (print)\n");
+	printf("cmd: r (reset), s (step), c (continue), b (breakpoint), w (watchpoint), d (delete), q (quit), p (print)\n");
+	printf("breakpoint: b addr, stops before the instruction at addr\n");
+	printf("watchpoint: w addr size, stops after stores to the size bytes at addr\n");
+	printf("delete: d addr, the breakpoint at addr or the watchpoint starting there\n");
 	printf("print options: \n");
 	printf("\tc\tPC\n");
 	printf("\ti\tNext instruction\n");
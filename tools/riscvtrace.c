@@ -0,0 +1,101 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include "PolyRISC-V.h"
+#include "PolyRISC-V_trace.h"
+#include "PolyRISC-V_elf.h"
+#include "PolyRISC-V_rvc.h"
+
+// Turns a binary trace recorded with RISCV_trace_start() into text disassembly
+//	Usage: riscvtrace trace_file [elf]
+//	With the traced ELF, pcs get annotated with their symbol
+//	Register and memory columns are worked out from the RV32I form of
+//	compressed instructions.
+
+static bool accesses_mem(const uint32_t instr)
+{
+	uint8_t opcode = instr_decode_opcode(instr);
+
+	return opcode == OP_LOAD || opcode == OP_STORE;
+}
+
+static bool writes_rd(const uint32_t instr)
+{
+	switch(instr_decode_opcode(instr)){
+		case OP_BRANCH:
+		case OP_STORE:
+		case OP_MISC_MEM:
+		case OP_SYSTEM:
+			return false;
+		default:
+			return instr_decode_rd(instr) != ZERO;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int status = EXIT_SUCCESS;
+	FILE *ftrace = NULL;
+	char magic[sizeof(TRACE_MAGIC)] = {0};
+	char text[64] = {0};
+	RISCV_trace_rec_st rec = {0};
+	RISCV_symtab_st *symtab = NULL;
+	const RISCV_sym_st *sym = NULL;
+	uint64_t count = 0;
+
+	if(argc < 2){
+		fprintf(stderr, "Usage: %s trace_file [elf]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if(argc > 2){
+		symtab = RISCV_symtab_load(argv[2]);
+		if(!symtab){
+			status = EXIT_FAILURE;
+			goto deinit;
+		}
+	}
+
+	ftrace = fopen(argv[1], "rb");
+	if(!ftrace){
+		fprintf(stderr, "Cannot open the file. Path: %s\nErrno: %s\n", argv[1], strerror(errno));
+		status = EXIT_FAILURE;
+		goto deinit;
+	}
+
+	if(fread(magic, sizeof(TRACE_MAGIC) - 1, 1, ftrace) != 1 || strcmp(magic, TRACE_MAGIC)){
+		fprintf(stderr, "Not a trace file. Path: %s\n", argv[1]);
+		status = EXIT_FAILURE;
+		goto deinit;
+	}
+
+	while(fread(&rec, sizeof(rec), 1, ftrace) == 1){
+		uint32_t instr = RISCV_instr_expand(rec.instr);
+
+		RISCV_disasm(rec.instr, rec.pc, text, sizeof(text));
+		if(RISCV_INSTR_LEN(rec.instr) == 2)
+			printf("%10" PRIu64 "  %08x:      %04x  %-28s", count, rec.pc, rec.instr, text);
+		else
+			printf("%10" PRIu64 "  %08x:  %08x  %-28s", count, rec.pc, rec.instr, text);
+		sym = RISCV_symtab_lookup(symtab, rec.pc);
+		if(sym)
+			printf("  <%s+0x%x>", sym->name, rec.pc - sym->addr);
+		if(writes_rd(instr))
+			printf("  %s=0x%08x", REG_NAMES[instr_decode_rd(instr)], rec.rd_value);
+		if(accesses_mem(instr))
+			printf("  mem=0x%08x", rec.mem_addr);
+		printf("\n");
+		count++;
+	}
+
+deinit:
+	RISCV_symtab_free(symtab);
+	if(ftrace){
+		fclose(ftrace);
+		ftrace = NULL;
+	}
+
+	return status;
+}